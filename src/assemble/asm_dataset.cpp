@@ -1,6 +1,10 @@
 #include "asm_dataset.hpp"
 
 #include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cmath>
+#include <fstream>
 #include <memory>
 #include "../utility.hpp"
 
@@ -35,6 +39,11 @@ void AsmDataset::LoadPurged() {
 }
 
 void AsmDataset::Purge() {
+    if (opts_.max_memory > 0) {
+        PurgePartitioned();
+        Dump();
+        return;
+    }
     
     GroupAndFilterDuplicate();
 
@@ -57,15 +66,23 @@ void AsmDataset::Purge() {
 
 void AsmDataset::LoadOverlaps(const std::string &fname) {
     
-    bool scan_overlaps_ = true;
-    if (scan_overlaps_) {
+    if (opts_.max_memory > 0) {
         LOG(INFO)("Scan overlaps to select params");
         ScanOverlapsToSelectParams(opts_.ifname);
 
-    }
+        LOG(INFO)("Spill overlaps to temporary files");
+        SpillOverlaps(opts_.ifname);
+    } else if (opts_.single_pass) {
+        LOG(INFO)("Load overlap file and select params");
+        ScanOverlapsToSelectParams(opts_.ifname, true);
+        FilterOverlapsWithoutLowQuality();
+    } else {
+        LOG(INFO)("Scan overlaps to select params");
+        ScanOverlapsToSelectParams(opts_.ifname);
 
-    LOG(INFO)("Load overlap file");
-    LoadOverlapsWithoutLowQuality(opts_.ifname);
+        LOG(INFO)("Load overlap file");
+        LoadOverlapsWithoutLowQuality(opts_.ifname);
+    }
     
     if (opts_.dump >= 2) {
         DumpOverlaps(OutputPath("load.m4a"));
@@ -90,8 +107,9 @@ void AsmDataset::LoadOverlaps2(const std::string &fname) {
 
     //
     
+    read_infos_.assign(rd_store_.Size(), ReadStatInfo());
     for (size_t i=0; i<rd_store_.Size(); ++i) {
-        read_infos_[i] = ReadStatInfo();
+        read_infos_[i].id = i;
         read_infos_[i].len = rd_store_.GetSeqLength(i);
     }
 }
@@ -124,7 +142,16 @@ void AsmDataset::LoadOverlapsWithoutLowQuality(const std::string &fname) {
     LOG(INFO)("Overlap size: %zd / %zd", ol_store_.Size(), total.load());
 }
 
-void AsmDataset::ScanOverlapsToSelectParams(const std::string &fname) {
+void AsmDataset::FilterOverlapsWithoutLowQuality() {
+    size_t total = ol_store_.Size();
+    ol_store_.Filter([this](const Overlap &o) {
+        return GetReadInfo(o.a_.id).CheckIdentity(o) || GetReadInfo(o.b_.id).CheckIdentity(o);
+    });
+
+    LOG(INFO)("Overlap size: %zd / %zd", ol_store_.Size(), total);
+}
+
+void AsmDataset::ScanOverlapsToSelectParams(const std::string &fname, bool load) {
 
     std::mutex mutex;
 
@@ -145,21 +172,24 @@ void AsmDataset::ScanOverlapsToSelectParams(const std::string &fname) {
 
     auto combine = [&](std::shared_ptr<WorkArea> work) {
         std::lock_guard<std::mutex> lock(mutex);
-        sread_info_.Merge(work->sri);
+        work->sri.MoveTo(read_infos_);
     };
 
     auto scan_overlap = [&](Overlap& o) {
         auto thread_local work = alloc_work();
-        if (opts_.filter0.Valid(o)) {
+        bool valid = opts_.filter0.Valid(o);
+        if (valid) {
             work->sri.Add(o);
         }
         if (work->sri.Size() >= block_size) {
             combine(work);
         }
-        return false;   // not load to memory
+        return load && valid;
     };
 
-    OverlapStore ol(rd_store_.GetStringPool());
+    OverlapStore tmp(rd_store_.GetStringPool());
+    OverlapStore &ol = load ? ol_store_ : tmp;
+    read_infos_.resize(rd_store_.Size());
     if (rd_store_.GetIdRange()[1] > 0) {    // read names have been loaded
         ol.LoadFast(fname, "", (size_t)opts_.thread_size, scan_overlap);
     } else {
@@ -169,17 +199,257 @@ void AsmDataset::ScanOverlapsToSelectParams(const std::string &fname) {
     for (auto & w : works) {
         combine(w);
     }
+    read_infos_.resize(std::max(read_infos_.size(), rd_store_.Size()));    // 没有预先载入read时，名字在扫描中加入
     
-    auto work_func = [&](const std::vector<int>& input) {
-        for (auto i : input) {
-            read_infos_[i].Stat(i, opts_);
+    MultiThreadRun((size_t)opts_.thread_size, 
+        [this]() {
+            return SplitRange(opts_.thread_size, (size_t)0, read_infos_.size());
+        }, 
+        [this](const std::array<size_t, 2> &range) {
+            for (size_t i=range[0]; i<range[1]; ++i) {
+                if (read_infos_[i].Valid()) read_infos_[i].Stat(i, opts_);
+            }
+        }
+    );
+}
+
+
+void AsmDataset::SpillOverlaps(const std::string &fname) {
+    // 按id把read分成若干个桶，每个桶的overlap数量接近。overlap写入它的两端所在的桶
+    size_t size = 0;
+    size_t total = 0;
+    for (const auto &ri : read_infos_) {
+        if (ri.Valid()) {
+            size++;
+            total += ri.count;
+        }
+    }
+    // 桶的数量由预算决定：每个overlap在两端的read中各计数一次，按Bucket::Add的估计(不含detail_)计算载入后的内存。
+    // 每个桶约为预算的1/4，合并时可以接近预算。桶数不超过read数，也不超过同时打开的文件数的限制，超出时一个桶可能大于预算。
+    const size_t max_bucket_count = 1000;
+    const double volume = total / 2.0 * (sizeof(Overlap) + 2*64);
+    const size_t budget = (size_t)(opts_.max_memory * 1024 * 1024 * 1024);
+    const size_t wanted = (size_t)std::ceil(volume * 4 / std::max<size_t>(budget, 1));
+    const size_t bucket_count = std::max<size_t>(1, std::min(std::min(wanted, size), max_bucket_count));
+    if (wanted > max_bucket_count) {
+        LOG(WARNING)("The memory budget needs %zd buckets, use %zd buckets", wanted, max_bucket_count);
+    }
+
+    read_buckets_.assign(read_infos_.size(), -1);
+    size_t acc = 0;
+    for (size_t i = 0; i < read_infos_.size(); ++i) {
+        if (read_infos_[i].Valid()) {
+            read_buckets_[i] = (int)std::min<size_t>(bucket_count - 1, acc * bucket_count / std::max<size_t>(total, 1));
+            acc += read_infos_[i].count;
         }
+    }
+
+    struct Spill {
+        std::mutex mutex;
+        std::ofstream file;
+    };
+    std::vector<Spill> spills(bucket_count);
+    buckets_.assign(bucket_count, Bucket());
+    for (size_t i = 0; i < spills.size(); ++i) {
+        spills[i].file.open(BucketFile(i), std::ios::binary);
+        if (!spills[i].file.is_open()) LOG(ERROR)("Failed to open file: %s", BucketFile(i).c_str());
+    }
+
+    auto spill = [&](int b, const Overlap &o) {
+        std::lock_guard<std::mutex> lock(spills[b].mutex);
+        OverlapStore::ToBinary(spills[b].file, o);
+        buckets_[b].Add(o);
     };
 
+    std::atomic<size_t> valid { 0 };
+    std::atomic<size_t> count { 0 };
+    auto spill_overlap = [&](Overlap &o) {
+        if (opts_.filter0.Valid(o)) {
+            valid++;
+            if (GetReadInfo(o.a_.id).CheckIdentity(o) || GetReadInfo(o.b_.id).CheckIdentity(o)) {
+                count++;
+                int ba = BucketOf(o.a_.id);
+                int bb = BucketOf(o.b_.id);
+                spill(ba, o);
+                if (bb != ba) spill(bb, o);
+            }
+        }
+        return false;
+    };
 
-    MultiThreadRun((size_t)opts_.thread_size, read_infos_, SplitMapKeys<std::unordered_map<int, fsa::ReadStatInfo>>, work_func);   
+    OverlapStore ol(rd_store_.GetStringPool());
+    if (rd_store_.GetIdRange()[1] > 0) {    // read names have been loaded
+        ol.LoadFast(fname, "", (size_t)opts_.thread_size, spill_overlap);
+    } else {
+        ol.Load(fname, "", (size_t)opts_.thread_size, spill_overlap);
+    }
+
+    for (auto &s : spills) {
+        s.file.close();
+    }
+
+    // 多线程写入的顺序与调度有关，逐个桶按id排序后重写，使后面的结果可重现
+    for (size_t k = 0; k < spills.size(); ++k) {
+        OverlapStore bucket(rd_store_.GetStringPool());
+        bucket.LoadBinary(BucketFile(k));
+        std::vector<const Overlap*> sorted(bucket.Size());
+        for (size_t i = 0; i < bucket.Size(); ++i) {
+            sorted[i] = &bucket.Get(i);
+        }
+        std::sort(sorted.begin(), sorted.end(), [](const Overlap* a, const Overlap* b) { return IdOrdered(*a, *b); });
+
+        std::ofstream file(BucketFile(k), std::ios::binary);
+        if (!file.is_open()) LOG(ERROR)("Failed to open file: %s", BucketFile(k).c_str());
+        for (auto o : sorted) {
+            OverlapStore::ToBinary(file, *o);
+        }
+    }
+    LOG(INFO)("Overlap size: %zd / %zd, spilled into %zd buckets", count.load(), valid.load(), spills.size());
 }
 
+void AsmDataset::PurgePartitioned() {
+    // overlap已由SpillOverlaps写入临时文件，两端在不同桶的overlap在两个桶中各有一份。
+    // 1. 在内存预算内逐段载入桶，去重、延伸overlap，统计段内read的覆盖度，把保留的overlap写回桶。
+    // 2. 根据覆盖度过滤read，扫描各桶找出被包含的read。
+    // 3. 扫描各桶，内存中只保留构建string graph需要的overlap：没有被过滤的，以及涉及被包含read的(见GetExtendOverlaps)。
+    //    后者中一端是保留的read的，数量不超过图中read的overlap，全部保留，bridge按它们经过被包含的read连接两个read；
+    //    两端都被过滤的只在phase沿被包含的read延伸时用到，在预算内保留，超出预算的丢弃并给出警告。
+    // 除第1步外，overlap只在它的read a所在的桶中处理。
+    auto owned = [this](const Overlap &o, size_t k) { return BucketOf(o.a_.id) == (int)k; };
+
+    GzFileWriter filtered(OutputPath("filtered_overlaps.txt"));
+    if (!filtered.Valid()) LOG(ERROR)("Failed to open file: %s", OutputPath("filtered_overlaps.txt").c_str());
+    std::ostringstream oss;
+
+    LOG(INFO)("Check Coverage");
+    const size_t budget = (size_t)(opts_.max_memory * 1024 * 1024 * 1024);
+    for (size_t lo = 0, hi = 0; lo < buckets_.size(); lo = hi) {
+        size_t memory = 0;
+        for (hi = lo; hi < buckets_.size() && (hi == lo || memory + buckets_[hi].memory <= budget); ++hi) {
+            memory += buckets_[hi].memory;
+        }
+        auto in_range = [this, lo, hi](Seq::Id id) { return BucketOf(id) >= (int)lo && BucketOf(id) < (int)hi; };
+
+        ol_store_.Clear();
+        groups_.clear();
+        for (size_t k = lo; k < hi; ++k) {
+            // 两端都在[lo, hi)中的overlap在两个桶中，只从编号小的桶载入
+            ol_store_.LoadBinary(BucketFile(k), [&](const Overlap &o) {
+                int other = BucketOf(o.a_.id) == (int)k ? BucketOf(o.b_.id) : BucketOf(o.a_.id);
+                return !(other >= (int)lo && other < (int)k);
+            });
+        }
+        LOG(INFO)("Purge buckets [%zd, %zd): %zd overlaps, about %.2fGB", lo, hi, ol_store_.Size(), memory / (1024.0*1024*1024));
+
+        // 同一对read的overlap在两个桶中的顺序可能不同，需要与顺序无关的比较
+        GroupAndFilterDuplicate(BetterAlignedLengthOrdered);
+        ExtendOverlapToEnd();
+        for (auto iter = groups_.begin(); iter != groups_.end(); ) {
+            if (in_range(iter->first)) {
+                ++iter;
+            } else {
+                iter = groups_.erase(iter);      // 段外read的overlap不全
+            }
+        }
+        AnalyzeCoverage();
+
+        std::vector<std::ofstream> files(hi - lo);
+        for (size_t k = lo; k < hi; ++k) {
+            buckets_[k] = Bucket();
+            files[k - lo].open(BucketFile(k), std::ios::binary);
+            if (!files[k - lo].is_open()) LOG(ERROR)("Failed to open file: %s", BucketFile(k).c_str());
+        }
+        for (size_t i = 0; i < ol_store_.Size(); ++i) {
+            const auto &o = ol_store_.Get(i);
+            if (IsReserved(o)) {
+                int ba = BucketOf(o.a_.id);
+                int bb = BucketOf(o.b_.id);
+                if (in_range(o.a_.id)) {
+                    OverlapStore::ToBinary(files[ba - lo], o);
+                    buckets_[ba].Add(o);
+                }
+                if (bb != ba && in_range(o.b_.id)) {
+                    OverlapStore::ToBinary(files[bb - lo], o);
+                    buckets_[bb].Add(o);
+                }
+            } else if (in_range(o.a_.id)) {
+                WriteFilteredOverlap(oss, o);
+            }
+        }
+        filtered.Flush(oss);
+    }
+    ol_store_.Clear();
+    groups_.clear();
+
+    FilterReadsByCoverage();
+    EstimateGenomeSize();
+
+    LOG(INFO)("Remove contained reads");
+    auto filtered_by_coverage = [this](Seq::Id id) {
+        auto type = GetReadInfo(id).filtered.type;
+        return type != RdReason::RS_OK && type != RdReason::RS_CONTAINED;
+    };
+    for (size_t k = 0; k < buckets_.size(); ++k) {
+        OverlapStore ol(rd_store_.GetStringPool());
+        ol.LoadBinary(BucketFile(k), [&](const Overlap &o) {
+            std::array<int, 2> rel;
+            if (owned(o, k) && !filtered_by_coverage(o.a_.id) && !filtered_by_coverage(o.b_.id) && IsContained(o, rel)) {
+                read_infos_[rel[0]].filtered = RdReason::Contained(rel[1]);
+            }
+            return false;
+        });
+    }
+
+    LOG(INFO)("Start filtering contained reads and relative overlaps");
+    size_t extra_memory = 0;
+    size_t extra_count = 0;
+    size_t dropped = 0;
+    for (size_t k = 0; k < buckets_.size(); ++k) {
+        ol_store_.LoadBinary(BucketFile(k), [&](const Overlap &o) {
+            if (!owned(o, k)) return false;
+
+            // 与内存中的顺序一致：先按覆盖度，再按包含关系标记overlap
+            const auto &ra = GetReadInfo(o.a_.id);
+            const auto &rb = GetReadInfo(o.b_.id);
+            if (filtered_by_coverage(o.a_.id)) {
+                SetOlReason(o, OlReason::FilteredRead(o.a_.id));
+            } else if (filtered_by_coverage(o.b_.id)) {
+                SetOlReason(o, OlReason::FilteredRead(o.b_.id));
+            } else if (!ra.filtered.IsOk()) {
+                SetOlReason(o, OlReason::FilteredRead(o.a_.id));
+            } else if (!rb.filtered.IsOk()) {
+                SetOlReason(o, OlReason::FilteredRead(o.b_.id));
+            } else {
+                SetOlReason(o, OlReason::Ok());
+            }
+
+            if (IsReserved(o)) return true;
+
+            WriteFilteredOverlap(oss, o);
+            if (oss.tellp() > 10000000) filtered.Flush(oss);
+            if (ra.filtered.type != RdReason::RS_CONTAINED && rb.filtered.type != RdReason::RS_CONTAINED) return false;
+            if (ra.filtered.IsOk() || rb.filtered.IsOk()) return true;
+
+            size_t memory = sizeof(Overlap) + o.detail_.size()*sizeof(Overlap::Detail) + 2*64;
+            if (extra_memory + memory > budget) {
+                dropped++;
+                return false;
+            }
+            extra_memory += memory;
+            extra_count++;
+            return true;
+        });
+        std::remove(BucketFile(k).c_str());
+    }
+    filtered.Flush(oss);
+    LOG(INFO)("Keep %zd overlaps between filtered reads for extending, about %.2fGB", extra_count, extra_memory / (1024.0*1024*1024));
+    if (dropped > 0) {
+        LOG(WARNING)("Drop %zd overlaps between filtered reads exceeding the memory budget", dropped);
+    }
+
+    ol_store_.Group(groups_, opts_.thread_size);
+    LOG(INFO)("Overlap size: %zd/%zd", ReservedSize(), ol_store_.Size());
+}
 
 double AsmDataset::CalcLocalOverhangThreshold(std::vector<std::array<double,2>> &overhangs) {
         
@@ -428,32 +698,35 @@ void AsmDataset::ModifyEnd(const Overlap &oldone, int maxoh) {
 void AsmDataset::FilterContained() {
     LOG(INFO)("Remove contained reads");
 
-    std::atomic<size_t> index { 0 };
+    // 每个read记录包含它的overlap中序号最大的一个(0表示没有)，结果与依次处理overlap相同，与线程数无关
+    std::vector<std::atomic<size_t>> containing(read_infos_.size());
+    for (auto &c : containing) c.store(0, std::memory_order_relaxed);
 
-    auto set_contained = [this](int contained, int containing) {
-        auto iter = read_infos_.find(contained);
-        assert(iter != read_infos_.end());
-        iter->second.filtered = RdReason::Contained(containing);
-    };
+    std::atomic<size_t> index { 0 };
     auto work_func = [&](size_t tid) {
         for (size_t i = index.fetch_add(1); i < ol_store_.Size(); i = index.fetch_add(1)) {
             const Overlap& o = ol_store_.Get(i);
-
-            if (IsReserved(o)) {
-                auto loc = o.Location(0);
-                if (loc == Overlap::Loc::Equal) {
-                    set_contained(std::max(o.a_.id, o.b_.id), std::min(o.a_.id, o.b_.id));
-                } else if (loc == Overlap::Loc::Contained) {
-                    set_contained(o.a_.id, o.b_.id);
-                } else if (loc == Overlap::Loc::Containing) {
-                    set_contained(o.b_.id, o.a_.id);
-                }
+            std::array<int, 2> rel;
+            if (IsReserved(o) && IsContained(o, rel)) {
+                auto &c = containing[rel[0]];
+                size_t curr = c.load(std::memory_order_relaxed);
+                while (curr < i + 1 && !c.compare_exchange_weak(curr, i + 1, std::memory_order_relaxed)) {}
             }
         }
     };
 
     MultiThreadRun((size_t)opts_.thread_size, work_func);
 
+    for (size_t id = 0; id < containing.size(); ++id) {
+        size_t c = containing[id].load(std::memory_order_relaxed);
+        if (c > 0) {
+            std::array<int, 2> rel;
+            IsContained(ol_store_.Get(c - 1), rel);
+            assert(rel[0] == (int)id && read_infos_[id].Valid());
+            read_infos_[id].filtered = RdReason::Contained(rel[1]);
+        }
+    }
+
     LOG(INFO)("Start filtering contained reads and relative overlaps");
     UpdateFilteredRead();
 }
@@ -462,38 +735,45 @@ void AsmDataset::FilterContained() {
 void AsmDataset::FilterCoverage() {
     LOG(INFO)("Check Coverage");
 
+    AnalyzeCoverage();
+    FilterReadsByCoverage();
+    UpdateFilteredRead();
+
+}
+
+void AsmDataset::AnalyzeCoverage() {
     auto work_func = [&](const std::vector<int>& input) {
 
         for (auto i : input) {
             auto minmax = AnalyzeCoverage(i, groups_[i]);
-            auto iter = read_infos_.find(i);
-            if (iter != read_infos_.end()) {
-                iter->second.minmax_coverage = {minmax[1], minmax[2]};
-                iter->second.covtype = minmax[0];
+            if (i < (int)read_infos_.size() && read_infos_[i].Valid()) {
+                read_infos_[i].minmax_coverage = {minmax[1], minmax[2]};
+                read_infos_[i].covtype = minmax[0];
             }
         }
     };
 
     MultiThreadRun(opts_.thread_size, groups_, SplitMapKeys<decltype(groups_)>, work_func);  
+}
 
+void AsmDataset::FilterReadsByCoverage() {
     auto threshold = CalcCoverageThreshold();
     int mincov = opts_.min_coverage < 0 ? threshold[0] : opts_.min_coverage;
     int maxcov = threshold[1];
     int maxdiff = threshold[2];
     LOG(INFO)("min_coverage = %d(%d), max_coverage = %d, max_diff_coverage = %d", mincov, threshold[0], maxcov, maxdiff);
     for (auto &c : read_infos_) {
-        const auto &minmax = c.second.minmax_coverage;
+        if (!c.Valid()) continue;
+
+        const auto &minmax = c.minmax_coverage;
         if (minmax[0] < mincov || minmax[1] > maxcov || minmax[1]-minmax[1] > maxdiff) {
-            c.second.filtered = RdReason::Coverage(minmax);
+            c.filtered = RdReason::Coverage(minmax);
         }
 
-        if (c.second.covtype != 0) {
-            c.second.filtered = RdReason::CoverageType(c.second.covtype);
+        if (c.covtype != 0) {
+            c.filtered = RdReason::CoverageType(c.covtype);
         }
     }
-
-    UpdateFilteredRead();
-
 }
 
 
@@ -803,19 +1083,19 @@ double AsmDataset::GetOverlapQuality(const Overlap &ol) {
     }
 }
 
-void AsmDataset::GroupAndFilterDuplicate() {
+void AsmDataset::GroupAndFilterDuplicate(bool (*better)(const Overlap &a, const Overlap &b)) {
     LOG(INFO)("Group overlaps and remove duplicated");
 
     std::vector<std::pair<const Overlap*, OlReason>> ignored;
     std::mutex mutex;
 
-    auto add_overlap = [this](int low, int a, int b, const Overlap& o, std::vector<std::unordered_map<Seq::Id, const Overlap*>>& group) {
+    auto add_overlap = [this, better](int low, int a, int b, const Overlap& o, std::vector<std::unordered_map<Seq::Id, const Overlap*>>& group) {
         
         auto it = group[a-low].find(b);
         if (it == group[a-low].end()) {
             group[a-low][b] = &o;
         } else {
-            if (BetterAlignedLength(o, *(it->second))) {
+            if (better(o, *(it->second))) {
             //if (GetOverlapQuality(o) > GetOverlapQuality(*(it->second))) {
                 SetOlReason(*(it->second), OlReason::Duplicate());
                 it->second = &o;
@@ -994,34 +1274,115 @@ void AsmDataset::ExtendOverlapToEnd() {
     );
 }
 
+// read的覆盖度。它是分段常数函数，只保存由overlap端点得到的断点和断点处的前缀和，不展开到每个碱基
+class CoverageProfile {
+public:
+    // events: (位置, +1/-1)，位置在[0, size)中
+    void Build(std::vector<std::array<int,2>> &events, int size) {
+        std::sort(events.begin(), events.end());
+        points_.assign(1, Point{0, 0, 0});
+        for (const auto &e : events) {
+            auto &last = points_.back();
+            if (e[0] == last.pos) {
+                last.cov += e[1];
+            } else {
+                points_.push_back({e[0], last.cov + e[1], last.prefix + (long long)last.cov * (e[0] - last.pos)});
+            }
+        }
+        size_ = size;
+    }
+
+    int Size() const { return size_; }
+
+    // [0, x)的覆盖度之和
+    long long Prefix(int x) const {
+        auto it = std::upper_bound(points_.begin(), points_.end(), x, [](int x, const Point &p) { return x < p.pos; });
+        --it;
+        return it->prefix + (long long)it->cov * (x - it->pos);
+    }
+    long long Sum(int b, int e) const { return Prefix(e) - Prefix(b); }
+
+    // [b, e)中覆盖度的最小值和最大值
+    std::array<int,2> MinMax(int b, int e) const {
+        assert(b < e);
+        std::array<int,2> minmax { INT_MAX, INT_MIN };
+        for (size_t i = 0; i < points_.size(); ++i) {
+            int next = i + 1 < points_.size() ? points_[i+1].pos : size_;
+            if (points_[i].pos < e && next > b) {
+                minmax[0] = std::min(minmax[0], points_[i].cov);
+                minmax[1] = std::max(minmax[1], points_[i].cov);
+            }
+        }
+        return minmax;
+    }
+
+    std::vector<int> Expand() const {
+        std::vector<int> cov(size_);
+        for (size_t i = 0; i < points_.size(); ++i) {
+            int next = i + 1 < points_.size() ? points_[i+1].pos : size_;
+            std::fill(cov.begin() + points_[i].pos, cov.begin() + next, points_[i].cov);
+        }
+        return cov;
+    }
+
+protected:
+    struct Point {
+        int pos;
+        int cov;
+        long long prefix;
+    };
+    std::vector<Point> points_;
+    int size_ { 0 };
+};
+
+// 与SmoothLine(cov[offset, offset+size+winsize-1), winsize)的结果相同，每个值用前缀和计算
+class SmoothCoverage {
+public:
+    SmoothCoverage(const CoverageProfile &profile, int offset, int size, int winsize) 
+        : profile_(profile), offset_(offset), size_(size), winsize_(winsize) {}
+
+    size_t size() const { return size_; }
+    double operator[] (size_t i) const { return profile_.Sum(offset_ + (int)i, offset_ + (int)i + winsize_) / (double)winsize_; }
+
+protected:
+    const CoverageProfile &profile_;
+    int offset_;
+    int size_;
+    int winsize_;
+};
+
+template<typename L>
+std::array<int,2> FindCliffs(const L& smooth, bool log);
+
 std::array<int, 3> AsmDataset::AnalyzeCoverage(int id, const std::unordered_map<int, const Overlap*>& group) {
     if (group.size() > 0) {
-        std::vector<int> cov(group.begin()->second->GetRead(id).len + 1, 0);
-        //const int redundance = - (cov.size() > 3000 ? 1000 : cov.size() / 3);
-        const int redundance = - std::min<int>(500, cov.size()/10);
-
+        const int size = group.begin()->second->GetRead(id).len + 1;
+        //const int redundance = - (size > 3000 ? 1000 : size / 3);
+        const int redundance = - std::min<int>(500, size/10);
+        const bool log = opts_.debug_name == rd_store_.QueryNameById(id);
+
+        thread_local std::vector<std::array<int,2>> events;
+        thread_local CoverageProfile profile;
+        events.clear();
         for (const auto &ig : group) {
             const Overlap& o = *ig.second;
             if (IsReserved(o)) {
                 auto& r = o.GetRead(id);
                 if (std::max(0, r.start-redundance) >= std::min(r.len, r.end+redundance)) continue;
 
-                cov[std::max(0, r.start-redundance)] ++;
-                cov[std::min(r.len, r.end+redundance)] --;
-                if ( opts_.debug_name == rd_store_.QueryNameById(id)) {
-                    assert(std::max(0, r.start-redundance) < std::min(r.len, r.end+redundance));
+                events.push_back({std::max(0, r.start-redundance), 1});
+                events.push_back({std::min(r.len, r.end+redundance), -1});
+                if (log) {
                     printf("cov %s\n", OverlapStore::ToPafLine(o, StringPool::UnsafeNameId(rd_store_.GetStringPool())).c_str());
                 }
             }
         }
-        for (size_t i = 1; i < cov.size(); ++i) {
-            cov[i] += cov[i - 1];
-        }
-        assert(cov.back() == 0);
+        profile.Build(events, size);
+        assert(profile.Sum(size-1, size) == 0);
 
-        if ( opts_.debug_name == rd_store_.QueryNameById(id)) {
-           for (size_t i = 0; i < cov.size(); ++i) {
-               printf("cov %d\n", cov[i]);
+        if (log) {
+           for (auto c : profile.Expand()) {
+               printf("cov %d\n", c);
            }
         }
 
@@ -1030,32 +1391,38 @@ std::array<int, 3> AsmDataset::AnalyzeCoverage(int id, const std::unordered_map<
             printf("cov_abn: %s\n", rd_store_.QueryNameById(id).c_str());
         }
 
-        if (cov.size() > 3000) {
-            read_infos_[id].cliff = CoverageConfidencePoints1(std::vector<int>(cov.begin()-redundance, cov.end()+redundance), rd_store_.QueryNameById(id) == opts_.debug_name);
-            if (read_infos_[id].cliff[0] > 0) read_infos_[id].cliff[0] -= redundance;
-            if (read_infos_[id].cliff[1] > 0) read_infos_[id].cliff[1] -= redundance;
+        auto &rinfo = read_infos_[id];
+        if (size > 3000) {
+            if (log) {
+                auto cov = profile.Expand();
+                rinfo.cliff = CoverageConfidencePoints1(std::vector<int>(cov.begin()-redundance, cov.end()+redundance), log);
+            } else {
+                rinfo.cliff = FindCliffs(SmoothCoverage(profile, -redundance, size + 2*redundance - 500 + 1, 500), log);
+            }
+            if (rinfo.cliff[0] > 0) rinfo.cliff[0] -= redundance;
+            if (rinfo.cliff[1] > 0) rinfo.cliff[1] -= redundance;
 
-            if (read_infos_[id].cliff[0] > 0) {
-                if (read_infos_[id].cliff[0] >= std::min<int>(opts_.max_unreliable_length, opts_.max_unreliable_rate*cov.size())) {
-                    read_infos_[id].cliff[0] = -1;
+            if (rinfo.cliff[0] > 0) {
+                if (rinfo.cliff[0] >= std::min<int>(opts_.max_unreliable_length, opts_.max_unreliable_rate*size)) {
+                    rinfo.cliff[0] = -1;
                 }
             }
             
-            if (read_infos_[id].cliff[1] > 0) {
-                if ((int)cov.size() - read_infos_[id].cliff[1] >= std::min<int>(opts_.max_unreliable_length, opts_.max_unreliable_rate*cov.size())) {
-                    read_infos_[id].cliff[1] = -1;
+            if (rinfo.cliff[1] > 0) {
+                if (size - rinfo.cliff[1] >= std::min<int>(opts_.max_unreliable_length, opts_.max_unreliable_rate*size)) {
+                    rinfo.cliff[1] = -1;
                 }
             }
         }
 
-        int inv = cov.size() / 3;
-        auto a0 = std::accumulate(cov.begin(), cov.begin()+inv, 0) / inv;
-        auto a1 = std::accumulate(cov.begin()+inv, cov.begin()+2*inv, 0) / inv;
-        auto a2 = std::accumulate(cov.begin()+2*inv, cov.end(), 0) / inv;
-        read_infos_[id].coverage = {a0, a1, a2};
+        int inv = size / 3;
+        int a0 = (int)profile.Sum(0, inv) / inv;
+        int a1 = (int)profile.Sum(inv, 2*inv) / inv;
+        int a2 = (int)profile.Sum(2*inv, size) / inv;
+        rinfo.coverage = {a0, a1, a2};
 
-        auto c_minmax = std::minmax_element(std::max(0, -redundance) + cov.begin(), cov.end() -1 - std::max(0, -redundance));
-        return {covtype, *c_minmax.first, *c_minmax.second };
+        auto c_minmax = profile.MinMax(std::max(0, -redundance), size - 1 - std::max(0, -redundance));
+        return {covtype, c_minmax[0], c_minmax[1] };
 
     } else {
         return { 0, 0, 0 };
@@ -1217,8 +1584,8 @@ std::vector<O> SmoothLine(const std::vector<I> &line, size_t winsize, bool log)
     return smooth;
 }
 
-template<typename T>
-std::vector<std::array<int,2>> FindCorners(const std::vector<T>& line, bool log) {
+template<typename L>
+std::vector<std::array<int,2>> FindCorners(const L& line, bool log) {
     const size_t stepsize = 500;
     assert(line.size() > stepsize);
 
@@ -1263,7 +1630,7 @@ std::vector<std::array<int,2>> FindCorners(const std::vector<T>& line, bool log)
             if (last != 0 && (curr == 0 && s0_count >= max_s0_count || curr != 0) && is_cliff(line[end], line[index], end-index, max_slope)) {
                 cliffs.push_back({(int)index, (int)end});
                 if (log) {
-                    printf("cliff %zd - %zd, %f %f\n", end, line[end],  index, line[index]);
+                    printf("cliff %zd - %f, %zd %f\n", end, line[end],  index, line[index]);
                 }
             }
             last = curr;
@@ -1275,7 +1642,7 @@ std::vector<std::array<int,2>> FindCorners(const std::vector<T>& line, bool log)
     if (last != 0 && is_cliff(line[end], line[index], end-index, max_slope)) {
         cliffs.push_back({(int)index, (int)end});
         if (log) {
-            printf("cliff %zd - %zd, %f %f\n", end, line[end],  index, line[index]);
+            printf("cliff %zd - %f, %zd %f\n", end, line[end],  index, line[index]);
         }
     }
 
@@ -1288,7 +1655,11 @@ std::array<int,2> AsmDataset::CoverageConfidencePoints1(const std::vector<int>&
     const size_t INV = 500;
     assert(cov.size() > INV);
 
-    std::vector<double> smooth = SmoothLine<double>(cov, INV, log);
+    return FindCliffs(SmoothLine<double>(cov, INV, log), log);
+}
+
+template<typename L>
+std::array<int,2> FindCliffs(const L& smooth, bool log) {
     auto corners = FindCorners(smooth, log);
 
     std::array<int,2> cliff { -1, -1};
@@ -1330,8 +1701,8 @@ std::array<int,3> AsmDataset::CalcCoverageThreshold() const {
     std::vector<int> cov_diff;
     cov_diff.reserve(read_infos_.size());
     for (const auto & i : read_infos_) {
-        const auto& minmax = i.second.minmax_coverage;
-        if (minmax[0] >= 0) {
+        const auto& minmax = i.minmax_coverage;
+        if (i.Valid() && minmax[0] >= 0) {
             cov_min.push_back(minmax[0]);
             cov_max.push_back(minmax[1]);
             cov_diff.push_back(minmax[1]-minmax[0]);
@@ -1407,24 +1778,29 @@ bool AsmDataset::IsContained(const Overlap& o, std::array<int, 2> &rel) {
 }
 
 void AsmDataset::UpdateFilteredRead() {
+    std::vector<uint8_t> filtered(read_infos_.size(), 0);
+    for (size_t i = 0; i < read_infos_.size(); ++i) {
+        filtered[i] = !read_infos_[i].filtered.IsOk();
+    }
 
-    for (size_t i=0; i < ol_store_.Size(); ++i) {
-        const auto &o = ol_store_.Get(i);
-        if (IsReserved(o)) {
-            auto it = read_infos_.find(o.a_.id);
-            assert(it != read_infos_.end());
-            if (!it->second.filtered.IsOk()) {
-                SetOlReason(o, OlReason::FilteredRead(it->first));
-            } else {
-                it = read_infos_.find(o.b_.id);                
-                assert(it != read_infos_.end());
-                if (!it->second.filtered.IsOk()) {
-                    SetOlReason(o, OlReason::FilteredRead(it->first));
+    MultiThreadRun(opts_.thread_size, 
+        [this]() {
+            return SplitRange(opts_.thread_size, (size_t)0, ol_store_.Size());
+        }, 
+        [this, &filtered](const std::array<size_t, 2> &range) {
+            for (size_t i=range[0]; i<range[1]; ++i) {
+                const auto &o = ol_store_.Get(i);
+                if (IsReserved(o)) {
+                    assert(o.a_.id < (Seq::Id)filtered.size() && o.b_.id < (Seq::Id)filtered.size());
+                    if (filtered[o.a_.id]) {
+                        SetOlReason(o, OlReason::FilteredRead(o.a_.id));
+                    } else if (filtered[o.b_.id]) {
+                        SetOlReason(o, OlReason::FilteredRead(o.b_.id));
+                    }
                 }
-
             }
         }
-    }
+    );
 }
 
 
@@ -1440,8 +1816,7 @@ std::unordered_set<Seq::Id> AsmDataset::GetNearbyReads(Seq::Id tid) {
             if (oltype == OlReason::RS_OK) {
                 nearby.insert(qread.id);
             } else if (oltype == OlReason::RS_FILTERED_READ) {
-                auto ri = read_infos_.find(qread.id);
-                if (ri->second.filtered.type == RdReason::RS_CONTAINED) {
+                if (GetReadInfo(qread.id).filtered.type == RdReason::RS_CONTAINED) {
                     nearby.insert(qread.id);
                 }
             }
@@ -1468,9 +1843,7 @@ std::unordered_set<const Overlap*> AsmDataset::GetExtendOverlaps(Seq::Id tid, in
                 extend.insert(&o);
             } else if (oltype == OlReason::RS_FILTERED_READ) {
                                 
-                auto qri = read_infos_.find(qread.id);
-                auto tri = read_infos_.find(tid); 
-                if (qri->second.filtered.type == RdReason::RS_CONTAINED || tri->second.filtered.type == RdReason::RS_CONTAINED) {
+                if (GetReadInfo(qread.id).filtered.type == RdReason::RS_CONTAINED || GetReadInfo(tid).filtered.type == RdReason::RS_CONTAINED) {
                     extend.insert(&o);
                 }
             }
@@ -1497,9 +1870,7 @@ std::unordered_set<const Overlap*> AsmDataset::GetBackOverlaps(Seq::Id tid, int
                 extend.insert(&o);
             } else if (oltype == OlReason::RS_FILTERED_READ) {
                                 
-                auto qri = read_infos_.find(qread.id);
-                auto tri = read_infos_.find(tid); 
-                if (qri->second.filtered.type == RdReason::RS_CONTAINED || tri->second.filtered.type == RdReason::RS_CONTAINED) {
+                if (GetReadInfo(qread.id).filtered.type == RdReason::RS_CONTAINED || GetReadInfo(tid).filtered.type == RdReason::RS_CONTAINED) {
                     extend.insert(&o);
                 }
             }
@@ -1529,11 +1900,37 @@ void AsmDataset::Dump() const {
     
     DumpReadInfos(OutputPath("readinfos"), read_infos_); 
     DumpOverlaps(OutputPath("filter.m4a"));
-    DumpFilteredOverlaps(OutputPath("filtered_overlaps.txt"));
+    if (opts_.max_memory <= 0) {
+        DumpFilteredOverlaps(OutputPath("filtered_overlaps.txt"));    // 外存模式在PurgePartitioned中输出
+    }
 
 }
 
 
+void AsmDataset::WriteFilteredOverlap(std::ostream &os, const Overlap &o) const {
+    OlReason rs = GetOlReason(o);
+    switch(rs.type) {    
+    case OlReason::RS_FILTERED_READ:
+        os << rd_store_.QueryNameById(o.a_.id) << " " << rd_store_.QueryNameById(o.b_.id) << " "
+            << rs.ToString() << " " << rd_store_.QueryNameById(rs.sub[0]) << " " << rs.sub[1] << "\n";
+        break;
+
+    case OlReason::RS_SIMPLE:
+    case OlReason::RS_DUPLICATE:
+    case OlReason::RS_LOCAL:
+    case OlReason::RS_CONSISTENCY:
+    case OlReason::RS_CONSISTENCY1:
+    case OlReason::RS_CONTIG:
+    case OlReason::RS_UNKNOWN:
+        os << rd_store_.QueryNameById(o.a_.id) << " " << rd_store_.QueryNameById(o.b_.id) << " "
+            << rs.ToString() << " " << rs.sub[0] << " " << rs.sub[1] << "\n";
+        break;
+    case OlReason::RS_OK:
+    default:
+        break;
+    }
+}
+
 void AsmDataset::DumpFilteredOverlaps(const std::string &fname) const {
     GzFileWriter writer(fname);
 
@@ -1552,28 +1949,7 @@ void AsmDataset::DumpFilteredOverlaps(const std::string &fname) const {
         size_t curr = index.fetch_add(1);
         while (curr < ol_store_.Size()) {
             
-            const auto &o = ol_store_.Get(curr);
-            OlReason rs = GetOlReason(o);
-            switch(rs.type) {    
-            case OlReason::RS_FILTERED_READ:
-                oss << rd_store_.QueryNameById(o.a_.id) << " " << rd_store_.QueryNameById(o.b_.id) << " "
-                    << rs.ToString() << " " << rd_store_.QueryNameById(rs.sub[0]) << " " << rs.sub[1] << "\n";
-                break;
-
-            case OlReason::RS_SIMPLE:
-            case OlReason::RS_DUPLICATE:
-            case OlReason::RS_LOCAL:
-            case OlReason::RS_CONSISTENCY:
-            case OlReason::RS_CONSISTENCY1:
-            case OlReason::RS_CONTIG:
-            case OlReason::RS_UNKNOWN:
-                oss << rd_store_.QueryNameById(o.a_.id) << " " << rd_store_.QueryNameById(o.b_.id) << " "
-                    << rs.ToString() << " " << rs.sub[0] << " " << rs.sub[1] << "\n";
-                break;
-            case OlReason::RS_OK:
-            default:
-                break;
-            }
+            WriteFilteredOverlap(oss, ol_store_.Get(curr));
 
             if (oss.tellp() > 10000000) {
                 combine_func(oss);
@@ -1621,13 +1997,14 @@ void AsmDataset::DumpFilteredOverlaps(const std::string &fname) const {
     // }
 }
 
-void AsmDataset::DumpReadInfos(const std::string &fname, const std::unordered_map<int, ReadStatInfo> &readInfos) const {
+void AsmDataset::DumpReadInfos(const std::string &fname, const std::vector<ReadStatInfo> &readInfos) const {
     GzFileWriter writer(fname);
 
     if (writer.Valid()) {
-        for (const auto &i : readInfos) {
-            const auto &ri = i.second;// " "  << ri.overhang << << ri.identity << " "
-            writer << rd_store_.QueryNameById(i.first) << " " << ri.len <<  " " << ri.count
+        for (const auto &ri : readInfos) {
+            if (!ri.Valid()) continue;
+            // " "  << ri.overhang << << ri.identity << " "
+            writer << rd_store_.QueryNameById(ri.id) << " " << ri.len <<  " " << ri.count
                    << " " << ri.overhang_l_threshold << " " << ri.overhang_r_threshold << " " 
                    <<  ri.minmax_coverage[0] << " " << ri.minmax_coverage[1] << " " <<  ri.coverage[0] << "," << ri.coverage[1] << "," << ri.coverage[2] << " "
                    << ri.filtered.ToString() << " " << (ri.filtered.type == RdReason::RS_CONTAINED ? rd_store_.QueryNameById(ri.filtered.sub[0]) : "0") << " "
@@ -1737,8 +2114,9 @@ void AsmDataset::EstimateGenomeSize() {
     std::vector<int> covs;
     long long int size = 0;
     for (auto &ri : read_infos_) {
-        covs.push_back(ri.second.coverage[1]);
-        size += ri.second.len;
+        if (!ri.Valid()) continue;
+        covs.push_back(ri.coverage[1]);
+        size += ri.len;
     }
     std::sort(covs.begin(), covs.end());
     int ave_cov = covs[covs.size()/2];
@@ -2,6 +2,7 @@
 
 #include <array>
 #include <set>
+#include <tuple>
 #include <unordered_map>
 #include <vector>
 
@@ -19,8 +20,7 @@ class AsmDataset {
 
 public:
     AsmDataset(AsmOptions& opts) 
-     : opts_(opts)
-     , sread_info_(read_infos_) {
+     : opts_(opts) {
 
     }
 
@@ -36,12 +36,15 @@ public:
     void LoadOverlaps(const std::string &fname);
     void LoadOverlaps2(const std::string &fname);
     void LoadOverlapsWithoutLowQuality(const std::string &fname);
+    void FilterOverlapsWithoutLowQuality();
 
     void Purge();
+    void SpillOverlaps(const std::string &fname);
+    void PurgePartitioned();
     void FilterLowQuality();
     void FilterLowQuality(int id, const std::unordered_map<int, const Overlap*> &group, std::unordered_set<const Overlap*> &ignored);
     double GetOverlapQuality(const Overlap &ol);
-    void GroupAndFilterDuplicate();
+    void GroupAndFilterDuplicate(bool (*better)(const Overlap &a, const Overlap &b)=BetterAlignedLength);
     void CheckOverlapEnd();
     void CheckOverlapEnd(int id, const std::unordered_map<int, const Overlap*> &group, std::unordered_set<const Overlap*> &ignored, std::unordered_set<int>& ignReads);
     void ExtendOverlapToEnd();
@@ -50,6 +53,8 @@ public:
     void FilterContained();
     bool IsContained(const Overlap& o, std::array<int, 2> &rel);
     void FilterCoverage();
+    void AnalyzeCoverage();
+    void FilterReadsByCoverage();
 
     void FilterConsistency();
     void CalcConsistency(int id, const std::unordered_map<int, const Overlap*> &group, std::unordered_set<const Overlap*> &best, std::unordered_set<const Overlap*> &ignored);
@@ -74,7 +79,7 @@ public:
     std::array<int, 3> CalcCoverageThreshold() const;
   
     bool IsReserved(const Overlap &o) const { return GetOlReason(o).type == OlReason::RS_OK; }
-    bool IsReserved(Seq::Id id)       const { auto it = read_infos_.find(id); return it->second.filtered.IsOk(); }
+    bool IsReserved(Seq::Id id)       const { return GetReadInfo(id).filtered.IsOk(); }
     size_t ReservedSize() const {
         size_t sz = 0;
         for (size_t i=0; i < ol_store_.Size(); ++i) {
@@ -104,9 +109,20 @@ public:
     void Dump() const;      
     void DumpOverlaps(const std::string &fname) const;
     void DumpFilteredOverlaps(const std::string &fname) const;
-    void DumpReadInfos(const std::string &fname, const std::unordered_map<int, ReadStatInfo> &readInfos) const;
+    void WriteFilteredOverlap(std::ostream &os, const Overlap &o) const;
+    void DumpReadInfos(const std::string &fname, const std::vector<ReadStatInfo> &readInfos) const;
 
     static bool BetterAlignedLength(const Overlap &a, const Overlap &b) { return a.AlignedLength()*a.identity_ > b.AlignedLength()*b.identity_; }
+    static bool BetterAlignedLengthOrdered(const Overlap &a, const Overlap &b) {
+        if (a.AlignedLength()*a.identity_ != b.AlignedLength()*b.identity_) return BetterAlignedLength(a, b);
+        return std::make_tuple(a.a_.id, a.a_.start, a.a_.end, a.b_.id, a.b_.start, a.b_.end, a.b_.strand) < 
+               std::make_tuple(b.a_.id, b.a_.start, b.a_.end, b.b_.id, b.b_.start, b.b_.end, b.b_.strand);
+    }
+    // 只由id和坐标决定的顺序，与overlap的载入顺序无关
+    static bool IdOrdered(const Overlap &a, const Overlap &b) {
+        return std::make_tuple(a.a_.id, a.b_.id, a.a_.start, a.a_.end, a.b_.start, a.b_.end, a.b_.strand, a.identity_) < 
+               std::make_tuple(b.a_.id, b.b_.id, b.a_.start, b.a_.end, b.b_.start, b.b_.end, b.b_.strand, b.identity_);
+    }
     static void SetOlReason(const Overlap &o, OlReason rs);
     static OlReason GetOlReason(const Overlap &o);
 
@@ -129,15 +145,15 @@ public:
     std::string OutputPath(const std::string &fname) const { return opts_.OutputPath(fname); }
 
     const ReadStatInfo& GetReadInfo(Seq::Id id) const {
-        auto iter = read_infos_.find(id);
-        assert(iter != read_infos_.end());
-        return iter->second;
+        assert(id >= 0 && id < (Seq::Id)read_infos_.size() && read_infos_[id].Valid());
+        return read_infos_[id];
     }
 public:
     static int Percentile(const std::vector<int>& data, double percent);
     static int FirstTrough(const std::vector<int>& data, size_t last, size_t k);
 
-    void ScanOverlapsToSelectParams(const std::string &fname);    
+    // 统计read的identity和overhang，选择过滤参数。load为true时，同时把通过filter0的overlap加载到ol_store_
+    void ScanOverlapsToSelectParams(const std::string &fname, bool load=false);
     double CalcLocalOverhangThreshold(std::vector<std::array<double,2>> &overhang);
 
     void EstimateGenomeSize();
@@ -145,9 +161,7 @@ public:
     AsmOptions& opts_;
     std::unordered_map<int, std::unordered_map<int, const Overlap*>> groups_;
 
-    std::unordered_map<Seq::Id, ReadStatInfo> read_infos_;
-
-    StatReadInfo sread_info_;
+    std::vector<ReadStatInfo> read_infos_;      // 以read id为下标，没有overlap的read无效(见ReadStatInfo::Valid)
 
     StringPool string_pool_;
     ReadStore rd_store_ { string_pool_ };
@@ -155,6 +169,20 @@ public:
     
     std::shared_ptr<ReadVariants> read_variants_;
     std::shared_ptr<PhaseInfoFile> phased_reads_;
+
+    // 外存模式(max_memory > 0)的临时文件，见SpillOverlaps和PurgePartitioned
+    struct Bucket {
+        void Add(const Overlap &o) {
+            count++;
+            memory += sizeof(Overlap) + o.detail_.size()*sizeof(Overlap::Detail) + 2*64;    // 64: an item of groups_
+        }
+        size_t count { 0 };
+        size_t memory { 0 };    // estimated memory after loading
+    };
+    std::vector<int> read_buckets_;
+    std::vector<Bucket> buckets_;
+    int BucketOf(Seq::Id id) const { return id >= 0 && id < (Seq::Id)read_buckets_.size() ? read_buckets_[id] : -1; }
+    std::string BucketFile(size_t i) const { return OutputPath("asm_bucket_" + std::to_string(i) + ".bin"); }
 };
 
 }
\ No newline at end of file
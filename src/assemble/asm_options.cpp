@@ -14,6 +14,8 @@ void AsmOptions::SetArguments(ArgumentParser &ap) {
     ap.AddNamedOption(genome_size, "genome_size", "genome size. It determines the maximum length of reads with coverage together", "INT", ParamToGenomeSize);
 
     ap.AddNamedOption(read_file, "read_file", "The file are used to increase the speed of loading overlaps.");
+    ap.AddNamedOption(max_memory, "max_memory", "memory budget (GB) of the overlaps in purging. If it is set, the overlaps are spilled to temporary files by reads and purged part by part, and only the overlaps used by the string graph are kept in memory");
+    ap.AddNamedOption(single_pass, "single_pass", "read the overlap file only once. The overlaps passing filter0 are kept in memory until the parameters are selected, which needs more memory.");
 
     ap.AddNamedOption(max_offset_rate, "max_offset_rate", "");
     ap.AddNamedOption(reduction0, "reduction0", "reduction method0 for the graph");
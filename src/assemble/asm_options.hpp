@@ -60,6 +60,8 @@ struct AsmOptions {
 
     int dump { 0 };
     bool skip_purge { false };
+    bool single_pass { false };
+    double max_memory { 0 };    // GB, 0 for purging all overlaps in memory
 };
 
 }
\ No newline at end of file
@@ -66,6 +66,8 @@ auto BestOverlapsSimplifier::FindBestOutEdge(BaseNode* n) -> std::vector<BestIte
 }
 
 
+// 一个节点的候选只取决于它的出边，以及判断不一致时沿出节点的第一条出边向后的两层节点(IsOutEdgeInconsistent)。
+// 上次运行后，只重新计算有变化的节点和沿入边向前两层的节点，其它节点沿用上次的候选。
 void BestOverlapsSimplifier::FindCandidateBestEdges() {
     auto nodes = graph_.CollectNodes([](BaseNode* n) {
         return n->OutDegree() > 0;
@@ -73,18 +75,41 @@ void BestOverlapsSimplifier::FindCandidateBestEdges() {
 
     cands_.resize(nodes.size());
 
+    std::vector<SgNode*> changed;
+    std::unordered_set<BaseNode*> dirty;
+    bool incremental = ChangedSinceLastRun(changed);
+    if (incremental) {
+        auto ns = WithInNodes(changed, bad_ols_ != nullptr ? 2 : 0);
+        dirty.insert(ns.begin(), ns.end());
+    }
+
+    std::vector<size_t> todo;
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        auto it = cached_.find(nodes[i]);
+        if (!incremental || dirty.find(nodes[i]) != dirty.end() || it == cached_.end()) {
+            todo.push_back(i);
+        } else {
+            cands_[i][0] = it->second;
+        }
+    }
+    Debug("Check %zd/%zd nodes\n", todo.size(), nodes.size());
+
     std::atomic<size_t> index { 0 };
 
     auto work_func = [&](size_t tid) {
-        for (size_t i = index.fetch_add(1); i < nodes.size(); i = index.fetch_add(1)) {
-            auto n = nodes[i];
+        for (size_t i = index.fetch_add(1); i < todo.size(); i = index.fetch_add(1)) {
+            auto n = nodes[todo[i]];
             assert(n->OutDegree() > 0);
-            cands_[i][0] = FindBestOutEdge(n);;
+            cands_[todo[i]][0] = FindBestOutEdge(n);;
         }
     };
 
     MultiThreadRun((size_t)graph_.Options().thread_size, work_func);
 
+    cached_.clear();
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        cached_[nodes[i]] = cands_[i][0];
+    }
 }
 
 
@@ -105,6 +105,7 @@ protected:
     
     std::vector<std::array<std::vector<BestItem>,2>> cands_;
     std::unordered_set<BaseEdge*> best_edges;
+    std::unordered_map<BaseNode*, std::vector<BestItem>> cached_;     // 上次运行时各节点的候选，见FindCandidateBestEdges
 };
 
 
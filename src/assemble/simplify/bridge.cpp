@@ -161,7 +161,11 @@ void BridgeSimplifier::Repair(const std::unordered_set<const Overlap*> &ols) {
         }
     };
     
-    for (auto ol : ols) {
+    // 重叠保存在OverlapStore的连续空间中，按地址排序即按读入的顺序
+    std::vector<const Overlap*> sorted(ols.begin(), ols.end());
+    std::sort(sorted.begin(), sorted.end());
+
+    for (auto ol : sorted) {
 
         auto e = get_edge(ol);
         if (e != nullptr) {
@@ -457,8 +461,7 @@ void BridgeSimplifier::Running() {
         return n->InDegree() == 1 && n->OutDegree() == 2;
     });
 
-    std::vector<std::vector<SgEdge*>> paths;
-    for (auto &n : cands) {
+    auto paths = AnalyseInParallel<std::vector<SgEdge*>>(cands, [this](BaseNode* n, std::vector<std::vector<SgEdge*>> &paths) {
         auto p0 = GetBridgePath(n, 0, 1);
         if (p0.size() > 0) {
             paths.push_back(p0);
@@ -467,7 +470,7 @@ void BridgeSimplifier::Running() {
         if (p1.size() > 0) {
             paths.push_back(p1);
         }
-    }
+    });
 
     std::sort(paths.begin(), paths.end(), [](const std::vector<SgEdge*>& a, const std::vector<SgEdge*>& b) {
         return a.size() < b.size();
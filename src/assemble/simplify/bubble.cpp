@@ -26,6 +26,7 @@ void BubbleSimplifier::Running() {
     LOG(INFO)("BubbleSimplifier %d", simple);
     size_t thread_size = graph_.Options().thread_size;
 
+    node_size_ = graph_.IndexNodes();
     auto cands = graph_.CollectNodes([this](const SgNode* n) { return n->OutDegree() > 1; });
     std::vector<BubbleEdge*> bubbles(cands.size());
     MultiThreadMap(thread_size, cands, bubbles, [this](SgNode* n) {
@@ -102,7 +103,8 @@ void BubbleSimplifier::Running() {
 
 
 
-bool IsClearBubble(const SgNode* start, const SgNode* end, const std::list<PathEdge*> &edges, const std::unordered_set<SgNode*> valids) {
+template<typename V>
+bool IsClearBubble(const SgNode* start, const SgNode* end, const std::list<PathEdge*> &edges, V is_valid) {
     std::unordered_set<SgNode*> nodes;
     for (auto e : edges) {
         if (e->InNode() != start) {
@@ -117,7 +119,7 @@ bool IsClearBubble(const SgNode* start, const SgNode* end, const std::list<PathE
         for (size_t i = 0; i < n->InDegree(); ++i) {
             auto ie = n->InEdge(i);
             auto in = ie->InNode();
-            if (valids.find(in) == valids.end()) {
+            if (!is_valid(in)) {
                 return false;
             }
         }
@@ -125,16 +127,73 @@ bool IsClearBubble(const SgNode* start, const SgNode* end, const std::list<PathE
     return true;
 }
 
+void BubbleSimplifier::Workspace::Reset(size_t size) {
+    if (ego.size() != size) {
+        ego.assign(size, 0);
+        local.assign(size, 0);
+        visited.assign(size, 0);
+        new_visited.assign(size, 0);
+        values.assign(size, zero);
+        epoch = 0;
+    }
+
+    epoch++;
+    if (epoch == 0) {       // 回绕
+        std::fill(ego.begin(), ego.end(), 0);
+        std::fill(local.begin(), local.end(), 0);
+        std::fill(visited.begin(), visited.end(), 0);
+        std::fill(new_visited.begin(), new_visited.end(), 0);
+        epoch = 1;
+    }
+}
+
+// 与SgGraph::GetEgoNodes(start, max_depth)相同，结果标记在ws.local中
+void BubbleSimplifier::CollectLocalNodes(Workspace &ws, SgNode* start, int max_depth) const {
+    ws.queue.assign(1, start);
+    ws.ego[start->Index()] = ws.epoch;
+
+    int depth = 0;
+    size_t curr = 0;
+    size_t level_end = 0;
+    while (depth < max_depth && curr < ws.queue.size()) {
+        auto n = ws.queue[curr];
+        for (size_t i = 0; i < n->OutDegree(); ++i) {
+            auto out = n->OutNode(i);
+            assert(out->Index() < node_size_);
+            if (!ws.IsEgo(out)) {
+                ws.ego[out->Index()] = ws.epoch;
+                ws.queue.push_back(out);
+            }
+        }
+
+        if (curr == level_end) {
+            depth++;
+            level_end = ws.queue.size() - 1;
+        }
+        curr++;
+    }
+
+    for (size_t i = 0; i < curr; ++i) {
+        ws.local[ws.queue[i]->Index()] = ws.epoch;
+    }
+}
+
 BubbleEdge* BubbleSimplifier::Detect(PathNode* start_node, bool check, int depth_cutoff, int width_cutoff) {
     int length_cutoff = graph_.Options().max_bubble_length;
 
     SgNode* end_node = nullptr;
 
     std::list<PathEdge*> bundle_edges;     
-    std::unordered_map<SgNode*, std::pair<int, int>> visited; // length, score
 
-    std::list<SgNode*> local_node_list = graph_.GetEgoNodes(start_node, depth_cutoff);
-    std::unordered_set<SgNode*> local_nodes(local_node_list.begin(), local_node_list.end());
+    thread_local Workspace ws;
+    ws.Reset(node_size_);
+    CollectLocalNodes(ws, start_node, depth_cutoff);
+
+    auto visit = [](Workspace &ws, SgNode* n, std::pair<int, int> v) {
+        ws.visited[n->Index()] = ws.epoch;
+        ws.values[n->Index()] = v;
+    };
+
     std::unordered_set<SgNode*> tips;
 
     int depth = 0;
@@ -145,7 +204,7 @@ BubbleEdge* BubbleSimplifier::Detect(PathNode* start_node, bool check, int depth
     bool meet_error = false;
     bool spur = false;
 
-    visited[start_node] = std::make_pair(0, 0);
+    visit(ws, start_node, std::make_pair(0, 0));
     for (size_t i = 0; i < start_node->OutDegree(); ++i) {
         auto e = start_node->OutEdge(i);
         tips.insert(e->OutNode());
@@ -155,9 +214,9 @@ BubbleEdge* BubbleSimplifier::Detect(PathNode* start_node, bool check, int depth
     }
 
 
-
+    std::vector<SgEdge*> new_visited;     // 最新被访问节点的最佳入边，延后加入visited
     do {
-        std::unordered_map<SgNode*, SgEdge*> new_visited;     // 最新被访问节点，延后加入visited
+        new_visited.clear();
         std::unordered_set<SgNode*> newtips, oldtips;     // 新产生的末梢节点和未处理的末梢节点
         
         for (auto n : tips) {
@@ -170,9 +229,9 @@ BubbleEdge* BubbleSimplifier::Detect(PathNode* start_node, bool check, int depth
                 // 如果所有入节点都已经访问，则找出分数最高的边。并且可以扩展它的出节点
                 // 否则改节点延后处理
 
-                if (local_nodes.find(e->InNode()) != local_nodes.end()) {
+                if (ws.IsLocal(e->InNode())) {
 
-                    if (visited.find(e->InNode()) != visited.end()) {
+                    if (ws.IsVisited(e->InNode())) {
                         if (best_in_edge == nullptr || best_in_edge->Score() < e->Score()) {
                             best_in_edge = e;
                         }
@@ -190,23 +249,22 @@ BubbleEdge* BubbleSimplifier::Detect(PathNode* start_node, bool check, int depth
             if (best_in_edge != nullptr) {
 
                 assert(n == best_in_edge->OutNode());
-                new_visited[n] = best_in_edge;
+                ws.new_visited[n->Index()] = ws.epoch;
+                new_visited.push_back(best_in_edge);
 
                 // 如果气泡没有收敛，继续添加新的末梢节点
                 if (tips.size() > 1) {
                     for (size_t i = 0; i < n->OutDegree(); ++i) {
                         auto e = n->OutEdge(i);
                         
-                        if (visited.find(e->OutNode()) != visited.end() ||
-                            new_visited.find(e->OutNode()) != new_visited.end()) {
+                        if (ws.IsVisited(e->OutNode()) || ws.IsNewVisited(e->OutNode())) {
                             loop_detect = true;
                             break;
                         }
 
                         SgNode *revese_node = graph_.ReverseNode(static_cast<PathNode*>(e->OutNode()));
-                        if (local_nodes.find(e->OutNode()) != local_nodes.end() && 
-                            visited.find(revese_node) == visited.end() &&
-                            new_visited.find(revese_node) == new_visited.end() ) {
+                        if (ws.IsLocal(e->OutNode()) && 
+                            !ws.IsVisited(revese_node) && !ws.IsNewVisited(revese_node)) {
 
                             if (tips.find(e->OutNode()) == tips.end()) {
                                 newtips.insert(e->OutNode());
@@ -226,7 +284,7 @@ BubbleEdge* BubbleSimplifier::Detect(PathNode* start_node, bool check, int depth
                 }
                 else {
                     //end_node = n; // tips[0]
-                    if (visited.find(n) != visited.end()) {
+                    if (ws.IsVisited(n)) {
                         loop_detect = true;
                         end_node = nullptr;
                     } else {
@@ -237,7 +295,7 @@ BubbleEdge* BubbleSimplifier::Detect(PathNode* start_node, bool check, int depth
                 if (tips.size() > 1) {
                     oldtips.insert(n);
                 } else {
-                    if (visited.find(n) != visited.end()) {
+                    if (ws.IsVisited(n)) {
                         loop_detect = true;
                         end_node = nullptr;
                     } else {
@@ -248,21 +306,18 @@ BubbleEdge* BubbleSimplifier::Detect(PathNode* start_node, bool check, int depth
 
         }
 
-        for (auto &i : new_visited) {
-            visited[i.first] = std::make_pair(
-                visited[i.second->InNode()].first + i.second->Length(),
-                visited[i.second->InNode()].second + i.second->Score());
+        for (auto e : new_visited) {
+            // 入节点都在之前的轮次中访问，更新的顺序不影响结果
+            const auto& in = ws.Value(e->InNode());
+            visit(ws, e->OutNode(), std::make_pair(in.first + (int)e->Length(), in.second + (int)e->Score()));
 
             // 更新当前长度
-        //LOG(INFO)("detect-bubble up: %s, %zd, %zd", start_node->Id().ToString(graph_.asmdata_.GetStringPool()).c_str(), length, visited[i.first].first);
-            if (length < visited[i.first].first) {
-                length = visited[i.first].first;
+            if (length < (size_t)ws.Value(e->OutNode()).first) {
+                length = ws.Value(e->OutNode()).first;
             }
 
         }
 
-       // LOG(INFO)("detect-bubble: %s, %zd", start_node->Id().ToString(graph_.asmdata_.GetStringPool()).c_str(), length);
-
         depth += 1;
         width = 1.0 * bundle_edges.size() / depth;
 
@@ -275,10 +330,10 @@ BubbleEdge* BubbleSimplifier::Detect(PathNode* start_node, bool check, int depth
 
     } while (tips.size() >= 1 && tips.size() < 6 && !loop_detect && !meet_error && !spur && depth <= depth_cutoff && length <= length_cutoff && (depth <= 10 || width <= width_cutoff));
 
-    if (end_node != nullptr && !loop_detect && !meet_error && !spur && depth <= depth_cutoff && length <= length_cutoff && (depth <= 10 || width <= width_cutoff) && (!check || check && IsClearBubble(start_node, end_node,bundle_edges, local_nodes))) {
+    if (end_node != nullptr && !loop_detect && !meet_error && !spur && depth <= depth_cutoff && length <= length_cutoff && (depth <= 10 || width <= width_cutoff) && 
+        (!check || check && IsClearBubble(start_node, end_node, bundle_edges, [](const SgNode* n) { return ws.IsLocal(n); }))) {
         
-        //LOG(INFO)("detect-bubble new: %s, %zd, %zd", start_node->Id().ToString(graph_.asmdata_.GetStringPool()).c_str(), visited[end_node].first, length);
-        return new BubbleEdge(start_node, end_node, bundle_edges, visited[end_node].first, width, visited[end_node].second);
+        return new BubbleEdge(start_node, end_node, bundle_edges, ws.Value(end_node).first, width, ws.Value(end_node).second);
     }
     else {
         return nullptr;
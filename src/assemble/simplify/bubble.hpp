@@ -14,9 +14,34 @@ public:
     virtual bool ParseParameters(const std::vector<std::string> &params);
 
     virtual void Running();
+    // 调用前需要SgGraph::IndexNodes分配节点编号，见Running
     BubbleEdge*  Detect(PathNode* s, bool check, int depth_cutoff = 100, int width_cutoff = 1600);
     PathGraph& graph_;   
     bool simple { false };
+
+protected:
+    // Detect的工作区，每个线程一份，在多次调用间复用。
+    // 节点状态按SgNode::Index存放，每次调用递增epoch，标记等于epoch才有效，不需要清空。
+    struct Workspace {
+        void Reset(size_t size);
+        bool IsEgo(const SgNode* n) const { return ego[n->Index()] == epoch; }
+        bool IsLocal(const SgNode* n) const { return local[n->Index()] == epoch; }
+        bool IsVisited(const SgNode* n) const { return visited[n->Index()] == epoch; }
+        bool IsNewVisited(const SgNode* n) const { return new_visited[n->Index()] == epoch; }
+        const std::pair<int, int>& Value(const SgNode* n) const { return IsVisited(n) ? values[n->Index()] : zero; }
+
+        uint32_t epoch { 0 };
+        std::vector<uint32_t> ego;          // 已加入queue
+        std::vector<uint32_t> local;        // 局部节点，与GetEgoNodes的结果相同
+        std::vector<uint32_t> visited;
+        std::vector<uint32_t> new_visited;
+        std::vector<std::pair<int, int>> values; // length, score
+        std::vector<SgNode*> queue;
+        const std::pair<int, int> zero { 0, 0 };
+    };
+    void CollectLocalNodes(Workspace &ws, SgNode* start, int max_depth) const;
+
+    size_t node_size_ { 0 };
 };
 
 
@@ -16,7 +16,7 @@ void CrossSimplifier::Running() {
 
     LOG(INFO)("Detecting cross structures: %zd %zd", cands.size(), crosses.size());
 
-    MultiThreadMap(1, cands, crosses, [&](SgNode* n) {
+    MultiThreadMap(ThreadSize(), cands, crosses, [&](SgNode* n) {
         return DetectCross(n);
     });
 
@@ -70,13 +70,13 @@ double LowQualitySimplifier::ComputeThreshold() {
 
 void LowQualitySimplifier::RemoveLowQuality(double threshold) {
 
-    std::unordered_set<BaseEdge*> removed;
+    std::vector<BaseEdge*> removed;
     for (size_t i = 0; i < nodes_.size(); ++i) {
         auto n = nodes_[i];
         const auto& qs = quals_[i];
         for (size_t i = 0; i < n->OutDegree(); ++i) {
             if (qs[i] < threshold) {
-                removed.insert(n->GetOutEdge(i));
+                removed.push_back(n->GetOutEdge(i));
             }
         }
     }
@@ -88,14 +88,13 @@ void LowQualitySimplifier::RemoveLowQuality(double threshold) {
 }
 
 
-void LowQualitySimplifier::RepairRmoved(double threshold, std::unordered_set<BaseEdge*> &removed) {
+void LowQualitySimplifier::RepairRmoved(double threshold, const std::vector<BaseEdge*> &removed) {
     auto is_transitive = [this](BaseEdge *e0, BaseEdge *e1) {
         return graph_.GetEdge(e0->OutNode()->Id(), e1->OutNode()->Id()) != nullptr ||
                graph_.GetEdge(e1->OutNode()->Id(), e0->OutNode()->Id()) != nullptr ;
 
     };
-    std::unordered_set<BaseEdge*> recovery;
-    for (auto e0 : removed) {
+    auto rcvs = AnalyseInParallel<BaseEdge*>(removed, [this, threshold, is_transitive](BaseEdge* e0, std::vector<BaseEdge*> &recovery) {
         auto n = e0->InNode();
         if (n->OutDegree() == 0) {
             std::vector<BaseEdge*> works;
@@ -133,23 +132,23 @@ void LowQualitySimplifier::RepairRmoved(double threshold, std::unordered_set<Bas
             }
 
             for (size_t i = e0->InNode()->OutDegree(); i < rcv.size(); ++i)  {
-                recovery.insert(rcv[i]);
+                recovery.push_back(rcv[i]);
 
             }
         }
-    }
+    });
+    std::unordered_set<BaseEdge*> recovery(rcvs.begin(), rcvs.end());
     LOG(INFO)("Recovery size0: %zd", recovery.size()*2);
     graph_.ReactiveEdges(recovery);
 }
 
 void LowQualitySimplifier::ReactiveEdges(double threshold) {
 
-    std::unordered_set<BaseEdge*> recovery;
     auto nodes = graph_.CollectNodes([](BaseNode* n) {
         return n->OutDegree() == 0;
     });
 
-    for (auto n : nodes) {
+    auto recovery = AnalyseInParallel<BaseEdge*>(nodes, [this, threshold](BaseNode* n, std::vector<BaseEdge*> &recovery) {
         if (n->OutDegree() == 0) {
             std::vector<BaseEdge*> works;
             for (auto e : n->GetReducedOutEdge()) {
@@ -167,13 +166,13 @@ void LowQualitySimplifier::ReactiveEdges(double threshold) {
                 Debug("low-quality reactive: %s %s %f\n", graph_.GetAsmData().QueryNameById(works[i]->ol_->a_.id).c_str(), 
                     graph_.GetAsmData().QueryNameById(works[i]->ol_->b_.id).c_str(), qual);
                 if (qual >= threshold) {
-                    recovery.insert(works[i]);
+                    recovery.push_back(works[i]);
                     break;
                 }
 
             }
         }
-    }
+    });
 
     LOG(INFO)("Recovery size1: %zd", recovery.size()*2);
     graph_.ReactiveEdges(recovery);
@@ -18,7 +18,7 @@ public:
 
     double ComputeThreshold();
     void RemoveLowQuality(double threshold);
-    void RepairRmoved(double threshold, std::unordered_set<BaseEdge*> &removed);
+    void RepairRmoved(double threshold, const std::vector<BaseEdge*> &removed);
     void ReactiveEdges(double threshold);
     StringGraph& graph_;   
     std::vector<BaseNode*> nodes_;
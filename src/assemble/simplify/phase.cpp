@@ -88,97 +88,118 @@ std::vector<std::vector<BaseNode*>> PhaseCrossSimplifier::CollectCross() {
     return cands;
 }
 
-void PhaseCrossSimplifier::Running() {
-    assert(rvs_ != nullptr);
+std::vector<std::vector<Seq::EndId>> PhaseCrossSimplifier::PhaseCross(const std::vector<BaseNode*> &cand) {
+    const int max_cand_size = 10;
+    if (cand.size() > max_cand_size) return {};
+    Debug("cand(%zd): %s->%s\n", cand.size(), graph_.GetAsmData().QueryNameById(cand.front()->ReadId()).c_str(),
+        graph_.GetAsmData().QueryNameById(cand.back()->ReadId()).c_str());
 
-    std::vector<std::vector<BaseNode*>> cands = CollectCross();
 
-    const int max_cand_size = 10;
-    for (auto &cand : cands) {
-        if (cand.size() > max_cand_size) continue;
-        Debug("cand(%zd): %s->%s\n", cand.size(), graph_.GetAsmData().QueryNameById(cand.front()->ReadId()).c_str(),
-            graph_.GetAsmData().QueryNameById(cand.back()->ReadId()).c_str());
+    std::vector<PhasePath> paths;
+    std::vector<BaseNode*> ends;
 
+    for (auto e : cand.back()->GetOutEdges()) {
+        ends.push_back(e->OutNode());
+    }
 
-        std::vector<PhasePath> paths;
-        std::vector<BaseNode*> ends;
+    Debug("start dophase\n");
+    for (auto e : cand.front()->GetInEdges()) {
+        Debug(" -- edge: %s %s\n", graph_.GetAsmData().QueryNameById(e->InNode()->ReadId()).c_str(),
+            graph_.GetAsmData().QueryNameById(e->OutNode()->ReadId()).c_str());
 
-        for (auto e : cand.back()->GetOutEdges()) {
-            ends.push_back(e->OutNode());
-        }
+        auto alt = std::find_if(cand.front()->GetInEdges().begin(), cand.front()->GetInEdges().end(), [e](BaseEdge* a) {
+            return a != e;
+        });
+        if (alt == cand.front()->GetInEdges().end()) continue;
+        assert(alt != cand.front()->GetInEdges().end());
 
-        Debug("start dophase\n");
-        for (auto e : cand.front()->GetInEdges()) {
-            Debug(" -- edge: %s %s\n", graph_.GetAsmData().QueryNameById(e->InNode()->ReadId()).c_str(),
-                graph_.GetAsmData().QueryNameById(e->OutNode()->ReadId()).c_str());
+        paths.push_back(PhasePath(graph_.GetAsmData(), e->InNode()->Id().MainNode(), rvs_, (*alt)->InNode()->ReadId(), opts_));
+        PhasePath &path = paths.back();
 
-            auto alt = std::find_if(cand.front()->GetInEdges().begin(), cand.front()->GetInEdges().end(), [e](BaseEdge* a) {
-                return a != e;
-            });
-            if (alt == cand.front()->GetInEdges().end()) continue;
-            assert(alt != cand.front()->GetInEdges().end());
+        path.Extend(cand, ends);
+    }
 
-            paths.push_back(PhasePath(graph_.GetAsmData(), e->InNode()->Id().MainNode(), rvs_, (*alt)->InNode()->ReadId(), opts_));
-            PhasePath &path = paths.back();
+    if (paths.size() != 2) {
+        LOG(WARNING)("phasepath != 2 indegree = %zd", cand.front()->InDegree());
+        return {};
+    }
+    Debug("end find %zd %zd\n", paths[0].dst.size(), paths[1].dst.size());
+    assert(paths.size() == 2);
+    if (paths[0].dst.size() == 1 && paths[1].dst.size() != 1) {
+        paths[1].ExtendWithOtherPath(cand, ends, paths[0]);
+        Debug("phasepath amb 1\n");
+    } else if (paths[1].dst.size() == 1 && paths[0].dst.size() != 1) {
+        paths[0].ExtendWithOtherPath(cand, ends, paths[1]);
+        Debug("phasepath amb 0\n");
+    }
 
-            path.Extend(cand, ends);
-        }
+    if (PhasePath::IsIndependentPath(paths)) {
+        return { paths[0].tips, paths[1].tips };
+    }
+    return {};
+}
 
-        Debug("end find %zd %zd\n", paths[0].dst.size(), paths[1].dst.size());
-        if (paths.size() != 2) {
-            LOG(WARNING)("phasepath != 2 indegree = %zd", cand.front()->InDegree());
-            continue;
-        }
-        assert(paths.size() == 2);
-        if (paths[0].dst.size() == 1 && paths[1].dst.size() != 1) {
-            paths[1].ExtendWithOtherPath(cand, ends, paths[0]);
-            Debug("phasepath amb 1\n");
-        } else if (paths[1].dst.size() == 1 && paths[0].dst.size() != 1) {
-            paths[0].ExtendWithOtherPath(cand, ends, paths[1]);
-            Debug("phasepath amb 0\n");
-        }
+void PhaseCrossSimplifier::Running() {
+    assert(rvs_ != nullptr);
+
+    std::vector<std::vector<BaseNode*>> cands = CollectCross();
 
-        if (PhasePath::IsIndependentPath(paths)) {
+    // 分析只读图，用到交叉结构的入边和出边。按顺序修改图时，如果这些边已被前面的修改改变，就重新分析，
+    // 因此结果和逐个分析、修改相同。
+    auto get_inputs = [](const std::vector<BaseNode*> &cand) {
+        std::vector<BaseEdge*> edges(cand.front()->GetInEdges());
+        edges.insert(edges.end(), cand.back()->GetOutEdges().begin(), cand.back()->GetOutEdges().end());
+        return edges;
+    };
 
-            //
-            for (auto c : cand) {
-                for (auto e : c->GetInEdges()) {
-                    if (!e->IsReduce()) {
+    std::vector<std::vector<BaseEdge*>> inputs(cands.size());
+    std::vector<std::vector<std::vector<Seq::EndId>>> phased(cands.size());
+    ParallelFor(cands.size(), [&](size_t i) {
+        inputs[i] = get_inputs(cands[i]);
+        phased[i] = PhaseCross(cands[i]);
+    });
 
-                        e->Reduce(BaseEdge::RT_PHASED);
-                        graph_.ReverseEdge(e)->Reduce(BaseEdge::RT_PHASED);
-                    }
+    for (size_t i = 0; i < cands.size(); ++i) {
+        auto &cand = cands[i];
+        if (get_inputs(cand) != inputs[i]) {
+            phased[i] = PhaseCross(cand);
+        }
+        if (phased[i].empty()) continue;
+
+        //
+        for (auto c : cand) {
+            for (auto e : c->GetInEdges()) {
+                if (!e->IsReduce()) {
+
+                    e->Reduce(BaseEdge::RT_PHASED);
+                    graph_.ReverseEdge(e)->Reduce(BaseEdge::RT_PHASED);
                 }
-                for (auto e : c->GetOutEdges()) {
-                    if (!e->IsReduce()) {
-                        e->Reduce(BaseEdge::RT_PHASED);
-                        graph_.ReverseEdge(e)->Reduce(BaseEdge::RT_PHASED);
-                    }
+            }
+            for (auto e : c->GetOutEdges()) {
+                if (!e->IsReduce()) {
+                    e->Reduce(BaseEdge::RT_PHASED);
+                    graph_.ReverseEdge(e)->Reduce(BaseEdge::RT_PHASED);
                 }
             }
+        }
 
-            //
-            for (auto &path : paths) {
-                Debug("phasepath path:\n");
-                auto & pathnode = path.tips;
-                for (size_t i = 1; i < pathnode.size(); ++i) {
-                    auto eid = BaseEdge::CreateID(pathnode[i-1], pathnode[i]);
-                    auto eiter = graph_.edges_.find(eid);
-                    if (eiter != graph_.edges_.end()) {
-                        if (eiter->second->IsReduce()) {
-                            eiter->second->Reactivate();
-                            graph_.ReverseEdge(eiter->second)->Reactivate();
-                        }
-                    } else {
-                        auto o = graph_.GetAsmData().QueryOverlap(Seq::EndIdToId(pathnode[i-1]), Seq::EndIdToId(pathnode[i]));
-                        assert (o != nullptr);
-                        graph_.AddOverlap(o);
+        //
+        for (auto &pathnode : phased[i]) {
+            Debug("phasepath path:\n");
+            for (size_t i = 1; i < pathnode.size(); ++i) {
+                auto e = graph_.GetEdge(pathnode[i-1], pathnode[i]);
+                if (e != nullptr) {
+                    if (e->IsReduce()) {
+                        e->Reactivate();
+                        graph_.ReverseEdge(e)->Reactivate();
                     }
+                } else {
+                    auto o = graph_.GetAsmData().QueryOverlap(Seq::EndIdToId(pathnode[i-1]), Seq::EndIdToId(pathnode[i]));
+                    assert (o != nullptr);
+                    graph_.AddOverlap(o);
                 }
-
             }
 
-
         }
     }
 }
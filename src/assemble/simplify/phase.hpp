@@ -23,6 +23,7 @@ public:
     virtual bool PreCondition() { rvs_ = graph_.GetAsmData().GetReadVariants(); return rvs_ != nullptr; }
 
     std::vector<std::vector<BaseNode*>> CollectCross();
+    std::vector<std::vector<Seq::EndId>> PhaseCross(const std::vector<BaseNode*> &cand);
     StringGraph& graph_;   
     ReadVariants* rvs_ { nullptr };
 
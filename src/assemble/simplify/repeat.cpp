@@ -5,13 +5,11 @@ namespace fsa {
 
 
 void RepeatSimplifier::Running() {
-    std::unordered_set<BaseEdge*> edges_to_reduce;
-
     auto nodes_to_test = graph_.CollectNodes([](BaseNode* n) {
         return n->InDegree() == 1 && n->OutDegree() == 1;
     });
     
-    for (auto n : nodes_to_test) {
+    auto edges_to_reduce = AnalyseInParallel<BaseEdge*>(nodes_to_test, [](BaseNode* n, std::vector<BaseEdge*> &edges_to_reduce) {
         auto in_node = n->GetInEdges()[0]->InNode();
         auto out_node = n->GetOutEdges()[0]->OutNode();
 
@@ -26,7 +24,7 @@ void RepeatSimplifier::Running() {
             int ww_in_count = ww->InDegree();
 
             if (ww != n && !e->IsReduce() && ww_in_count > 1 && !overlap) {
-                edges_to_reduce.insert(e);
+                edges_to_reduce.push_back(e);
             }
 
         }
@@ -42,11 +40,11 @@ void RepeatSimplifier::Running() {
             int vv_out_count = vv->OutDegree();
 
             if (vv != n && !e->IsReduce() && vv_out_count > 1 && !overlap) {
-                edges_to_reduce.insert(e);
+                edges_to_reduce.push_back(e);
             }
 
         }
-    }
+    });
     graph_.ReduceEdges(edges_to_reduce, BaseEdge::RT_REPEAT);
 }
 
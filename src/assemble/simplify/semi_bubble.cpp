@@ -33,6 +33,7 @@ void SemiBubbleSimplifier::Running() {
     });
 
     std::vector<SemiBubbleEdge*> semi(cands.size(), nullptr);
+    // Validate会调用BubbleEdge::IdentifySimplePaths，它延迟填充共享边的string_edges_，不能多线程
     MultiThreadMap(1, cands, semi, [this](SgNode* n) -> SemiBubbleEdge* {
         Debug("Find semi node id0: %s\n", n->Id().ToString(graph_.GetAsmData().GetStringPool()).c_str());
         auto e = Detect(static_cast<PathNode*>(n));
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <limits>
+
 #include "../string_graph.hpp"
 
 namespace fsa {
@@ -36,7 +38,75 @@ public:
     virtual void Running() = 0;
     virtual void Clear() {}
 
+    // 之后需要的节点变化记录的起始位置，见ChangedSinceLastRun
+    size_t FirstNeededChange() const { return last_run_ ? last_change_ : std::numeric_limits<size_t>::max(); }
+
 protected:
+    size_t ThreadSize() const { return std::max<size_t>(1, (size_t)ori_graph_.Options().thread_size); }
+
+    // 多线程执行f(i)，i为[0, size)
+    template<typename F>
+    void ParallelFor(size_t size, F f) const {
+        std::atomic<size_t> index { 0 };
+        MultiThreadRun(std::min(ThreadSize(), std::max<size_t>(size, 1)), [&index, size, &f](size_t tid) {
+            for (size_t i = index.fetch_add(1); i < size; i = index.fetch_add(1)) {
+                f(i);
+            }
+        });
+    }
+
+    // 化简分成两步：先并行分析，再依次修改图。analyse(item, results)只能读图，把需要处理的对象加入results。
+    // 返回值按items的顺序合并，与线程数和调度无关，调用者按这个顺序修改图，结果是确定的。
+    template<typename R, typename T, typename F>
+    std::vector<R> AnalyseInParallel(const std::vector<T> &items, F analyse) const {
+        const size_t block = 256;
+        std::vector<std::vector<R>> results((items.size() + block - 1) / block);
+        ParallelFor(results.size(), [&](size_t b) {
+            for (size_t i = b * block; i < std::min(items.size(), (b + 1) * block); ++i) {
+                analyse(items[i], results[b]);
+            }
+        });
+
+        std::vector<R> merged;
+        for (auto &r : results) {
+            merged.insert(merged.end(), r.begin(), r.end());
+        }
+        return merged;
+    }
+
+    // 取出上次运行以来边有变化的节点，并记录当前位置。第一次运行或参数与上次不同时返回false，
+    // 调用者需要检查整个图。节点的变化由SgGraph::TrackChanges记录。
+    bool ChangedSinceLastRun(std::vector<SgNode*> &nodes) {
+        std::string params = GetParameters();
+        bool incremental = last_run_ && params == last_params_;
+        if (incremental) {
+            nodes = ori_graph_.ChangedNodes(last_change_);
+        }
+        last_run_ = true;
+        last_params_ = params;
+        last_change_ = ori_graph_.NewChangeEpoch();
+        return incremental;
+    }
+
+    // nodes和沿入边向前depth层的节点，每个节点一次，保持nodes的顺序
+    static std::vector<BaseNode*> WithInNodes(const std::vector<SgNode*> &nodes, size_t depth) {
+        std::vector<BaseNode*> result;
+        std::unordered_set<BaseNode*> done;
+        for (auto n : nodes) {
+            if (done.insert(static_cast<BaseNode*>(n)).second) result.push_back(static_cast<BaseNode*>(n));
+        }
+        for (size_t begin = 0, d = 0; d < depth; ++d) {
+            size_t end = result.size();
+            for (size_t i = begin; i < end; ++i) {
+                for (auto e : result[i]->GetInEdges()) {
+                    if (done.insert(e->InNode()).second) result.push_back(e->InNode());
+                }
+            }
+            begin = end;
+        }
+        return result;
+    }
+
     void Debug(const char* const format, ...);
     std::string ToString(const SgEdge* e) { return e->Id().ToString(ori_graph_.GetAsmData().GetStringPool()); }
     std::string ToString(const SgNode* n) { return n->Id().ToString(ori_graph_.GetAsmData().GetStringPool()); }
@@ -44,6 +114,10 @@ protected:
     std::string name_;
     std::string desc_;
     SgGraph& ori_graph_;
+
+    bool last_run_ { false };
+    std::string last_params_;
+    size_t last_change_ { 0 };      // 上次运行时节点变化记录的位置
 };
 
 
@@ -30,53 +30,37 @@ std::string SpurSimplifier::GetParameters() const {
 //        /
 // ------>------------->
 // 
+// 一个节点的结果只取决于它的出边和出边另一端的出度。上次运行后，没有变化的节点不会再有spur，
+// 所以之后只检查有变化的节点和它们的入边起点。
 void SpurSimplifier::Running() {
-    std::unordered_set<BaseEdge*> removed;
-    std::mutex mutex;
-    auto nodes = graph_.CollectNodes([](BaseNode* n) {
-        return n->OutDegree() > 1;
-    });
-
-
-    std::atomic<size_t> index { 0 };
-
-    auto combine_func = [&removed, &mutex](std::unordered_set<BaseEdge*> &rs) {
-        std::lock_guard<std::mutex> lock(mutex);
-
-        removed.insert(rs.begin(), rs.end());
-    };
-
-    auto work_func = [&](size_t tid) {
-        std::unordered_set<BaseEdge*> rs;
-
-        for (size_t i = index.fetch_add(1); i < nodes.size(); i = index.fetch_add(1)) {
-            auto n = nodes[i];
+    std::vector<BaseNode*> nodes;
+    std::vector<SgNode*> changed;
+    if (ChangedSinceLastRun(changed)) {
+        nodes = WithInNodes(changed, 1);
+        nodes.erase(std::remove_if(nodes.begin(), nodes.end(), [](BaseNode* n) { return n->OutDegree() <= 1; }), nodes.end());
+        Debug("Check %zd changed nodes\n", nodes.size());
+    } else {
+        nodes = graph_.CollectNodes([](BaseNode* n) {
+            return n->OutDegree() > 1;
+        });
+    }
 
-            assert(n->OutDegree() > 1);
-            size_t count = 0;           
-            for (auto e : n->GetOutEdges()) {
-                assert(!e->IsReduce());
-            
-                if (e->OutNode()->OutDegree()  == 0) {
-                    rs.insert(e);
-                    count++;
-                }
-                 
-                if (count + 1 == n->OutDegree()) break;
+    auto removed = AnalyseInParallel<BaseEdge*>(nodes, [](BaseNode* n, std::vector<BaseEdge*> &rs) {
+        assert(n->OutDegree() > 1);
+        size_t count = 0;           
+        for (auto e : n->GetOutEdges()) {
+            assert(!e->IsReduce());
+        
+            if (e->OutNode()->OutDegree()  == 0) {
+                rs.push_back(e);
+                count++;
             }
+             
+            if (count + 1 == n->OutDegree()) break;
         }
-        combine_func(rs);
-    };
-    
-
-    MultiThreadRun((size_t)graph_.Options().thread_size, work_func);
+    });
 
-    for (auto e : removed) {
-        if (!e->IsReduce()) {
-            e->Reduce(BaseEdge::RT_SPUR);
-            graph_.ReverseEdge(e)->Reduce(BaseEdge::RT_SPUR);
-        }
-    }
+    graph_.ReduceEdges(removed, BaseEdge::RT_SPUR);
 
 }
 
@@ -17,66 +17,80 @@ bool TransitiveSimplifier::ParseParameters(const std::vector<std::string> &param
     return true;
 }
 
+std::string TransitiveSimplifier::GetParameters() const {
+    std::ostringstream oss;
+    oss << "fuzz=" << fuzz_;
+    return oss.str();
+}
+
+// 一个节点的结果只取决于它的出边和出边另一端的出边。去掉边不会产生新的可传递的边，上次运行后，
+// 只有出边或出节点的出边被加入或恢复的节点会有变化，所以之后只检查有变化的节点和它们的入边起点。
 void TransitiveSimplifier::Running() {
-    std::unordered_set<BaseEdge*> reduced;
+    std::vector<BaseNode*> nodes;
+    std::vector<SgNode*> changed;
+    if (ChangedSinceLastRun(changed)) {
+        nodes = WithInNodes(changed, 1);
+        nodes.erase(std::remove_if(nodes.begin(), nodes.end(), [](BaseNode* n) { return n->OutDegree() == 0; }), nodes.end());
+        Debug("Check %zd changed nodes\n", nodes.size());
+    } else {
+        nodes = graph_.CollectNodes([](BaseNode* n) {
+            return n->OutDegree() > 0;
+        });
+    }
 
-    auto nodes = graph_.CollectNodes([](BaseNode* n) {
-        return n->OutDegree() > 0;
+    // 先把出边按长度排序，之后的分析只读图，可以并行
+    ParallelFor(nodes.size(), [&nodes](size_t i) {
+		std::vector<BaseEdge*> &out_edges = nodes[i]->GetOutEdges();
+		std::sort(out_edges.begin(), out_edges.end(), [](BaseEdge* a, BaseEdge *b) { return a->Length() < b->Length(); });
     });
 
-    for (auto n : nodes) { n->mark_ = 'V'; }
-
-	for (auto n : nodes) {
+    auto reduced = AnalyseInParallel<BaseEdge*>(nodes, [this](BaseNode* n, std::vector<BaseEdge*> &reduced) {
         assert(n->OutDegree() > 0);
 
-		std::vector<BaseEdge*> &out_edges = n->GetOutEdges();
+		const std::vector<BaseEdge*> &out_edges = n->GetOutEdges();
 
-		std::sort(out_edges.begin(), out_edges.end(), [](BaseEdge* a, BaseEdge *b) { return a->Length() < b->Length(); });
+        // 出节点的标记，'I'表示相邻，'E'表示可由其它出节点到达。按地址排序以便查找
+        std::vector<std::pair<const BaseNode*, size_t>> index(out_edges.size());
+        for (size_t i = 0; i < out_edges.size(); ++i) {
+            index[i] = std::make_pair(out_edges[i]->OutNode(), i);
+        }
+        std::sort(index.begin(), index.end());
+        std::vector<char> marks(out_edges.size(), 'I');
 
-		for (auto e : out_edges) {
-			e->OutNode()->mark_ = 'I';
-		}
+        auto eliminate = [&index, &marks](const BaseNode* w) {
+            auto it = std::lower_bound(index.begin(), index.end(), std::make_pair(w, (size_t)0));
+            if (it != index.end() && it->first == w && marks[it->second] == 'I') {
+                marks[it->second] = 'E';
+            }
+        };
 
 		int max_len = out_edges.back()->Length()  + fuzz_;
 
-		for (auto e : out_edges) {
+		for (size_t i = 0; i < out_edges.size(); ++i) {
+            auto e = out_edges[i];
 			BaseNode* w = e->OutNode();
-			if (w->mark_ == 'I') {
-				std::sort(w->GetOutEdges().begin(), w->GetOutEdges().end(), [](BaseEdge* a, BaseEdge *b) { return a->Length() < a->Length(); });
+			if (marks[i] == 'I') {
 				for (auto e2 : w->GetOutEdges()) {
 					if (e2->Length() + e->Length() < (size_t)max_len) {
-						if (e2->OutNode()->mark_ == 'I') {
-							e2->OutNode()->mark_ = 'E';
-						}
+                        eliminate(e2->OutNode());
 					}
 				}
 			}
 		}
 		for (auto e : out_edges) {
-			BaseNode* w = e->OutNode();
-			std::sort(w->GetOutEdges().begin(), w->GetOutEdges().end(), [](BaseEdge* a, BaseEdge *b) { return a->Length() < b->Length(); });
-			if (w->OutDegree() > 0) {
-				//if (w->out_edges_.front()->OutNode()->mark_ == 'I') {
-				//	w->out_edges_.front()->OutNode()->mark_ = 'E';
-                //}
-			}				
-			for (auto e2 : w->GetOutEdges()) {
+			for (auto e2 : e->OutNode()->GetOutEdges()) {
 				if (e2->Length() < fuzz_) {
-					if (e2->OutNode()->mark_ == 'I') {
-						e2->OutNode()->mark_ = 'E';
-					}
+                    eliminate(e2->OutNode());
 				}
 			}
 		}
 
-		for (auto e : out_edges) {
-			if (e->OutNode()->mark_ == 'E') {
-                reduced.insert(e);
-                //reduced.insert(StringGraph::ReverseEdge(e));
+		for (size_t i = 0; i < out_edges.size(); ++i) {
+			if (marks[i] == 'E') {
+                reduced.push_back(out_edges[i]);
 			}
-			e->OutNode()->mark_ = 'V';
 		}
-	}
+	});
 
     graph_.ReduceEdges(reduced, BaseEdge::RT_TRANSITIVE);
 
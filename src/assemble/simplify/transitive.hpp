@@ -12,6 +12,7 @@ public:
     }
 
     virtual bool ParseParameters(const std::vector<std::string> &params);
+    virtual std::string GetParameters() const;
 
     virtual void Running();
     
@@ -92,6 +92,8 @@ void ReadStatInfo::Stat(int i, AsmOptions& opts_) {
 
 void StatReadInfo::Add(Overlap& o) {
 
+    read_infos_[o.a_.id].id = o.a_.id;
+    read_infos_[o.b_.id].id = o.b_.id;
     read_infos_[o.a_.id].len = o.a_.len;
     read_infos_[o.b_.id].len = o.b_.len;
 
@@ -125,6 +127,22 @@ void StatReadInfo::Merge(StatReadInfo &sri) {
     sri.Clear();
 }
 
+void StatReadInfo::MoveTo(std::vector<ReadStatInfo> &infos) {
+    for (auto &ri : read_infos_) {
+        if (ri.first >= (Seq::Id)infos.size()) {
+            infos.resize(ri.first + 1);
+        }
+        auto &info = infos[ri.first];
+        if (info.Valid()) {
+            info.identities.insert(info.identities.end(), std::make_move_iterator(ri.second.identities.begin()), std::make_move_iterator(ri.second.identities.end()));
+            info.overhangs.insert(info.overhangs.end(), std::make_move_iterator(ri.second.overhangs.begin()), std::make_move_iterator(ri.second.overhangs.end()));
+        } else {
+            info = std::move(ri.second);
+        }
+    }
+    Clear();
+}
+
 void StatReadInfo::Clear() {
     read_infos_.clear();
 }
@@ -115,6 +115,7 @@ struct ReadStatInfo {
     int covtype { 0 };
     RdReason filtered {RdReason::Ok()};
     std::array<int,2> cliff {{-1, -1}};
+    bool Valid() const { return id >= 0; }
     double IdentityThreshold(int start, int end) const ;
     bool CheckIdentity(const Overlap& o) const ;
     bool CheckOverhang(const Overlap& o) const ;
@@ -136,6 +137,7 @@ public:
     size_t Size() const { return read_infos_.size(); }
     void Add(Overlap& o);
     void Merge(StatReadInfo &sri);
+    void MoveTo(std::vector<ReadStatInfo> &infos);      // infos以read id为下标
     void Clear();
     std::unordered_map<Seq::Id, ReadStatInfo> &read_infos_;
     std::unordered_map<Seq::Id, ReadStatInfo> default_read_infos_;
@@ -15,8 +15,8 @@ static void PathToString(std::ostream &oss, const T& path, const StringPool &sp)
 std::string SgEdgeID::ToString(const StringPool &sp) const {
     std::ostringstream oss;
     oss << type_;
-    for (auto v : values_) {
-        oss << "~" << v.ToString(sp);
+    for (size_t i = 0; i < size_; ++i) {
+        oss << "~" << Value(i).ToString(sp);
     }
     return oss.str();
 }
@@ -24,8 +24,8 @@ std::string SgEdgeID::ToString(const StringPool &sp) const {
 std::string SgEdgeID::ToString() const {
     std::ostringstream oss;
     oss << type_;
-    for (auto v : values_) {
-        oss << "~" << v.ToString();
+    for (size_t i = 0; i < size_; ++i) {
+        oss << "~" << Value(i).ToString();
     }
     return oss.str();
 }
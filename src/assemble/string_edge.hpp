@@ -2,6 +2,7 @@
 
 #include <array>
 #include <list>
+#include <memory>
 
 #include "../overlap.hpp"
 #include "string_node.hpp"
@@ -19,27 +20,44 @@ struct SgEdgeState {
 
 };
 
+// 边的编号。字符串图的边由两个节点构成，存放在对象内；由两条边合并的边有四个节点，才分配数组。
 struct SgEdgeID {
     SgEdgeID() {}
-    SgEdgeID(int t, const SgNode::ID &a, const SgNode::ID& b) : type_(t), values_({a, b}){
-        values_.shrink_to_fit();
+    SgEdgeID(int t, const SgNode::ID &a, const SgNode::ID& b) : type_(t), size_(2), values_{{a, b}} {
     }
     
     SgEdgeID(int t, const SgNode::ID &a0, const SgNode::ID &a1, const SgNode::ID &b1, const SgNode::ID& b0) 
-     : type_(t), values_({a0, a1, b1, b0}) {
-
-        values_.shrink_to_fit();
+     : type_(t), size_(4), ext_(new SgNodeID[4] {a0, a1, b1, b0}) {
     }
 
-    SgEdgeID(int t, const std::vector<BaseNode::ID> &vs) : type_(t), values_(vs) {
+    SgEdgeID(int t, const std::vector<BaseNode::ID> &vs) : type_(t), size_(vs.size()) {
         assert(vs.size() == 2 || vs.size() == 4);
-        values_.shrink_to_fit();
+        if (size_ == 2) {
+            values_[0] = vs[0];
+            values_[1] = vs[1];
+        } else {
+            ext_.reset(new SgNodeID[4] {vs[0], vs[1], vs[2], vs[3]});
+        }
+    }
+
+    SgEdgeID(const SgEdgeID &a) : type_(a.type_), size_(a.size_), values_(a.values_) {
+        if (a.ext_ != nullptr) ext_.reset(new SgNodeID[4] {a.ext_[0], a.ext_[1], a.ext_[2], a.ext_[3]});
+    }
+    SgEdgeID(SgEdgeID &&a) = default;
+
+    SgEdgeID& operator = (const SgEdgeID &a) {
+        if (this != &a) {
+            SgEdgeID b(a);
+            *this = std::move(b);
+        }
+        return *this;
     }
+    SgEdgeID& operator = (SgEdgeID &&a) = default;
 
-    bool IsMultiple() const { assert(values_.size() == 2 || values_.size() == 4); return values_.size() == 4;}
+    bool IsMultiple() const { assert(size_ == 2 || size_ == 4); return size_ == 4;}
     int Type() const { return type_; }
-    const SgNodeID& Value(size_t i) const { return values_[i]; }
-    size_t ValueSize() const { return values_.size(); }
+    const SgNodeID& Value(size_t i) const { return size_ == 4 ? ext_[i] : values_[i]; }
+    size_t ValueSize() const { return size_; }
     struct Hash {
         size_t operator()(const SgEdgeID& r) const { 
             return r.hash();
@@ -53,10 +71,11 @@ struct SgEdgeID {
     }
 
     void Reverse() {
-        std::for_each(values_.begin(), values_.end(), [](BaseNode::ID& i) {
+        SgNodeID *v = size_ == 4 ? ext_.get() : values_.data();
+        std::for_each(v, v + size_, [](BaseNode::ID& i) {
             i.Reverse();
         });
-        std::reverse(values_.begin(), values_.end());
+        std::reverse(v, v + size_);
     }
 
     bool operator == (const SgEdgeID &a) const {
@@ -72,8 +91,8 @@ struct SgEdgeID {
         size_t h = 17;
         h = h * 31 + std::hash<int>()(type_);
         
-        for (size_t i = 0; i < values_.size(); ++i) {
-            h = h * 31 + values_[i].hash();
+        for (size_t i = 0; i < size_; ++i) {
+            h = h * 31 + Value(i).hash();
         }
         return h;
     }
@@ -83,7 +102,9 @@ struct SgEdgeID {
 
 protected:
     int type_ { 0 };
-    std::vector<SgNodeID> values_; // 
+    size_t size_ { 0 };
+    std::array<SgNodeID, 2> values_;            // 两个节点的边
+    std::unique_ptr<SgNodeID[]> ext_;           // 四个节点的边
 };
 
 
@@ -327,7 +327,41 @@ std::vector<std::vector<SgEdge*>> SgGraph::MaximumFlow(const SgNode* src, const
 }
 
 
+void SgGraph::TrackChanges() {
+    if (!tracking_) {
+        VisitNodes([this](SgNode* n) { n->SetChangeLog(&changes_); });
+        tracking_ = true;
+    }
+}
+
+std::vector<SgNode*> SgGraph::ChangedNodes(size_t pos) const {
+    std::vector<SgNode*> nodes;
+    for (size_t i = std::max(pos, changes_.base); i < changes_.End(); ++i) {
+        auto n = changes_.nodes[i - changes_.base];
+        if (n->ChangePosition() == i) nodes.push_back(n);     // 之后又有变化的，在后面的位置取出
+    }
+    return nodes;
+}
+
+void SgGraph::DiscardChanges() {
+    size_t pos = changes_.End();
+    for (const auto &i : simplifiers_) {
+        pos = std::min(pos, i.second->FirstNeededChange());
+    }
+    if (pos > changes_.base) {
+        changes_.nodes.erase(changes_.nodes.begin(), changes_.nodes.begin() + (pos - changes_.base));
+        changes_.base = pos;
+    }
+}
+
+size_t SgGraph::IndexNodes() {
+    size_t index = 0;
+    VisitNodes([&index](SgNode* n) { n->SetIndex(index++); });
+    return index;
+}
+
 void SgGraph::Simplify(const std::string &strategy, const std::string &reducers_str) {
+    TrackChanges();
 
     std::unordered_map<std::string, std::vector<std::string>> params;
     auto reducers = SplitStringByChar(reducers_str, '|');
@@ -358,6 +392,7 @@ void SgGraph::Simplify(const std::string &strategy, const std::string &reducers_
             }
 
             simplifier->second->Simplify(items);
+            DiscardChanges();
 
             index[items[0]]++;
         } else {
@@ -367,10 +402,7 @@ void SgGraph::Simplify(const std::string &strategy, const std::string &reducers_
 }
 
 StringGraph::StringGraph(AsmDataset &asmdata) 
-     : SgGraph(asmdata)
-     , nodes_(reinterpret_cast<std::unordered_map<BaseNode::ID, BaseNode*, BaseNode::ID::Hash> &>(org_nodes_))
-     , edges_(reinterpret_cast<std::unordered_map<BaseEdge::ID, BaseEdge*, BaseEdge::ID::Hash> &>(org_edges_)) {
-//{
+     : SgGraph(asmdata) {
     simplifiers_["transitive"].reset(new TransitiveSimplifier(*this));
     simplifiers_["spur"].reset(new SpurSimplifier(*this));
     simplifiers_["best"].reset(new BestOverlapsSimplifier(*this));
@@ -398,7 +430,7 @@ std::string StringGraph::IdToString(BaseNode::ID id) const {
 
 }
 
-void StringGraph::AddOverlap(const Overlap* overlap) {
+std::array<StringGraph::EdgeEnds, 2> StringGraph::GetEdgeEnds(const Overlap* overlap) {
 
 	Seq::EndId fB = Seq::IdToEndId(overlap->a_.id, 0);
 	Seq::EndId fE = Seq::IdToEndId(overlap->a_.id, 1);
@@ -414,8 +446,7 @@ void StringGraph::AddOverlap(const Overlap* overlap) {
 			//	      g.B           g.E
             assert(overlap->b_.start == 0 && overlap->b_.end < overlap->b_.len);
            
-			AddEdge(overlap, fE, gE, overlap->b_.id);
-			AddEdge(overlap, gB, fB, overlap->a_.id);
+			return {{ {fE, gE, overlap->b_.id}, {gB, fB, overlap->a_.id} }};
 		} else {
 			// f.B         f.E
 			//	f----------->
@@ -423,8 +454,7 @@ void StringGraph::AddOverlap(const Overlap* overlap) {
 			//	          g.E           g.B
             assert(overlap->b_.start > 0 && overlap->b_.end == overlap->b_.len);
 
-			AddEdge(overlap, fE, gB, overlap->b_.id);
-			AddEdge(overlap, gE, fB, overlap->a_.id);
+			return {{ {fE, gB, overlap->b_.id}, {gE, fB, overlap->a_.id} }};
 			
 		}
 	} else {
@@ -436,8 +466,7 @@ void StringGraph::AddOverlap(const Overlap* overlap) {
 			//	g------------->
 			//	g.B           g.E
             assert(overlap->b_.start > 0 && overlap->b_.end == overlap->b_.len);
-			AddEdge(overlap, fB, gB, overlap->b_.id);
-			AddEdge(overlap, gE, fE, overlap->a_.id);
+			return {{ {fB, gB, overlap->b_.id}, {gE, fE, overlap->a_.id} }};
 		}
 		else {
 			//        f.B         f.E
@@ -445,31 +474,22 @@ void StringGraph::AddOverlap(const Overlap* overlap) {
 			//	g <------------ 
 			//	g.E           g.B
             assert(overlap->b_.start == 0 && overlap->b_.end < overlap->b_.len);
-			AddEdge(overlap, fB, gE, overlap->b_.id);
-			AddEdge(overlap, gB, fE, overlap->a_.id);
+			return {{ {fB, gE, overlap->b_.id}, {gB, fE, overlap->a_.id} }};
 		}
 	}
 
 }
 
-void StringGraph::AddOverlaps(const OverlapStore &ol_store) {
-
-    std::unordered_set<std::array<Seq::Id, 2>, ArrayHash<int,2>, ArrayEqual<int,2>> done;
-    for (size_t i=0; i<ol_store.Size(); ++i) {
-        const auto& o = ol_store.Get(i);
-        auto ids = std::minmax(o.a_.id, o.b_.id);
-        std::array<Seq::Id, 2> id_pair = {ids.first, ids.second};
-
-        if (done.find(id_pair) == done.end()) {
-
-            if (o.attached == 0) {
-                AddOverlap(&(o));
-                done.insert(id_pair);
-
-            }
-        }
+void StringGraph::AddOverlap(const Overlap* overlap) {
+    for (const auto &ee : GetEdgeEnds(overlap)) {
+        AddEdge(overlap, ee.in, ee.out, ee.read);
     }
-    LOG(INFO)("Done = %zd", done.size());
+}
+
+void StringGraph::AddOverlaps(const OverlapStore &ol_store) {
+    AddOverlaps(ol_store, [](const Overlap &o) {
+        return o.attached == 0;
+    });
 }
 
 void StringGraph::AddOverlaps(const OverlapStore &ol_store, int min_length, int min_aligned_lenght, float min_identity) {
@@ -486,22 +506,139 @@ void StringGraph::AddOverlaps(const OverlapStore &ol_store, int min_length, int
     }
 
     LOG(INFO)("contained = %zd", contained.size());
-    std::unordered_set<std::array<Seq::Id, 2>, ArrayHash<int,2>, ArrayEqual<int,2>> done;
-    for (size_t i=0; i<ol_store.Size(); ++i) {
-        const auto& o = ol_store.Get(i);
+    AddOverlaps(ol_store, [&](const Overlap &o) {
+        return o.attached == 0 && !FilterOverlap(o, contained, min_length, min_aligned_lenght, min_identity);
+    });
+}
+
+template<typename A>
+void StringGraph::AddOverlaps(const OverlapStore &ol_store, A accept) {
+    // 结果和依次调用AddOverlap相同：同一对read只取第一个被接受的重叠，节点和边按重叠的顺序加入。
+    // 筛选、去重和连接节点由多线程完成，只有节点和边的创建是单线程的。
+    const size_t thread_size = std::max<size_t>(1, (size_t)Options().thread_size);
+    auto block = [thread_size](size_t size, size_t i) {
+        return std::array<size_t, 2>{{ size * i / thread_size, size * (i + 1) / thread_size }};
+    };
+
+    // 筛选重叠，每个线程处理连续的一段，合并后仍按原来的顺序
+    std::vector<std::vector<size_t>> accepted(thread_size);
+    MultiThreadRun(thread_size, [&](size_t t) {
+        auto range = block(ol_store.Size(), t);
+        for (size_t i = range[0]; i < range[1]; ++i) {
+            if (accept(ol_store.Get(i))) accepted[t].push_back(i);
+        }
+    });
+
+    std::vector<size_t> cands;
+    for (const auto &a : accepted) cands.insert(cands.end(), a.begin(), a.end());
+    accepted.clear();
+
+    // 按read对的哈希划分：各线程先把自己那一段的重叠分到所属线程的桶中，
+    // 再由所属线程依次处理各段的桶，即按原来的顺序去重，保留第一个
+    auto id_pair = [&ol_store, &cands](size_t i) {
+        const auto& o = ol_store.Get(cands[i]);
         auto ids = std::minmax(o.a_.id, o.b_.id);
-        std::array<Seq::Id,2> id_pair = {ids.first, ids.second};
+        return std::array<Seq::Id, 2>{{ids.first, ids.second}};
+    };
 
-        if (done.find(id_pair) == done.end()) {
+    std::vector<std::vector<std::vector<size_t>>> buckets(thread_size, std::vector<std::vector<size_t>>(thread_size));
+    MultiThreadRun(thread_size, [&](size_t t) {
+        ArrayHash<int,2> hash;
+        auto range = block(cands.size(), t);
+        for (size_t i = range[0]; i < range[1]; ++i) {
+            buckets[t][hash(id_pair(i)) % thread_size].push_back(i);
+        }
+    });
+
+    std::vector<uint8_t> keep(cands.size(), 0);
+    MultiThreadRun(thread_size, [&](size_t t) {
+        std::unordered_set<std::array<Seq::Id, 2>, ArrayHash<int,2>, ArrayEqual<int,2>> done;
+        for (size_t s = 0; s < thread_size; ++s) {
+            for (auto i : buckets[s][t]) {
+                if (done.insert(id_pair(i)).second) keep[i] = 1;
+            }
+            std::vector<size_t>().swap(buckets[s][t]);
+        }
+    });
+
+    std::vector<const Overlap*> ols;
+    for (size_t i = 0; i < cands.size(); ++i) {
+        if (keep[i]) ols.push_back(&ol_store.Get(cands[i]));
+    }
+    std::vector<size_t>().swap(cands);
+    std::vector<uint8_t>().swap(keep);
 
-            if (o.attached == 0 && !FilterOverlap(o, contained, min_length, min_aligned_lenght, min_identity)) {
-                AddOverlap(&(o));
-                done.insert(id_pair);
+    std::vector<EdgeEnds> ends(ols.size() * 2);
+    MultiThreadRun(thread_size, [&](size_t t) {
+        auto range = block(ols.size(), t);
+        for (size_t i = range[0]; i < range[1]; ++i) {
+            auto ee = GetEdgeEnds(ols[i]);
+            ends[2*i] = ee[0];
+            ends[2*i+1] = ee[1];
+        }
+    });
 
+    size_t max_index = end_nodes_.size();
+    for (const auto &ee : ends) {
+        max_index = std::max(max_index, std::max(EndIndex(ee.in), EndIndex(ee.out)) + 1);
+    }
+    end_nodes_.resize(max_index, nullptr);
+
+    // 先统计新节点的数量，使它们连续存放
+    std::vector<bool> added(max_index, false);
+    size_t new_nodes = 0;
+    for (const auto &ee : ends) {
+        for (auto id : { ee.in, ee.out }) {
+            if (end_nodes_[EndIndex(id)] == nullptr && !added[EndIndex(id)]) {
+                added[EndIndex(id)] = true;
+                new_nodes++;
             }
         }
     }
-    LOG(INFO)("Done = %zd", done.size());
+    std::vector<bool>().swap(added);
+
+    nodes_.Reserve(new_nodes);
+    for (const auto &ee : ends) {
+        if (GetNode(ee.in) == nullptr) AddNode(ee.in);
+        if (GetNode(ee.out) == nullptr) AddNode(ee.out);
+    }
+
+    std::vector<BaseEdge*> edges(ends.size(), nullptr);
+    edges_.Reserve(ends.size());
+    edge_index_.reserve(edge_index_.size() + ends.size());
+    for (size_t i = 0; i < ends.size(); ++i) {
+        edges[i] = CreateEdge(GetNode(ends[i].in), GetNode(ends[i].out), ends[i].read, ols[i / 2]);
+    }
+    const size_t ol_size = ols.size();
+    std::vector<EdgeEnds>().swap(ends);
+    std::vector<const Overlap*>().swap(ols);
+
+    // 按节点划分，每个节点的边只由一个线程加入，顺序与edges相同。划分方式同去重，
+    // 桶中的值为 边的序号*2 + (0: 入节点的出边, 1: 出节点的入边)
+    auto owner = [thread_size](const BaseNode* n) { return EndIndex(n->Id().MainNode()) % thread_size; };
+    MultiThreadRun(thread_size, [&](size_t t) {
+        auto range = block(edges.size(), t);
+        for (size_t i = range[0]; i < range[1]; ++i) {
+            buckets[t][owner(edges[i]->InNode())].push_back(2*i);
+            buckets[t][owner(edges[i]->OutNode())].push_back(2*i+1);
+        }
+    });
+
+    MultiThreadRun(thread_size, [&](size_t t) {
+        for (size_t s = 0; s < thread_size; ++s) {
+            for (auto k : buckets[s][t]) {
+                auto e = edges[k / 2];
+                if (k % 2 == 0) {
+                    e->InNode()->AddOutEdge(e);
+                } else {
+                    e->OutNode()->AddInEdge(e);
+                }
+            }
+            std::vector<size_t>().swap(buckets[s][t]);
+        }
+    });
+
+    LOG(INFO)("Done = %zd", ol_size);
 }
 
 
@@ -525,27 +662,41 @@ bool StringGraph::FilterOverlap(const Overlap &ovlp, const std::unordered_set<Ba
 }
 
 void StringGraph::AddEdge(const Overlap* ol, int in_node, int out_node, int read) {
-	auto in = nodes_.find(in_node);
-	if (in == nodes_.end()) {
-		auto r = nodes_.insert(std::make_pair(in_node, new BaseNode(in_node)));
-		assert(r.second);
-		in = r.first;
+	BaseNode* in = GetNode(in_node);
+	if (in == nullptr) {
+		in = AddNode(in_node);
 	}
 
-	auto out = nodes_.find(out_node);
-	if (out == nodes_.end()) {
-		auto r = nodes_.insert(std::make_pair(out_node, new BaseNode(out_node)));
-		assert(r.second);
-		out = r.first;
+	BaseNode* out = GetNode(out_node);
+	if (out == nullptr) {
+		out = AddNode(out_node);
 	}
 	
-	BaseEdge *e = new BaseEdge(in->second, out->second);
-	edges_[BaseEdge::ID(0, in_node, out_node)] = e;
+	BaseEdge *e = CreateEdge(in, out, read, ol);
+    in->AddOutEdge(e);
+    out->AddInEdge(e);
+}
+
+BaseEdge* StringGraph::CreateEdge(BaseNode* in, BaseNode* out, Seq::Id read, const Overlap* ol) {
+    BaseEdge* e = edges_.Emplace(in, out);
     e->read_ = read;
     e->ol_ = ol;
+    auto r = edge_index_.insert(std::make_pair(EdgeKey(in, out), e));
+    if (!r.second) r.first->second = e;     // 与原来按编号保存时相同，同一对节点保留最后加入的边
+    return e;
+}
+
+BaseNode* StringGraph::AddNode(int end_id) {
+	size_t index = EndIndex(end_id);
+	if (index >= end_nodes_.size()) {
+		end_nodes_.resize(std::max(index + 1, end_nodes_.size() * 2), nullptr);
+	}
+	assert(end_nodes_[index] == nullptr);
 
-    in->second->AddOutEdge(e);
-    out->second->AddInEdge(e);
+	BaseNode* n = nodes_.Emplace(end_id);
+	if (tracking_) n->SetChangeLog(&changes_);
+	end_nodes_[index] = n;
+	return n;
 }
 
 std::unordered_set<BaseNode*> StringGraph::BfsNodes(BaseNode* n, BaseNode *exclude, int depth) {
@@ -627,15 +778,14 @@ bool StringGraph::IsDiffType(const BaseNode* n0, const BaseNode* n1) {
 void StringGraph::IdentifySimplePaths() {
     std::unordered_set<BaseEdge*> visited;
 
-    for (auto &i : edges_) {
-        BaseEdge* e = i.second; // short name
+    edges_.ForEach([&](BaseEdge* e) {
         if (!e->IsReduce() && visited.find(e) == visited.end()) {
             paths_.push_back(ExtendSimplePath(e, visited));
             auto vpath = Reverse(paths_.back());
             for (auto e : vpath) visited.insert(e);
             paths_.push_back(vpath);
         }
-    }
+    });
 
 
 //    assert(Assert_PathDual(paths_));  TOO SLOW
@@ -820,8 +970,7 @@ void StringGraph::SaveEdges(const std::string &fname) {
     if (writer.Valid()) {
         std::ostringstream oss;
         oss << std::setprecision(3);
-        for (auto i : edges_) {
-            BaseEdge* e = i.second;
+        edges_.ForEach([&](BaseEdge* e) {
             auto tile = e->GetTile();
             oss << std::fixed 
                 << std::setw(14) << IdToString(e->InNode()->Id()) << " "
@@ -832,7 +981,7 @@ void StringGraph::SaveEdges(const std::string &fname) {
             if (oss.tellp() >= 100000000) {
                 flush_oss(writer, oss);
             }
-        }
+        });
         flush_oss(writer, oss);
  
 
@@ -864,8 +1013,7 @@ double StringGraph::GetOverlapQuality(const Overlap &ol) {
 
 
 void StringGraph::ReduceOtherEdges(const std::unordered_set<BaseEdge*> reserved, BaseEdge::ReduceType type) {
-    for (auto &i: edges_) { 
-        auto e = i.second;
+    edges_.ForEach([&](BaseEdge* e) {
         if (!e->IsReduce()) {
             auto re = ReverseEdge(e);
             if (reserved.find(e) == reserved.end() && reserved.find(re) == reserved.end()) {
@@ -873,7 +1021,7 @@ void StringGraph::ReduceOtherEdges(const std::unordered_set<BaseEdge*> reserved,
                 re->Reduce(type);
             }
         }
-    }
+    });
 }
 
 
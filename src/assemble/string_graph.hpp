@@ -7,6 +7,9 @@
 #include <deque>
 #include <numeric>
 #include <functional>
+#include <memory>
+#include <new>
+#include <type_traits>
 
 #include "../sequence.hpp"
 #include "../utility.hpp"
@@ -59,11 +62,11 @@ public:
 
     
     SgNode* ReverseNode(SgNode* n) {
-        return org_nodes_[SgNode::ID::Reverse(n->Id())];
+        return QueryNode(SgNode::ID::Reverse(n->Id()));
     }
 
     SgEdge* ReverseEdge(SgEdge* e) {
-        return org_edges_[SgEdge::ID::Reverse(e->Id())];
+        return QueryEdge(SgEdge::ID::Reverse(e->Id()));
     }
     
     std::vector<SgEdge*> ReversePath(const std::vector<SgEdge*> &path) {
@@ -77,12 +80,13 @@ public:
 
 
 
-    SgNode* QueryNode(const SgNode::ID &id) {
+    // 派生类可以把节点和边保存在其它容器中，需要重载QueryNode、QueryEdge和VisitNodes
+    virtual SgNode* QueryNode(const SgNode::ID &id) {
         auto iter = org_nodes_.find(id);
         return iter != org_nodes_.end() ? iter->second : nullptr;
     }
 
-    SgEdge* QueryEdge(const SgEdge::ID &id) {
+    virtual SgEdge* QueryEdge(const SgEdge::ID &id) {
         auto iter = org_edges_.find(id);
         return iter != org_edges_.end() ? iter->second : nullptr;
     }
@@ -101,7 +105,21 @@ public:
 
     void InsertNode(SgNode* n) {
         org_nodes_[n->Id()] = n;
+        if (tracking_) n->SetChangeLog(&changes_);
     }
+
+    // 开始记录节点的变化。之后节点的边被加入、化简或恢复时，节点被追加到changes_，
+    // 简化器可以只处理上次运行以来有变化的节点，不需要扫描整个图。
+    void TrackChanges();
+    // 开始新的纪元并返回记录的当前位置，之后有变化的节点记录在这个位置之后
+    size_t NewChangeEpoch() { changes_.epoch++; return changes_.End(); }
+    // 位置pos之后有变化的节点，每个节点一次，按最后一次变化的顺序
+    std::vector<SgNode*> ChangedNodes(size_t pos) const;
+    // 丢弃所有简化器都不再需要的记录
+    void DiscardChanges();
+
+    // 给所有节点分配[0, size)的稠密编号(SgNode::Index)，返回节点数。图变化后编号失效，需要重新分配。
+    size_t IndexNodes();
     
     void Simplify(const std::string &strategy, const std::string &reducer="");
 
@@ -118,6 +136,70 @@ public:
 
     std::unordered_map<std::string,  std::shared_ptr<class Simplifier>> simplifiers_;
 
+    bool tracking_ { false };
+    SgChangeLog changes_;
+
+protected:
+    virtual void VisitNodes(const std::function<void(SgNode*)> &f) {
+        for (auto &i : org_nodes_) f(i.second);
+    }
+};
+
+// 按块连续存放对象，块不会重新分配，对象的地址在释放前不变。
+// 字符串图的节点和边数量很大，逐个new的分配开销和内存碎片都很明显。
+template<typename T>
+class FlatStore {
+public:
+    FlatStore() {}
+    FlatStore(const FlatStore&) = delete;
+    FlatStore& operator = (const FlatStore&) = delete;
+    ~FlatStore() { Clear(); }
+
+    // 保证之后的n个对象存放在同一块中
+    void Reserve(size_t n) {
+        if (blocks_.empty() || blocks_.back().capacity - blocks_.back().size < n) {
+            Block b;
+            b.capacity = std::max(n, (size_t)kMinBlock);
+            b.data.reset(new Storage[b.capacity]);
+            blocks_.push_back(std::move(b));
+        }
+    }
+
+    template<typename... Args>
+    T* Emplace(Args&&... args) {
+        Reserve(1);
+        auto &b = blocks_.back();
+        T* t = new (&b.data[b.size]) T(std::forward<Args>(args)...);
+        b.size++;
+        size_++;
+        return t;
+    }
+
+    size_t Size() const { return size_; }
+
+    template<typename F>
+    void ForEach(F f) {
+        for (auto &b : blocks_) {
+            for (size_t i = 0; i < b.size; ++i) f(reinterpret_cast<T*>(&b.data[i]));
+        }
+    }
+
+    void Clear() {
+        ForEach([](T* t) { t->~T(); });
+        blocks_.clear();
+        size_ = 0;
+    }
+
+protected:
+    typedef typename std::aligned_storage<sizeof(T), alignof(T)>::type Storage;
+    struct Block {
+        std::unique_ptr<Storage[]> data;
+        size_t size { 0 };
+        size_t capacity { 0 };
+    };
+    static const size_t kMinBlock = 4096;
+    std::vector<Block> blocks_;
+    size_t size_ { 0 };
 };
 
 class StringGraph : public SgGraph {
@@ -134,23 +216,32 @@ public:
         return BaseEdge::ID::Reverse(id);
     }
     BaseNode* ReverseNode(BaseNode* n) {
-        return nodes_[ReverseNode(n->Id())];
+        return GetNode(Seq::ReverseEndId(n->Id().MainNode()));
     }
 
     BaseEdge* ReverseEdge(BaseEdge* e) {
-        return edges_[ReverseEdge(e->Id())];
+        return GetEdge(ReverseNode(e->OutNode()), ReverseNode(e->InNode()));
     }
     
     std::list<BaseEdge*> Reverse(const std::list<BaseEdge*>& path);
 
-    BaseNode* GetNode(BaseNode::ID id) {
-        auto i = nodes_.find(id);
-        return i != nodes_.end() ? i->second : nullptr;
+    BaseNode* GetNode(Seq::EndId id) {
+        size_t i = EndIndex(id);
+        return i < end_nodes_.size() ? end_nodes_[i] : nullptr;
+    }
+
+    BaseNode* GetNode(const BaseNode::ID &id) {
+        return IsBaseId(id) ? GetNode(id.MainNode()) : nullptr;
+    }
+
+    BaseEdge* GetEdge(BaseNode* in, BaseNode* out) {
+        if (in == nullptr || out == nullptr) return nullptr;
+        auto i = edge_index_.find(EdgeKey(in, out));
+        return i != edge_index_.end() ? i->second : nullptr;
     }
 
-    BaseEdge* GetEdge(BaseNode::ID iid, BaseNode::ID oid) {
-        auto i = edges_.find(BaseEdge::ID(0, iid, oid));
-        return i != edges_.end() ? i->second : nullptr;
+    BaseEdge* GetEdge(const BaseNode::ID &iid, const BaseNode::ID &oid) {
+        return GetEdge(GetNode(iid), GetNode(oid));
     }
 
     void AddOverlap(const Overlap* overlap);
@@ -158,13 +249,33 @@ public:
     void AddOverlaps(const class OverlapStore &ol_store, int min_length, int min_aligned_lenght, float min_identity);
     bool FilterOverlap(const Overlap &ovlp, const std::unordered_set<BaseNode::ID, BaseNode::ID::Hash> &contained, int min_length, int min_aligned_length, float min_identity);    
     void AddEdge(const Overlap* ol, int in_node, int out_node, int read);
+    BaseNode* AddNode(int end_id);
+
+    // 重叠产生的一条边，in和out为Seq::EndId，read为边所延伸的read
+    struct EdgeEnds {
+        Seq::EndId in;
+        Seq::EndId out;
+        Seq::Id read;
+    };
+    static std::array<EdgeEnds, 2> GetEdgeEnds(const Overlap* overlap);
 
 
     std::unordered_set<BaseNode*> BfsNodes(BaseNode* n, BaseNode* exclude=nullptr, int depth=5);
     
+    // 按边的端点排序。修改图的顺序会影响节点中边的顺序，排序后不依赖于容器中指针的顺序。
+    template<typename C>
+    static std::vector<BaseEdge*> SortEdges(const C& c) {
+        std::vector<BaseEdge*> es(c.begin(), c.end());
+        std::sort(es.begin(), es.end(), [](const BaseEdge* a, const BaseEdge* b) {
+            return std::make_pair(a->InNode()->Id().MainNode(), a->OutNode()->Id().MainNode()) < 
+                   std::make_pair(b->InNode()->Id().MainNode(), b->OutNode()->Id().MainNode());
+        });
+        return es;
+    }
+
     template<typename C>
     void ReduceEdges(const C& c,  BaseEdge::ReduceType type) {
-        for (auto& e : c) {
+        for (auto& e : SortEdges(c)) {
             if (!e->IsReduce()) {
                 e->Reduce(type);
                 ReverseEdge(e)->Reduce(type);
@@ -174,7 +285,7 @@ public:
 
     template<typename C>
     void ReactiveEdges(const C& c) {
-        for (auto& e : c) {
+        for (auto& e : SortEdges(c)) {
             if (e->IsReduce()) {
                 e->Reactivate();
                 ReverseEdge(e)->Reactivate();
@@ -191,21 +302,29 @@ public:
     template<typename F>
     std::vector<BaseNode*> CollectNodes(F f) {
         std::vector<BaseNode*> ns;
-        for (auto& i : nodes_) {
-            if (f(i.second)) ns.push_back(i.second);
-        }
+        nodes_.ForEach([&](BaseNode* n) {
+            if (f(n)) ns.push_back(n);
+        });
         return ns;
     }
 
     template<typename F> 
     std::vector<BaseEdge*> CollectEdges(F f) {
         std::vector<BaseEdge*> es;
-        for (auto& i : edges_) {
-            if (f(i.second)) es.push_back(i.second);
-        }
+        edges_.ForEach([&](BaseEdge* e) {
+            if (f(e)) es.push_back(e);
+        });
         return es;
     }
 
+    virtual SgNode* QueryNode(const SgNode::ID &id) { return GetNode(id); }
+    virtual SgEdge* QueryEdge(const SgEdge::ID &id) {
+        if (id.Type() == 0 && id.ValueSize() == 2 && IsBaseId(id.Value(0)) && IsBaseId(id.Value(1))) {
+            return GetEdge(id.Value(0), id.Value(1));
+        }
+        return nullptr;
+    }
+
     LinearPath FindBridgePath(BaseEdge* start, int max_length, int max_nodesize);
 
  //   void PhaseCross();
@@ -227,10 +346,30 @@ public:
     double GetOverlapQuality(const Overlap& ol);
     void ReduceOtherEdges(const std::unordered_set<BaseEdge*> reserved, BaseEdge::ReduceType type);
 protected:
+    template<typename A>
+    void AddOverlaps(const class OverlapStore &ol_store, A accept);
+
+    virtual void VisitNodes(const std::function<void(SgNode*)> &f) {
+        nodes_.ForEach([&f](BaseNode* n) { f(n); });
+    }
+
+    BaseEdge* CreateEdge(BaseNode* in, BaseNode* out, Seq::Id read, const Overlap* ol);
+
     std::list<std::list<BaseEdge*>> paths_;
     
-    std::unordered_map<BaseNode::ID, BaseNode*, BaseNode::ID::Hash>& nodes_;
-    std::unordered_map<BaseEdge::ID, BaseEdge*, BaseEdge::ID::Hash>& edges_;
+    // 字符串图只有单个read端点的节点和两个节点的边，不放入org_nodes_和org_edges_。
+    // 节点和边连续存放在nodes_和edges_中，节点按Seq::EndId直接索引，边按两端节点的索引查找，
+    // 构建和化简时不需要为每个对象分配内存，也不需要计算编号的哈希。
+    static bool IsBaseId(const BaseNode::ID &id) { return id.Type() == ID_NODE_TYPE_STRING && id.ValueSize() == 1; }
+    static size_t EndIndex(Seq::EndId id) { return (size_t)Seq::EndIdToId(id) * 2 + Seq::End(id); }
+    static uint64_t EdgeKey(const BaseNode* in, const BaseNode* out) {
+        return ((uint64_t)EndIndex(in->Id().MainNode()) << 32) | EndIndex(out->Id().MainNode());
+    }
+
+    FlatStore<BaseNode> nodes_;
+    FlatStore<BaseEdge> edges_;
+    std::vector<BaseNode*> end_nodes_;
+    std::unordered_map<uint64_t, BaseEdge*> edge_index_;
 
 
 friend class PhaseCrossSimplifier;
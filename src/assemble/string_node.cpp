@@ -7,8 +7,8 @@ namespace fsa {
 std::string SgNodeID::ToString(const StringPool &sp) const {
     std::ostringstream oss;
     oss << t ;
-    for (auto iv : v) {
-        oss << "_" << sp.QueryStringById(Seq::EndIdToId(iv));
+    for (size_t i = 0; i < n; ++i) {
+        oss << "_" << sp.QueryStringById(Seq::EndIdToId(Value(i)));
     }
     return oss.str();
 }
@@ -16,8 +16,8 @@ std::string SgNodeID::ToString(const StringPool &sp) const {
 std::string SgNodeID::ToString() const {
     std::ostringstream oss;
     oss <<  (int)t;
-    for (auto iv : v) {
-        oss << "_" << iv;
+    for (size_t i = 0; i < n; ++i) {
+        oss << "_" << Value(i);
     }
     return oss.str();
 }
@@ -251,10 +251,10 @@ bool CrossNode::IsRaw() const {
 SgNodeID CrossNode::CreateID() const {
     std::vector<int> values;
     
-    values.insert(values.end(), in_nodes_[0]->Id().Values().begin(), in_nodes_[0]->Id().Values().end());
-    values.insert(values.end(), in_nodes_[1]->Id().Values().begin(), in_nodes_[1]->Id().Values().end());
-    values.insert(values.end(), out_nodes_[0]->Id().Values().begin(), out_nodes_[0]->Id().Values().end());
-    values.insert(values.end(), out_nodes_[1]->Id().Values().begin(), out_nodes_[1]->Id().Values().end());
+    for (auto n : { in_nodes_[0], in_nodes_[1], out_nodes_[0], out_nodes_[1] }) {
+        const SgNodeID &id = n->Id();
+        values.insert(values.end(), id.Data(), id.Data() + id.ValueSize());
+    }
 
     std::sort(values.begin(), values.end());
 
@@ -24,31 +24,65 @@ static const int ID_EDGE_TYPE_CROSS = 6;
 
 static const int ID_EDGE_TYPE_ALT = 7;
 
+// 节点的编号。字符串图的节点只有一个值(Seq::EndId)，合并产生的节点(Bubble/Loop/Cross等)有多个值。
+// 不超过两个值时存放在对象内，不需要分配堆内存，多于两个值时才分配数组。
 struct SgNodeID {
-    SgNodeID() { t = -1; }
-    SgNodeID(int id, int type=0) {
-        v.push_back(id);
-        v.shrink_to_fit();
-        t = type;
+    SgNodeID() : t(-1), n(0) {}
+    SgNodeID(int id, int type=0) : t(type), n(1) {
+        inl[0] = id;
     }
 
-    SgNodeID(int type, int v0, int v1) {
-        t = type;
-        v.push_back(v0);
-        v.push_back(v1);
-        v.shrink_to_fit();
+    SgNodeID(int type, int v0, int v1) : t(type), n(2) {
+        inl[0] = v0;
+        inl[1] = v1;
     }
 
-    SgNodeID(int type, const std::vector<int> &values) {
-        t = type;
-        v = values;
-        v.shrink_to_fit();
+    SgNodeID(int type, const std::vector<int> &values) : t(type), n(0) {
+        Assign(values.data(), values.size());
     }
     
-    SgNodeID(int type, const SgNodeID& id) {
-        v = id.v;
-        v.shrink_to_fit();
-        t = type;
+    SgNodeID(int type, const SgNodeID& id) : t(type), n(0) {
+        Assign(id.Data(), id.n);
+    }
+
+    SgNodeID(const SgNodeID &a) : t(a.t), n(0) {
+        Assign(a.Data(), a.n);
+    }
+
+    SgNodeID(SgNodeID &&a) : t(a.t), n(a.n) {
+        if (n > 2) {
+            ext = a.ext;
+        } else {
+            inl[0] = a.inl[0];
+            inl[1] = a.inl[1];
+        }
+        a.n = 0;
+    }
+
+    ~SgNodeID() { Release(); }
+
+    SgNodeID& operator = (const SgNodeID &a) {
+        if (this != &a) {
+            t = a.t;
+            Assign(a.Data(), a.n);
+        }
+        return *this;
+    }
+
+    SgNodeID& operator = (SgNodeID &&a) {
+        if (this != &a) {
+            Release();
+            t = a.t;
+            n = a.n;
+            if (n > 2) {
+                ext = a.ext;
+            } else {
+                inl[0] = a.inl[0];
+                inl[1] = a.inl[1];
+            }
+            a.n = 0;
+        }
+        return *this;
     }
 
     bool operator != (const SgNodeID& a) const {
@@ -57,20 +91,24 @@ struct SgNodeID {
 
     bool operator == (const SgNodeID& a) const {
         if (t != a.t) return false;
-        if (v.size() != a.v.size()) return false;
+        if (n != a.n) return false;
 
-        for (size_t i = 0; i < v.size(); ++i) {
-            if (v[i] != a.v[i]) return false;
+        const int *v = Data();
+        const int *av = a.Data();
+        for (size_t i = 0; i < n; ++i) {
+            if (v[i] != av[i]) return false;
         } 
         return true;
     }
 
     bool operator < (const SgNodeID &a) const {
         if (t < a.t) return true;
-        for (size_t i = 0; i < std::min(v.size(), a.v.size()); ++i) {
-            if (v[i] < a.v[i]) return false;
+        const int *v = Data();
+        const int *av = a.Data();
+        for (size_t i = 0; i < std::min(n, a.n); ++i) {
+            if (v[i] < av[i]) return false;
         } 
-        return v.size() < a.v.size();
+        return n < a.n;
     }
 
     struct Hash {
@@ -83,18 +121,19 @@ struct SgNodeID {
         size_t h = 17;
         h = h * 31 + std::hash<int>()(t);
         
-        for (size_t i = 0; i < v.size(); ++i) {
+        const int *v = Data();
+        for (size_t i = 0; i < n; ++i) {
             h = h * 31 + std::hash<int>()(v[i]);
         }
         return h;
     }
 
-    int End() const { return v[0] > 0 ? 0 : 1; }
-    int MainNode() const { return v[0]; }
+    int End() const { return Data()[0] > 0 ? 0 : 1; }
+    int MainNode() const { return Data()[0]; }
     int Type() const { return t; }
-    const std::vector<int>& Values() const { return v; }
-    int Value(size_t i) const { return v[i]; }
-    size_t ValueSize() const { return v.size(); }
+    const int* Data() const { return n > 2 ? ext : inl; }
+    int Value(size_t i) const { return Data()[i]; }
+    size_t ValueSize() const { return n; }
     static SgNodeID Reverse(SgNodeID id) {
         SgNodeID r = id;
         r.Reverse();
@@ -102,21 +141,52 @@ struct SgNodeID {
     }
 
     void Reverse() {
-        std::reverse(v.begin(), v.end());
-        std::for_each(v.begin(), v.end(), [](int& c){ c = Seq::ReverseEndId(c); });
+        int *v = n > 2 ? ext : inl;
+        std::reverse(v, v + n);
+        std::for_each(v, v + n, [](int& c){ c = Seq::ReverseEndId(c); });
     }
 
     std::string ToString(const class StringPool &sp) const;
     std::string ToString() const;
 
-    //int v;
 protected:
-    int t;
-    std::vector<int> v;
+    void Assign(const int *values, size_t size) {
+        Release();
+        n = (uint32_t)size;
+        int *v = inl;
+        if (n > 2) {
+            ext = new int[n];
+            v = ext;
+        }
+        std::copy(values, values + size, v);
+    }
+
+    void Release() {
+        if (n > 2) delete[] ext;
+        n = 0;
+    }
 
+protected:
+    int t;
+    uint32_t n;
+    union {
+        int inl[2];
+        int *ext;
+    };
 };
 
 class SgEdge;
+class SgNode;
+
+// 节点变化的记录，见SgGraph::TrackChanges。记录按变化的顺序追加，同一纪元内每个节点只记一次。
+// 位置是从开始记录算起的绝对位置，nodes[0]的位置为base，之前的记录已被丢弃。
+struct SgChangeLog {
+    size_t End() const { return base + nodes.size(); }
+
+    size_t epoch { 1 };
+    size_t base { 0 };
+    std::vector<SgNode*> nodes;
+};
 
 class SgNode {
 public:
@@ -128,8 +198,8 @@ public:
     size_t  InDegree() const { return  org_in_edges_.size(); }
     size_t OutDegree() const { return org_out_edges_.size(); }
 
-    void AddInEdge(SgEdge* e) { org_in_edges_.push_back(e); }
-    void AddOutEdge(SgEdge* e) { org_out_edges_.push_back(e); }
+    void AddInEdge(SgEdge* e) { org_in_edges_.push_back(e); Changed(); }
+    void AddOutEdge(SgEdge* e) { org_out_edges_.push_back(e); Changed(); }
 
     SgEdge* InEdge(size_t i) { return org_in_edges_[i]; }
     const SgEdge* InEdge(size_t i) const { return org_in_edges_[i]; }
@@ -158,15 +228,34 @@ public:
     bool IsType(const std::string &t) const { return type_.find(t) != std::string::npos; }
 
     bool operator < (const SgNode& n) const { return id_ < n.id_; }
+    void SetChangeLog(SgChangeLog* log) { change_log_ = log; }
+    // 最后一次变化在SgChangeLog中的位置
+    size_t ChangePosition() const { return change_pos_; }
+
+    // 稠密编号，见SgGraph::IndexNodes
+    size_t Index() const { return index_; }
+    void SetIndex(size_t i) { index_ = i; }
 protected: 
     void MoveEdge(std::vector<SgEdge*> &src, std::vector<SgEdge*> &dst, const SgEdge *e) {
         auto it = std::find(src.begin(), src.end(), e);    
         assert(it != src.end());
         dst.push_back(*it);
         src.erase(it);
+        Changed();
+    }
+    void Changed() {
+        if (change_log_ != nullptr && change_epoch_ != change_log_->epoch) {
+            change_epoch_ = change_log_->epoch;
+            change_pos_ = change_log_->End();
+            change_log_->nodes.push_back(this);
+        }
     }
 protected:
     ID id_;
+    SgChangeLog* change_log_ { nullptr };   // 图的变化记录，见SgGraph::TrackChanges
+    size_t change_epoch_ { 0 };             // 最后一次变化时的纪元
+    size_t change_pos_ { 0 };
+    size_t index_ { 0 };
     std::string type_ { "sg" };
 
     std::vector<SgEdge*> org_in_edges_;
@@ -1,5 +1,8 @@
 #include "alignment.hpp"
 
+#include <algorithm>
+#include <cassert>
+
 namespace fsa {
 
 void Alignment::Swap(bool isSameDirect) {
@@ -23,6 +26,47 @@ void Alignment::Swap(bool isSameDirect) {
     }
 }
 
+bool Alignment::Slice(size_t tstart, size_t tend, const DnaSeq* window, Alignment &sub, int mismatch) const {
+    assert(window == nullptr || window->Size() == tend - tstart);
+    sub.Reset(window, query);
+    sub.tid = tid;
+    sub.qid = qid;
+
+    const size_t offset = tstart;
+    tstart = std::max(tstart, target_start);
+    tend = std::min(tend, target_end);
+    if (tstart >= tend) return false;
+
+    size_t it = target_start;
+    size_t iq = query_start;
+    size_t s = aligned_target.size();
+    size_t e = aligned_target.size();
+    size_t qs = iq;
+    for (size_t i = 0; i < aligned_target.size(); ++i) {
+        if (aligned_target[i] != '-') {
+            if (it == tstart) { s = i; qs = iq; }
+            if (it == tend) { e = i; break; }
+            it++;
+        }
+        if (aligned_query[i] != '-') iq++;
+    }
+    assert(s < e);
+
+    sub.aligned_target = aligned_target.substr(s, e - s);
+    sub.aligned_query = aligned_query.substr(s, e - s);
+    sub.target_start = tstart - offset;
+    sub.target_end = tend - offset;
+    sub.query_start = qs;
+    sub.query_end = qs + (sub.aligned_query.size() - std::count(sub.aligned_query.begin(), sub.aligned_query.end(), '-'));
+    sub.distance = 0;
+    for (size_t i = 0; i < sub.aligned_target.size(); ++i) {
+        if (sub.aligned_target[i] != sub.aligned_query[i]) {
+            sub.distance += sub.aligned_target[i] != '-' && sub.aligned_query[i] != '-' ? mismatch : 1;
+        }
+    }
+    return true;
+}
+
 void Alignment::Rearrange(std::string &alq, std::string &alt) {
     
     // 原则: 将alt的base尽量往
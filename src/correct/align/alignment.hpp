@@ -32,6 +32,9 @@ public:
     static void Rearrange(std::string &alq, std::string &alt);
     static void Rearrange1(std::string &alq, std::string &alt);
     bool TrimEnds(size_t checklen=1000, int stub=8);
+    // 截取target区间[tstart, tend)对应的部分，sub的target坐标相对于tstart，sub.target设为window，即该区间的序列。
+    // mismatch是产生该比对的aligner对错配的计分(见ToolAligner::MismatchCost)，用于重新计算distance
+    bool Slice(size_t tstart, size_t tend, const DnaSeq* window, Alignment &sub, int mismatch) const;
 
     int Score() const;
     Seq::Id tid { Seq::NID };
@@ -11,6 +11,7 @@ public:
     virtual ~DiffAligner();
     
     virtual bool Align(const char* qseq, size_t qsize, const char* tseq, size_t tsize, std::array<size_t,2> qrange, std::array<size_t, 2> trange, Alignment& al);
+    virtual int MismatchCost() const { return 2; }
 protected:
     double error_rate_ { 0.15 };
     int segment_size_ { 1000 };
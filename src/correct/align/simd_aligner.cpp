@@ -0,0 +1,271 @@
+#include "simd_aligner.hpp"
+
+#if defined(__SSE2__)
+
+#include <cassert>
+#include <algorithm>
+
+#include "../../utility.hpp"
+#include "../../utils/logger.hpp"
+
+namespace fsa {
+
+static const int16_t NEG = -32768;
+
+SimdAligner::SimdAligner(const std::vector<std::string> &parameters) {
+    // simd:m=2:x=-4:g=-3:w=64:z=200
+    for (size_t i=1; i<parameters.size(); ++i) {
+        auto kv = SplitStringByChar(parameters[i], '=');
+        if (kv.size() != 2) {
+            LOG(ERROR)("Not support parameter: aligner=simd:..:%s:..", parameters[i].c_str());
+        } else if (kv[0] == "m") {
+            match_ = std::stoi(kv[1]);
+        } else if (kv[0] == "x") {
+            mismatch_ = std::stoi(kv[1]);
+        } else if (kv[0] == "g") {
+            gap_ = std::stoi(kv[1]);
+        } else if (kv[0] == "w") {
+            band_ = std::stoi(kv[1]);
+        } else if (kv[0] == "z") {
+            zdrop_ = std::stoi(kv[1]);
+        } else {
+            LOG(ERROR)("Not support parameter: aligner=simd:..:%s:..", parameters[i].c_str());
+        }
+    }
+    band_ = std::max(8, (band_ + 7) / 8 * 8);
+
+    H_.resize(band_ + 1);
+    qc_.resize(kChunk + band_);
+    qb_.resize(kChunk + band_);
+    tc_.resize(kChunk);
+}
+
+bool SimdAligner::Align(const char* qseq, size_t qsize, const char* tseq, size_t tsize, std::array<size_t, 2> qrange, std::array<size_t, 2> trange, Alignment& al) {
+    std::vector<Query> queries(1, Query{qseq, qsize, qrange, trange});
+    std::vector<Alignment> als(1, al);
+    std::vector<bool> rs;
+    Align(tseq, tsize, queries, als, rs);
+    al = als[0];
+    return rs[0];
+}
+
+void SimdAligner::Align(const char* tseq, size_t tsize, const std::vector<Query> &queries, std::vector<Alignment> &als, std::vector<bool> &rs) {
+    assert(als.size() == queries.size());
+    rs.assign(queries.size(), false);
+
+    Strand qls[kLanes], tls[kLanes], qrs[kLanes], trs[kLanes];
+    int left_i[kLanes], left_j[kLanes];
+    for (size_t b = 0; b < queries.size(); b += kLanes) {
+        size_t n = std::min(kLanes, queries.size() - b);
+        for (size_t l = 0; l < n; ++l) {
+            const auto &q = queries[b+l];
+            int qs = (int)q.qrange[0];
+            int ts = (int)q.trange[0];
+            qls[l] = Strand{q.seq + qs - 1, -1, qs};
+            tls[l] = Strand{tseq + ts - 1, -1, ts};
+            qrs[l] = Strand{q.seq + qs, 1, (int)q.size - qs};
+            trs[l] = Strand{tseq + ts, 1, (int)tsize - ts};
+        }
+
+        // 向左延伸的回溯从最远处走向种子点，得到的字符串已是正向
+        Extend(n, qls, tls);
+        for (size_t l = 0; l < n; ++l) {
+            Alignment &al = als[b+l];
+            al.aligned_query.clear();
+            al.aligned_target.clear();
+            al.distance = 0;
+            Traceback(l, qls[l], tls[l], al.aligned_query, al.aligned_target, al.distance);
+            left_i[l] = best_i_[l];
+            left_j[l] = best_j_[l];
+        }
+
+        Extend(n, qrs, trs);
+        std::string alq, alt;
+        for (size_t l = 0; l < n; ++l) {
+            const auto &q = queries[b+l];
+            Alignment &al = als[b+l];
+            alq.clear();
+            alt.clear();
+            Traceback(l, qrs[l], trs[l], alq, alt, al.distance);
+            al.aligned_query.append(alq.rbegin(), alq.rend());
+            al.aligned_target.append(alt.rbegin(), alt.rend());
+
+            al.query_start = q.qrange[0] - left_i[l];
+            al.query_end = q.qrange[0] + best_i_[l];
+            al.target_start = q.trange[0] - left_j[l];
+            al.target_end = q.trange[0] + best_j_[l];
+            rs[b+l] = al.target_end > al.target_start;
+        }
+    }
+}
+
+// H(i, j)是query前i个碱基与target前j个碱基的最高得分，第j列只计算行lo(j) = j+off-w/2开始的w行，
+// off在每块的开始根据上一列得分最高的行调整。H_[r]保存第r行，每个lane一个int16。
+// 得分在每块开始时减去上一列的最高分，使int16不溢出。
+void SimdAligner::Extend(size_t n, const Strand *qs, const Strand *ts) {
+    const int L = (int)kLanes;
+    const int W = band_;
+    const int C = kChunk;
+    int16_t* h = (int16_t*)&H_[0];
+
+    int off[kLanes] = {0};
+    int16_t done[kLanes];
+    for (int l = 0; l < L; ++l) {
+        best_i_[l] = best_j_[l] = 0;
+        done[l] = (size_t)l < n && qs[l].size > 0 && ts[l].size > 0 ? 0 : -1;
+        for (int r = 0; r < W; ++r) {
+            int i = r - W/2;
+            h[r*L+l] = i >= 0 && i <= ((size_t)l < n ? qs[l].size : -1) ? gap_ * i : NEG;
+        }
+        h[W*L+l] = NEG;
+    }
+
+    const __m128i vneg = _mm_set1_epi16(NEG);
+    const __m128i vmis = _mm_set1_epi16(mismatch_);
+    const __m128i vdiff = _mm_set1_epi16(match_ - mismatch_);
+    const __m128i vgap = _mm_set1_epi16(gap_);
+    const __m128i vzdrop = _mm_set1_epi16(zdrop_);
+    const __m128i vone = _mm_set1_epi16(1);
+    const __m128i vbl[4] = { _mm_set1_epi16(1), _mm_set1_epi16(1<<2), _mm_set1_epi16(1<<4), _mm_set1_epi16(1<<6) };
+    const __m128i vbu[4] = { _mm_set1_epi16(2), _mm_set1_epi16(2<<2), _mm_set1_epi16(2<<4), _mm_set1_epi16(2<<6) };
+
+    __m128i active = _mm_xor_si128(_mm_loadu_si128((const __m128i*)done), _mm_set1_epi16(-1));
+    __m128i best = _mm_setzero_si128();
+    int16_t cmax[kLanes], carg[kLanes];
+
+    dirs_.clear();
+    offs_.clear();
+    for (int j = 0; _mm_movemask_epi8(active) != 0; j += C) {
+        if (j > 0) {
+            // 带移到上一列最高分所在的行，并减去最高分
+            int16_t base[kLanes];
+            for (int l = 0; l < L; ++l) {
+                base[l] = 0;
+                if (done[l]) continue;
+                int delta = carg[l] - W/2;
+                if (delta > 0) {
+                    for (int r = 0; r < W; ++r) h[r*L+l] = r + delta < W ? h[(r+delta)*L+l] : NEG;
+                } else if (delta < 0) {
+                    for (int r = W-1; r >= 0; --r) h[r*L+l] = r + delta >= 0 ? h[(r+delta)*L+l] : NEG;
+                }
+                off[l] += delta;
+                base[l] = std::max<int16_t>(cmax[l], 0);
+            }
+            const __m128i vbase = _mm_loadu_si128((const __m128i*)base);
+            for (int r = 0; r < W; ++r) H_[r] = _mm_subs_epi16(H_[r], vbase);
+            best = _mm_subs_epi16(best, vbase);
+        }
+
+        // 第j+c+1列的第r行对应query的第j+off-w/2+c+r个碱基，target的第j+c个碱基
+        int16_t* qc = (int16_t*)&qc_[0];
+        int16_t* qb = (int16_t*)&qb_[0];
+        int16_t* tc = (int16_t*)&tc_[0];
+        for (int l = 0; l < L; ++l) {
+            offs_.push_back(off[l]);
+            int s = j + off[l] - W/2;
+            for (int p = 0; p < C + W; ++p) {
+                bool valid = !done[l] && s + p >= 0 && s + p < qs[l].size;
+                qc[p*L+l] = valid ? qs[l][s+p] : 4;
+                qb[p*L+l] = valid ? 0 : NEG;
+            }
+            for (int c = 0; c < C; ++c) {
+                tc[c*L+l] = !done[l] && j + c < ts[l].size ? ts[l][j+c] : 5;
+            }
+        }
+        dirs_.resize(dirs_.size() + (size_t)C * W / 4 * L);
+
+        for (int c = 0; c < C && _mm_movemask_epi8(active) != 0; ++c) {
+            const __m128i t = tc_[c];
+            __m128i up = vneg;
+            __m128i vmax = vneg;
+            __m128i varg = _mm_setzero_si128();
+            __m128i row = _mm_setzero_si128();
+            uint8_t* d = &dirs_[(size_t)(j + c) * W / 4 * L];
+            for (int r = 0; r < W; r += 8) {
+                __m128i code[2] = { _mm_setzero_si128(), _mm_setzero_si128() };
+                for (int k = 0; k < 8; ++k) {
+                    const __m128i qb = qb_[c+r+k];
+                    const __m128i eq = _mm_cmpeq_epi16(qc_[c+r+k], t);
+                    const __m128i s = _mm_adds_epi16(_mm_add_epi16(vmis, _mm_and_si128(eq, vdiff)), qb);
+                    const __m128i dg = _mm_adds_epi16(H_[r+k], s);
+                    const __m128i lf = _mm_adds_epi16(H_[r+k+1], vgap);
+                    const __m128i m = _mm_max_epi16(dg, lf);
+                    const __m128i u = _mm_adds_epi16(_mm_adds_epi16(up, vgap), qb);
+                    const __m128i v = _mm_max_epi16(m, u);
+                    code[k>>2] = _mm_or_si128(code[k>>2], _mm_or_si128(_mm_and_si128(_mm_cmpgt_epi16(lf, dg), vbl[k&3]),
+                                                                       _mm_and_si128(_mm_cmpgt_epi16(u, m), vbu[k&3])));
+                    H_[r+k] = v;
+                    up = v;
+                    const __m128i gt = _mm_cmpgt_epi16(v, vmax);
+                    vmax = _mm_max_epi16(vmax, v);
+                    varg = _mm_or_si128(_mm_and_si128(gt, row), _mm_andnot_si128(gt, varg));
+                    row = _mm_add_epi16(row, vone);
+                }
+                _mm_storeu_si128((__m128i*)(d + r/4*L), _mm_packus_epi16(code[0], code[1]));
+            }
+
+            // 更新最高分，检查各lane是否结束
+            const int col = j + c + 1;
+            const __m128i improved = _mm_and_si128(_mm_cmpgt_epi16(vmax, best), active);
+            best = _mm_or_si128(_mm_and_si128(improved, vmax), _mm_andnot_si128(improved, best));
+            const int im = _mm_movemask_epi8(improved);
+            const int zd = _mm_movemask_epi8(_mm_and_si128(_mm_cmpgt_epi16(_mm_subs_epi16(best, vmax), vzdrop), active));
+            _mm_storeu_si128((__m128i*)cmax, vmax);
+            _mm_storeu_si128((__m128i*)carg, varg);
+            for (int l = 0; l < L; ++l) {
+                if (done[l]) continue;
+                int lo = col + off[l] - W/2;
+                if (im & (1 << 2*l)) {
+                    best_i_[l] = lo + carg[l];
+                    best_j_[l] = col;
+                }
+                if ((zd & (1 << 2*l)) || col >= ts[l].size || lo + 1 > qs[l].size) {
+                    done[l] = -1;
+                }
+            }
+            active = _mm_xor_si128(_mm_loadu_si128((const __m128i*)done), _mm_set1_epi16(-1));
+        }
+    }
+}
+
+void SimdAligner::Traceback(size_t l, const Strand &q, const Strand &t, std::string &alq, std::string &alt, size_t &distance) const {
+    const int L = (int)kLanes;
+    const int W = band_;
+    int i = best_i_[l];
+    int j = best_j_[l];
+    while (i > 0 || j > 0) {
+        int code = 0;
+        if (j == 0) {
+            code = 2;
+        } else if (i == 0) {
+            code = 1;
+        } else {
+            int lo = j + offs_[(j-1) / kChunk * L + l] - W/2;
+            int r = i - lo;
+            assert(r >= 0 && r < W);
+            code = (dirs_[((size_t)(j-1) * W / 4 + r / 4) * L + l] >> (2 * (r % 4))) & 3;
+        }
+
+        if (code & 2) {
+            alq.push_back("ACGT"[(int)q[i-1]]);
+            alt.push_back('-');
+            distance += 1;
+            i--;
+        } else if (code & 1) {
+            alq.push_back('-');
+            alt.push_back("ACGT"[(int)t[j-1]]);
+            distance += 1;
+            j--;
+        } else {
+            alq.push_back("ACGT"[(int)q[i-1]]);
+            alt.push_back("ACGT"[(int)t[j-1]]);
+            distance += q[i-1] != t[j-1] ? 2 : 0;
+            i--;
+            j--;
+        }
+    }
+}
+
+} // namespace fsa
+
+#endif // __SSE2__
@@ -0,0 +1,66 @@
+#ifndef FSA_CORRECT_SIMD_ALIGNER_HPP
+#define FSA_CORRECT_SIMD_ALIGNER_HPP
+
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "tool_aligner.hpp"
+
+namespace fsa {
+
+#if defined(__SSE2__)
+// 一个target与多条query的带状延伸比对，每条query占一个SIMD lane（int16）。
+// 从种子点分别向左、右延伸，带跟随每列得分最高的行移动，z-drop时停止。
+// 各lane的计算互不影响，单条比对和批量比对的结果相同。
+class SimdAligner : public ToolAligner {
+public:
+    SimdAligner(const std::vector<std::string> &parameters);
+    virtual ~SimdAligner() {}
+
+    virtual bool Align(const char* qseq, size_t qsize, const char* tseq, size_t tsize, std::array<size_t,2> qrange, std::array<size_t, 2> trange, Alignment& al);
+    virtual void Align(const char* tseq, size_t tsize, const std::vector<Query> &queries, std::vector<Alignment> &als, std::vector<bool> &rs);
+    virtual size_t BatchSize() const { return kLanes; }
+    virtual int MismatchCost() const { return 2; }
+
+    static const size_t kLanes = 8;
+    static const int kChunk = 32;       // 每块的列数，块开始时移动带
+
+protected:
+    // 单向的序列，第k个碱基是p[k*step]，向左延伸时step为-1
+    struct Strand {
+        const char* p;
+        int step;
+        int size;
+        char operator[] (int k) const { return p[k*step]; }
+    };
+
+    // 延伸前n个lane，其余lane不参与。结果在best_i_和best_j_，路径在dirs_
+    void Extend(size_t n, const Strand *qs, const Strand *ts);
+    // 从lane l的终点回溯，按延伸方向的逆序追加比对字符串
+    void Traceback(size_t l, const Strand &q, const Strand &t, std::string &alq, std::string &alt, size_t &distance) const;
+
+protected:
+    int match_ { 2 };
+    int mismatch_ { -4 };
+    int gap_ { -3 };
+    int band_ { 64 };          // w 带宽，8的倍数
+    int zdrop_ { 200 };        // z
+
+    std::vector<__m128i> H_;            // 当前列，band_+1行，最后一行为哨兵
+    std::vector<__m128i> qc_;           // 当前块每行的query碱基
+    std::vector<__m128i> qb_;           // 当前块每行的偏置，不在query范围内的行为最小值
+    std::vector<__m128i> tc_;           // 当前块每列的target碱基
+    std::vector<uint8_t> dirs_;         // 每个单元2bit的来源: 0对角线，1左，2和3上
+    std::vector<int> offs_;             // 每块每个lane的带偏移
+    int best_i_[kLanes];
+    int best_j_[kLanes];
+};
+#endif // __SSE2__
+
+} // namespace fsa
+
+#endif  // FSA_CORRECT_SIMD_ALIGNER_HPP
@@ -1,4 +1,7 @@
 #include "tool_aligner.hpp"
+
+#include <cassert>
+
 #include "../../utility.hpp"
 #include "../..//utils/logger.hpp"
 
@@ -6,6 +9,7 @@
 #include "./diff_aligner.hpp"
 #include "./edlib_aligner.hpp"
 #include "./ksw2_aligner.hpp"
+#include "./simd_aligner.hpp"
 
 namespace fsa {
 
@@ -19,6 +23,10 @@ std::shared_ptr<ToolAligner> ToolAligner::Create(const std::string &opts) {
             aligner.reset(new EdlibAligner(ss));
         } else if (ss[0] == "ksw2") {
             aligner.reset(new Ksw2Aligner(ss));
+#if defined(__SSE2__)
+        } else if (ss[0] == "simd") {
+            aligner.reset(new SimdAligner(ss));
+#endif
         } else {
             LOG(ERROR)("Not support parameter: aligner=%s", opts.c_str());
         }
@@ -30,4 +38,13 @@ std::shared_ptr<ToolAligner> ToolAligner::Create(const std::string &opts) {
     return aligner;
 }
 
+void ToolAligner::Align(const char* tseq, size_t tsize, const std::vector<Query> &queries, std::vector<Alignment> &als, std::vector<bool> &rs) {
+    assert(als.size() == queries.size());
+    rs.assign(queries.size(), false);
+    for (size_t i = 0; i < queries.size(); ++i) {
+        const auto &q = queries[i];
+        rs[i] = Align(q.seq, q.size, tseq, tsize, q.qrange, q.trange, als[i]);
+    }
+}
+
 } // namespace fsa {
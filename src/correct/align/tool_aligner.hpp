@@ -3,6 +3,7 @@
 #include <array>
 #include <string>
 #include <memory>
+#include <vector>
 
 #include "alignment.hpp"
 
@@ -13,6 +14,20 @@ public:
     virtual ~ToolAligner() {}
     virtual void SetParameter(const std::string& name, const std::string& value="") {}
     virtual bool Align(const char* qseq, size_t qsize, const char* tseq, size_t tsize, std::array<size_t,2> qrange, std::array<size_t, 2> trange, Alignment& al) = 0;
+    // Alignment::distance中一个错配的计分，插入和缺失计1
+    virtual int MismatchCost() const { return 1; }
+
+    struct Query {
+        const char* seq;
+        size_t size;
+        std::array<size_t, 2> qrange;
+        std::array<size_t, 2> trange;
+    };
+    // 同一个target与一批query比对，结果与逐个调用Align相同。
+    // 缺省实现逐个比对，能同时处理多条序列的实现（如每个SIMD lane一条query）覆盖它。
+    virtual void Align(const char* tseq, size_t tsize, const std::vector<Query> &queries, std::vector<Alignment> &als, std::vector<bool> &rs);
+    // 一次批量比对适合的query数目
+    virtual size_t BatchSize() const { return 1; }
     
     static std::shared_ptr<ToolAligner> Create(const std::string &opts);
 };
@@ -16,6 +16,7 @@
 #include "./align/diff_aligner.hpp"
 #include "./align/edlib_aligner.hpp"
 #include "./align/ksw2_aligner.hpp"
+#include "./align/simd_aligner.hpp"
 
 
 namespace fsa {
@@ -65,6 +66,10 @@ void Aligner::SetAligner(const std::string& opts) {
             worker.reset(new EdlibAligner(ss));
         } else if (ss[0] == "ksw2") {
             worker.reset(new Ksw2Aligner(ss));
+#if defined(__SSE2__)
+        } else if (ss[0] == "simd") {
+            worker.reset(new SimdAligner(ss));
+#endif
         } else {
             LOG(ERROR)("Not support parameter: aligner=%s", opts.c_str());
         }
@@ -198,33 +203,67 @@ void Aligner::AppendAlignedString(const uint32_t * cigar, size_t cigarLen, const
     auto r = worker->Align((const char*)&qseq[0], qseq.size(),
                        (const char*)&tseq[0], tseq.size(), {qs, qe}, {ts, te}, al); 
     if (r) {
-        
-        bool valid = false;
         DEBUG_printf("q:%s\nt:%s\n", query.ToString()->c_str(), target_->ToString()->c_str());
-        DEBUG_printf("alq: %s\nalt: %s\n", al.aligned_query.c_str(), al.aligned_target.c_str());
-        DEBUG_printf("global idents: %f\n", al.Identity());
-        
-        if (al.Identity() >= min_identity_ ) {
-            valid = al.TrimEnds();
-            if (valid && min_local_identity_ > 0 && al.aligned_query.size() >= 1.5*local_window_size_) {
-                auto idents = ComputeIdentity(al.aligned_query,  al.aligned_target, local_window_size_);
-                valid = idents[1] >= min_local_identity_;
-                
-                DEBUG_printf("local idents: %f\n", idents[1]);
-            }
-    
-        }
-        if (!valid) {
-            al.target_start = 0;
-            al.target_end = 0;
-            al.query_start = 0;
-            al.query_end = 0;
-        }
+        Validate(al);
     }
     
     return al.Valid(); 
 }
 
+void Aligner::Align(const std::vector<Query> &queries, std::vector<Alignment> &als, std::vector<bool> &rs) {
+    std::vector<uint8_t>& tseq = target_0123_;
+
+    if (batch_qseqs_.size() < queries.size()) batch_qseqs_.resize(queries.size());
+    batch_queries_.resize(queries.size());
+    als.resize(queries.size());
+
+    for (size_t i = 0; i < queries.size(); ++i) {
+        const auto &q = queries[i];
+        als[i].Reset(target_, q.seq);
+
+        std::vector<uint8_t> &qseq = batch_qseqs_[i];
+        qseq = q.seq->ToUInt8(0, -1, q.rc);
+
+        int ts = q.range[2];
+        int qs = !q.rc ? q.range[0] : qseq.size() - q.range[1];
+        int te = q.range[3];
+        int qe = !q.rc ? q.range[1] : qseq.size() - q.range[0];
+
+        auto new_s = FindExactMatch(tseq, qseq, {ts, qs});
+        batch_queries_[i] = { (const char*)&qseq[0], qseq.size(), {{(size_t)new_s[1], (size_t)qe}}, {{(size_t)new_s[0], (size_t)te}} };
+    }
+
+    worker->Align((const char*)&tseq[0], tseq.size(), batch_queries_, als, rs);
+
+    for (size_t i = 0; i < queries.size(); ++i) {
+        rs[i] = rs[i] && Validate(als[i]);
+    }
+}
+
+bool Aligner::Validate(Alignment &al) const {
+    bool valid = false;
+    DEBUG_printf("alq: %s\nalt: %s\n", al.aligned_query.c_str(), al.aligned_target.c_str());
+    DEBUG_printf("global idents: %f\n", al.Identity());
+    
+    if (al.Identity() >= min_identity_ ) {
+        valid = al.TrimEnds();
+        if (valid && min_local_identity_ > 0 && al.aligned_query.size() >= 1.5*local_window_size_) {
+            auto idents = ComputeIdentity(al.aligned_query,  al.aligned_target, local_window_size_);
+            valid = idents[1] >= min_local_identity_;
+            
+            DEBUG_printf("local idents: %f\n", idents[1]);
+        }
+
+    }
+    if (!valid) {
+        al.target_start = 0;
+        al.target_end = 0;
+        al.query_start = 0;
+        al.query_end = 0;
+    }
+    return al.Valid();
+}
+
 std::array<int, 2> Aligner::FindExactMatch(const std::vector<uint8_t>& tseq, const std::vector<uint8_t>& qseq, const std::array<int , 2> &s) {
     const int k = 4;
     const int w = 100;
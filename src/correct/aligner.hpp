@@ -31,6 +31,18 @@ public:
     void SetTarget(const DnaSeq& tseq, const std::array<size_t, 2> trange);
 
     bool Align(const DnaSeq &qseq, bool rc /* reverse complement */, const std::array<int, 4> &range, Alignment &al);
+
+    struct Query {
+        const DnaSeq* seq;
+        bool rc;
+        std::array<int, 4> range;
+    };
+    // 批量比对，结果与逐个调用Align(qseq, rc, range, al)相同
+    void Align(const std::vector<Query> &queries, std::vector<Alignment> &als, std::vector<bool> &rs);
+    size_t BatchSize() const { return worker->BatchSize(); }
+    // 检查比对的identity，并修剪两端，用于Align和其它来源（如PAF的cigar）的比对结果
+    bool Validate(Alignment &al) const;
+    int MismatchCost() const { return worker->MismatchCost(); }
     std::array<int, 2> FindExactMatch(const std::vector<uint8_t>& tseq, const std::vector<uint8_t>& qseq, const std::array<int , 2> &s);
 
     static void AppendAlignedString(const uint32_t * cigar, size_t cigarLen, const char* query, const char* target, std::string& aligned_query, std::string& aligned_target);
@@ -45,6 +57,8 @@ protected:
     const DnaSeq* target_;
     std::vector<uint8_t> target_0123_;
     std::array<size_t, 2> trange_ {{0, 0}};
+    std::vector<std::vector<uint8_t>> batch_qseqs_;        // buffers of the batch, reused
+    std::vector<ToolAligner::Query> batch_queries_;
     double min_identity_ { 70 };
     double min_local_identity_ { 50 };
     double local_window_size_ { 1000 };
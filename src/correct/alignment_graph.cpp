@@ -7,6 +7,7 @@
 #include <stdint.h>
 #include <fstream>
 #include <unordered_set>
+#include <chrono>
 
 #include <algorithm>
 #include <numeric>
@@ -215,7 +216,9 @@ AlignmentGraph::Segment AlignmentGraph::FindBestPathBasedOnCount() {
 
 }
 
+TimeCounter weight_tc("FindBestPathBasedOnWeight");
 AlignmentGraph::Segment AlignmentGraph::FindBestPathBasedOnWeight() {
+    TimeCounter::Mark mark(weight_tc);
     Segment seg ;
 
     const Node* end = nullptr;
@@ -223,32 +226,30 @@ AlignmentGraph::Segment AlignmentGraph::FindBestPathBasedOnWeight() {
 
     ComputeSimilarity();
 
+    const auto &selected = query_infos_.selected_mask_;
     score_range_ = { 1.0, -1.0};
-    for (size_t i=0; i<query_infos_.scores_.size(); ++i) {
-        if (query_infos_.selected_.count(i) > 0) {
-            auto s = query_infos_.scores_[i].WeightInGraph();
-            score_range_[0] = std::min<double>(s, score_range_[0]);
-            score_range_[1] = std::max<double>(s, score_range_[1]);
-        }
-    }
+    selected.ForEach([this](size_t i) {
+        auto s = query_infos_.scores_[i-1].WeightInGraph();
+        score_range_[0] = std::min<double>(s, score_range_[0]);
+        score_range_[1] = std::max<double>(s, score_range_[1]);
+    });
+
+    query_weights_.assign(MAX_COV, 0.0);
+    selected.ForEach([this](size_t i) {
+        query_weights_[i] = query_infos_.scores_[i-1].WeightInGraph(score_range_, weight_range_);
+    });
+
     // pre-compute
     for (size_t col = 0; col < cols.size(); col++) {
-        cols[col].weight = 0;
-        cols[col].selected = 0;
-        if (cols[col].queries[0]) cols[col].weight += 0.5;
-
-       // if (cols[col].queries[0]) cols[col].weight += 1;
-        for (size_t i=0; i<query_infos_.scores_.size(); ++i) {
-            if (cols[col].queries[i+1] && query_infos_.selected_.count(i) > 0) {
-                cols[col].weight += query_infos_.scores_[i].WeightInGraph(score_range_, weight_range_);
-                cols[col].selected += 1;
-            }
-        }
+        auto queries = cols[col].queries & selected;
+        cols[col].selected = queries.count();
+        cols[col].weight = AccumulateWeights(queries, cols[col].queries[0] ? 0.5 : 0.0);
     }
 
     for (size_t i = 0; i < cols.size(); i++) {
         if (cols[i].selected < 4) continue;
         for (size_t j = 0; j < cols[i].Size(); j++) {
+            const double compensate = WeightCompensation(i, j);   // the same for all links in the row
             for (size_t k = 0; k < cols[i][j].Size(); k++) {
 
                 Node &node = cols[i][j][k];
@@ -258,7 +259,8 @@ AlignmentGraph::Segment AlignmentGraph::FindBestPathBasedOnWeight() {
 
                     Loc prev = link.prev;
 
-                    double score = LinkScoreWeight(i, j, link) + (prev.col == -1 ? 0 : cols[prev.col][prev.row][prev.base].score);
+                    double link_score = AccumulateWeights(link.seqs & selected, 0.0) - compensate;     // LinkScoreWeight
+                    double score = link_score + (prev.col == -1 ? 0 : cols[prev.col][prev.row][prev.base].score);
 
                     if (score > node.score) {
                         node.score = score;
@@ -396,7 +398,7 @@ std::vector<std::string> AlignmentGraph::RestoreSegment(const Segment &seg) {
 
     std::vector<Loc> stack_loc;
     std::vector<size_t> stack_link;
-    std::vector<std::bitset<MAX_COV>> stack_seqs;
+    std::vector<WordBitset<MAX_COV>> stack_seqs;
     const std::vector<std::string> toBase = {"A", "C", "G", "T", ""};
 
     for (size_t i=0; i<5; ++i) {
@@ -696,7 +698,9 @@ AlignmentGraph::Loc AlignmentGraph::Locate(const Node& node) {
     return { -1, 0, 0 };
 }
 
+TimeCounter cns_tc("Consensus");
 void AlignmentGraph::Consensus() {
+    TimeCounter::Mark mark(cns_tc);
     Segment seg = LinkScore == &AlignmentGraph::LinkScoreWeight 
         ? FindBestPathBasedOnWeight()
         : FindBestPathBasedOnCount();
@@ -780,8 +784,14 @@ int AlignmentGraph::Options::BranchThreshold(int cov) {
 }
 
 std::vector<const AlignmentGraph::Link*> AlignmentGraph::CollectLinks(size_t i) {
-    assert(i < cols.size());
     std::vector<const Link*> links;
+    CollectLinks(i, links);
+    return links;
+}
+
+void AlignmentGraph::CollectLinks(size_t i, std::vector<const Link*> &links) {
+    assert(i < cols.size());
+    links.clear();
     if (cols[i].Size() >= 1) {
         for (size_t j = 0; j < cols[i][0].Size(); ++j) {
             for (const auto& l : cols[i][0][j].links) {
@@ -791,7 +801,6 @@ std::vector<const AlignmentGraph::Link*> AlignmentGraph::CollectLinks(size_t i)
             }
         }
     }
-    return links;
 }
 
 
@@ -853,9 +862,11 @@ std::vector<const AlignmentGraph::Link*> AlignmentGraph::CollectLinks2(size_t i)
 
 void AlignmentGraph::ComputeSimilarity() {
     assert(cols.size() > 0 );
+    auto start_time = std::chrono::steady_clock::now();
 
     for (size_t i=range_[0]+1; i<range_[1]-1; ++i) {     // Skip the first and last bases
-        std::vector<const Link*> links = CollectLinks(i);
+        auto &links = links_buffer_;
+        CollectLinks(i, links);
         size_t link_count = std::accumulate(links.begin(), links.end(), 0, [](size_t a, const Link* b) {
             return a + b->count;
         });
@@ -886,27 +897,27 @@ void AlignmentGraph::ComputeSimilarity() {
                 auto tlink = find_link(0);
                 branch_flags_[i] = true;
                 branches_[i] = tlink;
-                for (size_t si = 0; si<query_infos_.scores_.size(); ++si) {
-                    int qid = si;
-                    if (cols[i].queries[qid+1]) {
-                        query_infos_.scores_[si].cross += qw;
-
-                        auto qlink = find_link(qid+1);
-                        
-                        query_infos_.scores_[si].branches[i] = qlink;
-                        if (tlink != nullptr) {
-                            query_infos_.scores_[si].t_in_cross += qw;
-                        }
-                        if (qlink != nullptr) {
-                            query_infos_.scores_[si].q_in_cross += qw;
-                        }
-
-                        if (tlink  != nullptr && qlink != nullptr) {
-                            if (tlink == qlink) query_infos_.scores_[si].q_t_one+= qw;
-                            else                query_infos_.scores_[si].q_t_two+= qw;
-                        }
+                auto queries = cols[i].queries;
+                queries.reset(0);   // the target
+                queries.ForEach([&](size_t b) {
+                    size_t si = b - 1;
+                    query_infos_.scores_[si].cross += qw;
+
+                    auto qlink = find_link(b);
+                    
+                    query_infos_.scores_[si].branches[i] = qlink;
+                    if (tlink != nullptr) {
+                        query_infos_.scores_[si].t_in_cross += qw;
                     }
-                }
+                    if (qlink != nullptr) {
+                        query_infos_.scores_[si].q_in_cross += qw;
+                    }
+
+                    if (tlink  != nullptr && qlink != nullptr) {
+                        if (tlink == qlink) query_infos_.scores_[si].q_t_one+= qw;
+                        else                query_infos_.scores_[si].q_t_two+= qw;
+                    }
+                });
             }
         }
     }
@@ -919,7 +930,7 @@ void AlignmentGraph::ComputeSimilarity() {
     }
 
     query_infos_.SelectReads(min_selected);
-    
+    similarity_time_ += std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
 }
 
 void AlignmentGraph::QueryInfos::SelectReads(int min_sel) {
@@ -947,12 +958,14 @@ void AlignmentGraph::QueryInfos::SelectReads(int min_sel) {
     }
 
     selected_.clear();
+    selected_mask_.reset();
     int ccc = count0;   
     size_t selsize = std::max(std::min<int>(ccc*1.0 + count1, (ccc+count1+count2)*3/2),   std::min(min_sel, ccc*2));
     selsize = std::max<size_t>(min_sel, selsize);
 
     for (size_t i=0; i<score_index.size(); ++i) {
         selected_.insert(score_index[i]);
+        if (score_index[i] + 1 < MAX_COV) selected_mask_.set(score_index[i] + 1);
         if (i >= selsize) break;
     }
 }
@@ -1169,27 +1182,25 @@ double AlignmentGraph::LinkScoreCount(size_t col, size_t row, const Link& link)
 } 
 
 double AlignmentGraph::LinkScoreWeight(size_t col, size_t row, const Link &link) {
-    double s = 0;
-    for (size_t i=0; i<query_infos_.scores_.size(); ++i) {
-        if (link.seqs[i+1] && query_infos_.selected_.find(i) != query_infos_.selected_.end()) {
-            s += query_infos_.scores_[i].WeightInGraph(score_range_, weight_range_);
-        }
-    }
+    double s = AccumulateWeights(link.seqs & query_infos_.selected_mask_, 0.0);
 
     //double compensate = std::pow<double>(reduction_, row) * branch_score_;
     //printf("score: %d %d %zd %f %f %f\n",row, col, cols[col].coverage, compensate, min_coverage_ * branch_score_ / cols[col].coverage, std::max(branch_score_*4/(4+row), 0.3));
     //return s - std::max<double>(compensate*cols[col].weight, min_coverage_ * branch_score_ * cols[col].weight / cols[col].coverage );
 
-    double scale = std::max<double>(std::pow<double>(branch_score_[2], row)*branch_score_[0], branch_score_[1]);
-    double compensate = std::max<double>(scale * cols[col].weight, branch_score_[0] * cols[col].weight * min_coverage_ / cols[col].coverage);
+    return s - WeightCompensation(col, row);
+}
 
-    return s - compensate;
+double AlignmentGraph::WeightCompensation(size_t col, size_t row) const {
+    double scale = std::max<double>(std::pow<double>(branch_score_[2], row)*branch_score_[0], branch_score_[1]);
+    return std::max<double>(scale * cols[col].weight, branch_score_[0] * cols[col].weight * min_coverage_ / cols[col].coverage);
 }
 
 
 bool AlignmentGraph::IsSimpleColumn(size_t col) {
     if (col + 1 < cols.size()) {
-        auto links = CollectLinks(col+1);       // 下个col会收拢前一个的分支，方便统计
+        auto &links = links_buffer_;
+        CollectLinks(col+1, links);       // 下个col会收拢前一个的分支，方便统计
 
         std::sort(links.begin(), links.end(), [](const Link* a, const Link *b) {
             return a->count > b->count || (a->count == b->count && a->prev < b->prev);
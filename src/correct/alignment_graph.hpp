@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cassert>
+#include <cstdint>
 #include <vector>
 #include <list>
 #include <map>
@@ -34,7 +35,7 @@ public:
         const Link* best_link{ nullptr };
 
         std::vector<Link> links;
-        std::bitset<MAX_COV> seqs;
+        WordBitset<MAX_COV> seqs;
     };
 
     struct NodeGroup {
@@ -60,7 +61,7 @@ public:
         uint coverage {0};
         int selected {0};
         double weight {0};
-        std::bitset<MAX_COV> queries;
+        WordBitset<MAX_COV> queries;
 
     };
 
@@ -99,6 +100,7 @@ public:
         double FindScoreThreshold2();
         std::vector<Score> scores_;
         std::unordered_set<int> selected_;
+        WordBitset<MAX_COV> selected_mask_;    // bit i+1 is set if scores_[i] is selected, the layout of Column::queries
     };
 
 
@@ -157,8 +159,11 @@ public:
 
     void ComputeSimilarity();
     void SelectReads();
+    // seconds spent in ComputeSimilarity since the last call, which is part of Consensus
+    double TakeSimilarityTime() { double t = similarity_time_; similarity_time_ = 0; return t; }
 
     std::vector<const Link*> CollectLinks(size_t i);
+    void CollectLinks(size_t i, std::vector<const Link*> &links);
     std::vector<const Link*> CollectLinks1(size_t i);
     std::vector<const Link*> CollectLinks2(size_t i);
 
@@ -172,7 +177,14 @@ protected:
     void AddQuery(size_t qid, size_t query_start, const std::string &aligned_query,  size_t target_start, const std::string &aligned_target);
     double LinkScoreCount(size_t col, size_t row, const Link& link);
     double LinkScoreWeight(size_t col, size_t row, const Link& link);
+    double WeightCompensation(size_t col, size_t row) const;
     bool IsSimpleColumn(size_t col);
+
+    // Adds the weights of the set bits in ascending order, which is the order of looping over the queries.
+    double AccumulateWeights(const WordBitset<MAX_COV> &bits, double init) const {
+        bits.ForEach([this, &init](size_t i) { init += query_weights_[i]; });
+        return init;
+    }
 protected:
     static DnaSerialTable2 Base2Num;
 
@@ -197,6 +209,9 @@ protected:
     const Node* (AlignmentGraph::*FindBestPath)() {nullptr };
 
     QueryInfos query_infos_;
+    std::vector<double> query_weights_;         // WeightInGraph of the selected queries, indexed as Column::queries
+    std::vector<const Link*> links_buffer_;     // reused by CollectLinks
+    double similarity_time_ { 0 };
 };
 
 
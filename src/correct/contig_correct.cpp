@@ -1,6 +1,8 @@
 #include "contig_correct.hpp"
 
 #include <edlib.h>
+#include <condition_variable>
+#include <deque>
 #include <iostream>
 #include "./utils/logger.hpp"
 #include "utility.hpp"
@@ -21,6 +23,7 @@ ArgumentParser ContigCorrect::GetArgumentParser() {
     ap.AddNamedOption(read_name_, "read_name", "Set read name for correcting");
     ap.AddNamedOption(read_name_fname_, "read_name_fname", "Set read name for correcting");
     ap.AddNamedOption(aligner_, "aligner", "method for local alignment, diff|edlib.");
+    ap.AddNamedOption(corrector_, "corrector", "method for consensus, graph|poa. graph: AlignmentGraph built from the pairwise alignments, poa: banded partial order alignment of the reads placed by the overlaps, without pairwise alignment, poa:m=2:x=-4:g=-4:w=10:wr=0.01:mg=16");
     ap.AddNamedOption(score_, "score", "");
     ap.AddNamedOption(coverage_, "coverage", "");
     ap.AddNamedOption(min_length_, "min_length", "");
@@ -30,6 +33,10 @@ ArgumentParser ContigCorrect::GetArgumentParser() {
     ap.AddNamedOption(min_coverage_, "min_coverage", "");
     ap.AddNamedOption(max_overhang_, "max_overhang", "");
     ap.AddNamedOption(max_overhang_rate_, "max_overhang_rate", "");
+    ap.AddNamedOption(max_windows_, "max_windows", "maximum number of windows kept in memory, 0 for no limit. If it is set, the overlaps are spilled into files by contig, and only the overlaps and reads of the contigs in correction are kept in memory");
+    ap.AddNamedOption(checkpoint_interval_, "checkpoint_interval", "number of contigs written between checkpoints, 0 for no checkpoint");
+    ap.AddNamedOption(resume_, "resume", "resume the job from the last checkpoint");
+    ap.AddNamedOption(align_once_, "align_once", "align each read to the whole contig once and share the alignment among windows");
 
     return ap;
 }
@@ -41,16 +48,32 @@ void ContigCorrect::CheckArguments() {
     filter0_opts_ = filter0_.ToString();
     filter1_opts_ = filter1_.ToString();
 
+    auto corrector = Corrector::Create(corrector_);
+    if (align_once_ && corrector != nullptr && corrector->AlignsQueries()) {
+        LOG(WARNING)("The corrector %s aligns the reads itself, ignore --align_once", corrector_.c_str());
+        align_once_ = false;
+    }
 }
 
 void ContigCorrect::Running() {
     read_store_.Load(ctg_fname_, "", true);
     LoadReadIds();
-    read_store_.Load(rread_fname_, "", true);
+    PrepareCheckpoint();
 
-    LoadOverlaps(overlap_fname_);
+    // 从长到短纠错，长contig的窗口多，先处理可以减少最后只剩少数线程工作的时间
+    std::stable_sort(read_ids_.begin(), read_ids_.end(), [this](Seq::Id a, Seq::Id b) {
+        return read_store_.GetSeqLength(a) > read_store_.GetSeqLength(b);
+    });
 
-    ol_store_.GroupTarget(groups_, thread_size_);
+    if (max_windows_ > 0) {
+        // 只建立read的索引，序列随overlap按桶载入
+        read_store_.Load(rread_fname_, "", false);
+        SpillOverlaps(overlap_fname_);
+    } else {
+        read_store_.Load(rread_fname_, "", true);
+        LoadOverlaps(overlap_fname_);
+        ol_store_.GroupTarget(groups_, thread_size_);
+    }
 
     LOG(INFO)("Start Correcting");
     Correct();
@@ -72,6 +95,92 @@ void ContigCorrect::LoadOverlaps(const std::string &fname) {
 }
 
 
+void ContigCorrect::SpillOverlaps(const std::string &fname) {
+    // 按纠错顺序把contig分到桶中，每个桶约有max_windows_个窗口。桶数不超过同时打开的文件数的限制，超出时增大桶。
+    const size_t max_bucket_count = 1000;
+    size_t total = 0;
+    for (auto id : read_ids_) total += read_store_.GetSeqLength(id);
+    const size_t bucket_bases = std::max<size_t>((size_t)max_windows_ * window_size_, (total + max_bucket_count - 1) / max_bucket_count);
+
+    contig_buckets_.assign(read_store_.Size(), -1);
+    size_t bases = 0;
+    for (auto id : read_ids_) {
+        if (id < 0 || id >= (Seq::Id)contig_buckets_.size()) continue;  // 未找到的contig名字
+        if (buckets_.empty() || bases >= bucket_bases) {
+            buckets_.push_back(std::unique_ptr<OverlapBucket>(new OverlapBucket()));
+            bases = 0;
+        }
+        contig_buckets_[id] = buckets_.size() - 1;
+        buckets_.back()->remaining++;
+        bases += read_store_.GetSeqLength(id);
+    }
+
+    for (size_t i = 0; i < buckets_.size(); ++i) {
+        buckets_[i]->file.open(BucketFile(i), std::ios::binary);
+        if (!buckets_[i]->file.is_open()) LOG(ERROR)("Failed to open file: %s", BucketFile(i).c_str());
+    }
+
+    std::atomic<size_t> count { 0 };
+    ol_store_.LoadFast(fname, "", (size_t)thread_size_, [this, &count](Overlap &o) {
+        int b = o.b_.id >= 0 && o.b_.id < (Seq::Id)contig_buckets_.size() ? contig_buckets_[o.b_.id] : -1;
+        if (b >= 0) {
+            auto &bucket = *buckets_[b];
+            std::lock_guard<std::mutex> lock(bucket.mutex);
+            OverlapStore::ToBinary(bucket.file, o);
+            count++;
+        }
+        return false;
+    });
+
+    for (auto &b : buckets_) {
+        b->file.close();
+    }
+    read_users_.assign(read_store_.Size(), 0);
+    LOG(INFO)("Spill %zd overlaps from file %s into %zd buckets", count.load(), fname.c_str(), buckets_.size());
+}
+
+const std::unordered_map<int, std::vector<const Overlap*>>& ContigCorrect::AcquireOverlaps(Seq::Id tid) {
+    if (buckets_.empty() || contig_buckets_[tid] < 0) return groups_[tid];
+
+    auto &bucket = *buckets_[contig_buckets_[tid]];
+    if (bucket.ol_store == nullptr) {
+        const std::string fname = BucketFile(contig_buckets_[tid]);
+        bucket.ol_store.reset(new OverlapStore(read_store_.GetStringPool()));
+        bucket.ol_store->LoadBinary(fname);
+        std::remove(fname.c_str());
+
+        for (size_t i = 0; i < bucket.ol_store->Size(); ++i) {
+            const Overlap &o = bucket.ol_store->Get(i);
+            bucket.groups[o.b_.id][o.a_.id].push_back(&o);
+            if (read_users_[o.a_.id]++ == 0) bucket.reads.push_back(o.a_.id);
+        }
+        std::sort(bucket.reads.begin(), bucket.reads.end());
+        read_store_.LoadItems(bucket.reads);
+        LOG(INFO)("Load bucket %d: %zd contigs, %zd overlaps, %zd reads", contig_buckets_[tid], bucket.remaining, bucket.ol_store->Size(), bucket.reads.size());
+    }
+    return bucket.groups[tid];
+}
+
+void ContigCorrect::ReleaseOverlaps(Seq::Id tid) {
+    if (buckets_.empty() || contig_buckets_[tid] < 0) {
+        groups_[tid].clear();
+        return;
+    }
+
+    auto &bucket = *buckets_[contig_buckets_[tid]];
+    bucket.groups.erase(tid);
+    if (--bucket.remaining == 0) {
+        // 其它已载入的桶仍在使用的read不释放
+        std::vector<Seq::Id> unused;
+        for (auto id : bucket.reads) {
+            if (--read_users_[id] == 0) unused.push_back(id);
+        }
+        read_store_.ReleaseItems(unused);
+        bucket.groups.clear();
+        bucket.ol_store.reset();
+        std::vector<Seq::Id>().swap(bucket.reads);
+    }
+}
 
 void ContigCorrect::LoadReadIds() {
     if (!read_name_.empty()) {
@@ -91,55 +200,111 @@ void ContigCorrect::LoadReadIds() {
     }
 }
 
+void ContigCorrect::PrepareCheckpoint() {
+    if (checkpoint_interval_ <= 0 && !resume_) return;
+
+    // 窗口的结果只在整条contig完成后写出，所以按contig记录进度
+    checkpoint_.reset(new Checkpoint(cread_fname_ + ".ckpt", read_store_.Size()));
+    if (resume_ && checkpoint_->Load()) {
+        checkpoint_->Restore({cread_fname_});
+        size_t size = read_ids_.size();
+        read_ids_.erase(std::remove_if(read_ids_.begin(), read_ids_.end(), [this](Seq::Id id) {
+            return checkpoint_->Test(id);
+        }), read_ids_.end());
+        append_output_ = true;
+        LOG(INFO)("Resume from checkpoint: %zd/%zd contigs done", size - read_ids_.size(), size);
+    } else {
+        checkpoint_->Remove();
+    }
+}
 
 void ContigCorrect::Correct() {
     std::mutex mutex;
-    std::ofstream of_cread(cread_fname_);
+    std::condition_variable cond;
+    // ate: tellp() returns the size of the file for the checkpoint
+    std::ofstream of_cread(cread_fname_, append_output_ ? std::ios::app | std::ios::ate : std::ios::out);
+
+    const std::vector<Seq::Id> &ids = read_ids_;
+
+    // ContigJob只在它的窗口即将被处理时创建，写出后释放。active按分发顺序保存尚未写出的contig，
+    // inflight是它们的窗口总数。设置max_windows_后，只有最早的contig不受inflight的限制，保证能继续执行。
+    std::deque<std::shared_ptr<ContigJob>> active;
+    size_t next_contig = 0;
+    size_t next_window = 0;     // index of the next window in active.back()
+    size_t inflight = 0;
+    size_t written = 0;
+
+    auto get_window = [&](std::shared_ptr<ContigJob> &contig) -> std::shared_ptr<WindowJob> {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            bool limited = max_windows_ > 0 && inflight >= (size_t)max_windows_;
+            if (!active.empty() && next_window < active.back()->windows.size()) {
+                if (!limited || active.size() == 1) {
+                    contig = active.back();
+                    inflight++;
+                    return contig->windows[next_window++];
+                }
+            } else if (next_contig < ids.size()) {
+                if (!limited || active.empty()) {
+                    auto id = ids[next_contig++];
+                    std::shared_ptr<ContigJob> job(new ContigJob(id, read_store_.GetSeqLength(id), AcquireOverlaps(id), window_size_, overlap_size_));
+                    if (job->windows.empty()) {
+                        ReleaseOverlaps(id);
+                        continue;
+                    }
+                    if (align_once_) job->PrepareAlignments();
+                    active.push_back(job);
+                    next_window = 0;
+                    continue;
+                }
+            } else {
+                return nullptr;
+            }
+            cond.wait(lock);
+        }
+    };
+
+    auto save_contig = [&](const std::shared_ptr<ContigJob> &contig) {
+        const std::string &name = read_store_.QueryNameById(contig->tid);
+        std::string seq = contig->GetSeq();
 
-   auto save_contig = [&](const std::string& name, const std::string &seq) {
         std::lock_guard<std::mutex> lock(mutex);
         of_cread << ">" << name << "\n" << seq << "\n";
-    };
-
-    std::vector<std::shared_ptr<WindowJob>> windows;
-    std::vector<std::shared_ptr<ContigJob>> jobs;
-    for (auto i : read_ids_) {        
-        jobs.push_back(std::shared_ptr<ContigJob>(new ContigJob(i, read_store_.GetSeqLength(i), groups_[i], window_size_, overlap_size_)));
-        for (auto &s : jobs.back()->windows) {
-            windows.push_back(s);
+        LOG(INFO)("Write contig: %s, contigs done: %zd/%zd", name.c_str(), ++written, ids.size());
+        if (checkpoint_ != nullptr) {
+            checkpoint_->Set(contig->tid);
+            if (checkpoint_interval_ > 0 && written % checkpoint_interval_ == 0) checkpoint_->Save({&of_cread});
         }
-    }
 
-    std::atomic<size_t> index {0};
+        inflight -= contig->windows.size();
+        active.erase(std::find(active.begin(), active.end(), contig));
+        ReleaseOverlaps(contig->tid);
+        cond.notify_all();
+    };
 
     auto work_func = [&](size_t i) {
         Worker worker(*this);
 
-        auto curr = index.fetch_add(1);
-        while (curr < windows.size()) {
-            //if (curr != 0) { curr = index.fetch_add(1);continue; }
-            auto& wjob = *windows[curr];
-            worker.Correct(wjob);
-            worker.Clear();
-            //if (true || wjob.owner->IsDone()) {
-            if ( wjob.owner->Savable()) {
-                LOG(INFO)("Write contig: %s", read_store_.QueryNameById(wjob.owner->tid).c_str());
-                save_contig(read_store_.QueryNameById(wjob.owner->tid), wjob.owner->GetSeq());
-                //save_contig(read_store_.QueryNameById(wjob.owner->tid), wjob.seq);
-                LOG(INFO)("Write contig: %s", read_store_.QueryNameById(wjob.owner->tid).c_str());
-                //break;
+        std::shared_ptr<ContigJob> contig;
+        for (auto wjob = get_window(contig); wjob != nullptr; wjob = get_window(contig)) {
+            if (align_once_) {
+                worker.CorrectWithContigAlignments(*wjob);
+            } else {
+                worker.Correct(*wjob);
             }
-            if (curr % 100 == 0) {
-                LOG(INFO)("Jobs done: %d/%d", curr, windows.size());
+            worker.Clear();
+            if (contig->Savable()) {
+                save_contig(contig);
             }
-            curr = index.fetch_add(1);
         }
     };
 
  
-    LOG(INFO)("thread size %zd, jobsize %d", thread_size_, windows.size());
+    LOG(INFO)("thread size %zd, contig size %zd, max windows %d", thread_size_, ids.size(), max_windows_);
     if (of_cread.is_open()) {
         MultiThreadRun((size_t)thread_size_, work_func);
+        // 全部完成，不再需要checkpoint
+        if (checkpoint_ != nullptr) checkpoint_->Remove();
     } else {
         LOG(INFO)("Failed to open file: %s", rread_fname_.c_str());
     }
@@ -170,10 +335,24 @@ bool ContigCorrect::Worker::ExactFilter(const Alignment &r) {
 bool ContigCorrect::Worker::GetAlignment(Seq::Id id, const Overlap* o, Alignment& al) {
     const auto& tread = o->GetRead(id);
     const auto& qread = o->GetOtherRead(id);
-
-    std::array<int, 4> range = {qread.start, qread.end, tread.start, tread.end};
-    return aligner_.Align(owner_.read_store_.GetSeq(qread.id), !o->SameDirect(), range, al);  // TODO target 由调用者设置，可能存在不一致，需要优化。
-
+    const DnaSeq& contig = owner_.read_store_.GetSeq(id);
+
+    // target只取read可能比对到的contig区间：overlap区间两端各延伸read未比对部分的长度，并留出插入缺失的余量
+    int ext = std::max(qread.start, qread.len - qread.end);
+    ext += ext / 4 + 100;
+    int tstart = std::max(0, tread.start - ext);
+    int tend = std::min((int)contig.Size(), tread.end + ext);
+    const DnaSeq target(contig, tstart, tend - tstart);
+    aligner_.SetTarget(target, {0, target.Size()});
+
+    std::array<int, 4> range = {qread.start, qread.end, tread.start - tstart, tread.end - tstart};
+    if (!aligner_.Align(owner_.read_store_.GetSeq(qread.id), !o->SameDirect(), range, al)) return false;
+
+    // 换回整条contig的坐标
+    al.target = &contig;
+    al.target_start += tstart;
+    al.target_end += tstart;
+    return true;
 }
       
  std::array<size_t,2> MostEffectiveCoverage(size_t tsize, const std::vector<Alignment> &aligns, size_t stub, int min_coverage) {
@@ -229,6 +408,7 @@ bool ContigCorrect::Worker::Correct(WindowJob &job) {
     std::vector<const Overlap*> cands = job.GetOverlaps();
     if (cands.size() == 0) {    // if the area is not coveraged by any reads.
         job.seq = *DnaSeq(owner_.read_store_.GetSeq(id), job.start, job.end-job.start).ToString();
+        job.done = true;
         return true;
     }
 
@@ -250,8 +430,36 @@ bool ContigCorrect::Worker::Correct(WindowJob &job) {
     });
     
     size_t heap_size = cands.size();
-    aligner_.SetTarget(target);
     std::vector<int> coverage(target.Size(), 0);
+    std::array<size_t, 2> range = {(size_t)(job.start - ctgstart), (size_t)(job.end - ctgstart)};
+
+    if (graph_->AlignsQueries()) {
+        // 由Corrector比对未比对的read，按overlap的坐标估计覆盖度
+        std::vector<Corrector::Fragment> fragments;
+        while (heap_size > 0) {
+            auto o = cands[0];
+            const auto& tread = o->GetRead(id);
+            const auto& qread = o->GetOtherRead(id);
+            fragments.push_back({qread.id, &owner_.read_store_.GetSeq(qread.id), !o->SameDirect(), {{qread.start, qread.end, tread.start-ctgstart, tread.end-ctgstart}}});
+
+            std::for_each(coverage.begin()+fragments.back().range[2], coverage.begin()+fragments.back().range[3], [](int& c) {c++;} );
+            if (IsCoverageEnough(coverage) || (int)fragments.size() >= owner_.max_number_) {
+                break;
+            }
+            std::pop_heap(cands.begin(), cands.begin()+heap_size, [](const Overlap* a, const Overlap* b) {
+                return a->attached < b->attached;    // CAUTION
+            });
+            heap_size--;
+        }
+
+        graph_->Build(target, range, fragments);
+        graph_->Consensus();
+        job.seq = graph_->GetSequence();
+        job.done = true;
+        return true;
+    }
+
+    aligner_.SetTarget(target);
     Alignment al;
     while (heap_size > 0) {
         auto o = cands[0];
@@ -281,17 +489,91 @@ bool ContigCorrect::Worker::Correct(WindowJob &job) {
 
     // auto range = MostEffectiveCoverage(target.Size(), aligned_, 500, owner_.min_coverage_);
 
-    std::array<size_t, 2> range = {(size_t)(job.start - ctgstart), (size_t)(job.end - ctgstart)};
-   
-    graph_.Build(target, range, aligned_);
-    graph_.Consensus();
-    job.seq = graph_.GetSequence();
+    graph_->Build(target, range, aligned_);
+    graph_->Consensus();
+    job.seq = graph_->GetSequence();
 
     job.done = true;
 
     return true;
 }
 
+bool ContigCorrect::Worker::CorrectWithContigAlignments(WindowJob &job) {
+    auto id = job.GetTId();
+    auto &contig = *job.owner;
+
+    std::vector<const Overlap*> cands = job.GetOverlaps();
+    if (cands.size() == 0) {    // if the area is not coveraged by any reads.
+        job.seq = *DnaSeq(owner_.read_store_.GetSeq(id), job.start, job.end-job.start).ToString();
+        job.done = true;
+        return true;
+    }
+
+    // 比对结果已是整条contig的坐标，target只需覆盖窗口
+    const DnaSeq target(owner_.read_store_.GetSeq(id), job.start, job.end - job.start);
+    
+    CalculateWeight(id, target, cands, job.start, {job.start, job.end});
+
+    std::make_heap(cands.begin(), cands.end(), [](const Overlap* a, const Overlap* b) {
+       return a->attached < b->attached;    // CAUTION
+    });
+    
+    size_t heap_size = cands.size();
+    std::vector<int> coverage(target.Size(), 0);
+    Alignment al;
+    while (heap_size > 0) {
+        const auto& ra = GetReadAlignment(contig, cands[0]);
+        // 过滤条件与逐窗口比对一致，以窗口而非整条contig计算target的overhang
+        if (ra.valid && ra.al.Slice(job.start, job.end, &target, al, aligner_.MismatchCost()) && !ExactFilter(al)) {
+            aligned_.push_back(al);
+
+            std::for_each(coverage.begin()+al.target_start, coverage.begin()+al.target_end, [](int& c) {c++;} );
+            if (IsCoverageEnough(coverage) || (int)aligned_.size() >= owner_.max_number_) {
+                break;
+            }
+        }
+        
+        std::pop_heap(cands.begin(), cands.begin()+heap_size, [](const Overlap* a, const Overlap* b) {
+            return a->attached < b->attached;    // CAUTION
+        });
+        heap_size--;
+    }
+    ReleaseReadAlignments(contig, cands);
+
+    graph_->Build(target, {0, target.Size()}, aligned_);
+    graph_->Consensus();
+    job.seq = graph_->GetSequence();
+
+    job.done = true;
+
+    return true;
+}
+
+const ContigCorrect::ReadAlignment& ContigCorrect::Worker::GetReadAlignment(ContigJob &contig, const Overlap* o) {
+    auto it = contig.alignments.find(o);
+    assert(it != contig.alignments.end());
+
+    ReadAlignment &ra = *it->second;
+    std::call_once(ra.flag, [this, &contig, &ra, o]() {
+        ra.valid = GetAlignment(contig.tid, o, ra.al);
+        if (ra.valid) {
+            ra.al.Rearrange();
+        } else {
+            ra.al = Alignment();
+        }
+    });
+    return ra;
+}
+
+void ContigCorrect::Worker::ReleaseReadAlignments(ContigJob &contig, const std::vector<const Overlap*> &cands) {
+    for (auto o : cands) {
+        auto &ra = *contig.alignments.find(o)->second;
+        if (ra.users.fetch_sub(1) == 1) {
+            ra.al = Alignment();
+        }
+    }
+}
+
 void ContigCorrect::Worker::CalculateWeight(Seq::Id id,  const DnaSeq& target, const std::vector<const Overlap*> & cands, int offset, const std::array<int,2> &range) {
     std::vector<double> cand_cov_wts (target.Size()+1);
 
@@ -357,6 +639,16 @@ ContigCorrect::ContigJob::ContigJob(Seq::Id id, size_t len, const std::unordered
     }
 } 
 
+void ContigCorrect::ContigJob::PrepareAlignments() {
+    for (const auto &w : windows) {
+        for (auto o : w->GetOverlaps()) {
+            auto &ra = alignments[o];
+            if (ra == nullptr) ra.reset(new ReadAlignment());
+            ra->users++;
+        }
+    }
+}
+
 std::string ContigCorrect::ContigJob::GetSeq() const {
     assert(windows.size() > 0);
 
@@ -367,6 +659,11 @@ std::string ContigCorrect::ContigJob::GetSeq() const {
 
         const std::string& next = windows[i]->seq; // alias
         printf("next %zd %d %d\n", next.size(), windows[i]->start, windows[i]->end);
+        if (next.size() < ovl_size || seq.size() < ovl_size) {
+            LOG(WARNING)("Window %d is shorter than the overlap of windows", i);
+            seq.insert(seq.end(), next.begin() + std::min(ovl_size, next.size()), next.end());
+            continue;
+        }
 
         EdlibAlignResult r = edlibAlign(next.c_str(), ovl_size, seq.c_str()+seq.size()-ovl_size, ovl_size, 
             edlibNewAlignConfig(-1, EDLIB_MODE_HW, EDLIB_TASK_PATH, NULL, 0));
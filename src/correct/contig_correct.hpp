@@ -5,11 +5,15 @@
 #include <vector>
 #include <mutex>
 #include <atomic>
+#include <memory>
+#include <fstream>
+#include <unordered_map>
 
 #include "overlap_store.hpp"
 #include "read_store.hpp"
 #include "alignment_graph.hpp"
 #include "utils/program.hpp"
+#include "utils/checkpoint.hpp"
 
 namespace fsa {
 using ArrayGraph = AlignmentGraph;
@@ -24,10 +28,35 @@ protected:
 
     void LoadOverlaps(const std::string &fname);
     void LoadReadIds();
+    void PrepareCheckpoint();
     void Correct();
+
+    // 设置max_windows_后，overlap按contig分到若干个桶，写入临时文件。桶在它的第一条contig开始纠错时载入，
+    // 连同它用到的read的序列，它的contig都写出后释放，内存中只有正在纠错的contig的overlap。
+    // 桶中的contig在纠错顺序中是连续的。AcquireOverlaps和ReleaseOverlaps在调度的锁内调用。
+    struct OverlapBucket {
+        std::unique_ptr<OverlapStore> ol_store;
+        std::unordered_map<Seq::Id, std::unordered_map<Seq::Id, std::vector<const Overlap*>>> groups;
+        std::vector<Seq::Id> reads;     // query reads of the overlaps
+        size_t remaining { 0 };         // contigs not written yet
+        std::mutex mutex;               // for spilling
+        std::ofstream file;
+    };
+    void SpillOverlaps(const std::string &fname);
+    const std::unordered_map<Seq::Id, std::vector<const Overlap*>>& AcquireOverlaps(Seq::Id tid);
+    void ReleaseOverlaps(Seq::Id tid);
+    std::string BucketFile(size_t i) { return OutputPath("ctg_correct_bucket_" + std::to_string(i) + ".bin"); }
     
     std::string OutputPath(const std::string &fname) { return output_directory_+"/"+fname; }
 
+    // 读数与整条contig的比对结果，由覆盖它的窗口共享，只计算一次
+    struct ReadAlignment {
+        std::once_flag flag;
+        bool valid { false };
+        Alignment al;
+        std::atomic<int> users { 0 };   // 尚未使用该结果的窗口数，为0时释放
+    };
+
     struct ContigJob;
     struct WindowJob {
         WindowJob(ContigJob *w, int s, int e) : owner(w), start(s), end(e) {}
@@ -70,6 +99,9 @@ protected:
             return IsDone() && !saved.exchange(true);
         }
 
+        // 为每个窗口用到的overlap建立比对结果的槽位，在启动线程前调用
+        void PrepareAlignments();
+
 
         Seq::Id tid;    // target id
         size_t tlen;
@@ -78,29 +110,33 @@ protected:
         size_t win_size;
         size_t ovl_size;
         std::atomic<bool> saved { false };
+        std::unordered_map<const Overlap*, std::unique_ptr<ReadAlignment>> alignments;
     };
 
 
     class Worker {
     public:
-        Worker(ContigCorrect& owner) : owner_(owner) {
-            graph_.SetParameter("score", owner.score_);
-            graph_.SetParameter("min_coverage", owner.min_coverage_);
+        Worker(ContigCorrect& owner) : owner_(owner), graph_(Corrector::Create(owner.corrector_)) {
+            graph_->SetParameter("score", owner.score_);
+            graph_->SetParameter("min_coverage", owner.min_coverage_);
             aligner_.SetParameter("min_identity", owner.min_identity_);  
             aligner_.SetParameter("min_local_identity", owner.min_local_identity_);
             aligner_.SetParameter("aligner", owner_.aligner_);
         };
         ~Worker() {  }
         bool Correct(WindowJob &job);
+        bool CorrectWithContigAlignments(WindowJob &job);
+        const ReadAlignment& GetReadAlignment(ContigJob &contig, const Overlap* o);
+        void ReleaseReadAlignments(ContigJob &contig, const std::vector<const Overlap*> &cands);
         void CalculateWeight(Seq::Id tid,  const DnaSeq& target, const std::vector<const Overlap*> & cands, int offset, const std::array<int,2>& range);
         bool IsCoverageEnough(const std::vector<int> &cov);
         bool ExactFilter(const Alignment& r);
         bool GetAlignment(Seq::Id id, const Overlap* o, Alignment &al);
-        void Clear() {graph_.Clear(); aligned_.clear(); corrected.clear(), scores_.clear(); }
-        const std::string GetCorrected() const { return graph_.GetSequence(); }
+        void Clear() {graph_->Clear(); aligned_.clear(); corrected.clear(), scores_.clear(); }
+        const std::string GetCorrected() const { return graph_->GetSequence(); }
     protected:
         ContigCorrect& owner_;
-        ArrayGraph graph_;
+        std::unique_ptr<Corrector> graph_;
         Aligner aligner_;
         std::vector<Alignment> aligned_;
         std::string corrected;
@@ -133,12 +169,19 @@ protected:
     double branch_score_ { 0.3 };
     int window_size_ { 50000 };
     int overlap_size_ { 500 };
+    int max_windows_ { 64 };       // 0 for no limit
+    bool align_once_ { false };     // align each read to the whole contig once and slice it into windows
+    bool resume_ { false };
+    int checkpoint_interval_ { 0 };     // contigs
+    bool append_output_ { false };
+    std::unique_ptr<Checkpoint> checkpoint_;
 
     std::string read_name_ {""};
     std::string read_name_fname_ { "" };
     int thread_size_{ 4 };
 
     std::string aligner_ { "diff" };
+    std::string corrector_ { "graph" };
     std::string score_ { "count" };
     std::string output_directory_ {"."};
 
@@ -154,6 +197,10 @@ protected:
     ReadStore read_store_;
     OverlapStore ol_store_{read_store_.GetStringPool() };
     std::unordered_map<int, std::unordered_map<int, std::vector<const Overlap*>>> groups_;
+
+    std::vector<int> contig_buckets_;   // 按contig id索引，-1表示不在任何桶中
+    std::vector<std::unique_ptr<OverlapBucket>> buckets_;
+    std::vector<uint32_t> read_users_;  // 按read id索引，使用该read的已载入的桶数
 };
 
 } // namespace fsa {
@@ -1 +1,22 @@
 #include "corrector.hpp"
+
+#include "alignment_graph.hpp"
+#include "poa_graph.hpp"
+#include "./utils/logger.hpp"
+#include "../utility.hpp"
+
+namespace fsa {
+
+std::unique_ptr<Corrector> Corrector::Create(const std::string &opts) {
+    auto ss = SplitStringByChar(opts, ':');
+    if (ss.size() == 1 && ss[0] == "graph") {
+        return std::unique_ptr<Corrector>(new AlignmentGraph());
+    } else if (ss.size() >= 1 && ss[0] == "poa") {
+        return std::unique_ptr<Corrector>(new PoaGraph(ss));
+    } else {
+        LOG(ERROR)("Not support parameter: corrector=%s", opts.c_str());
+        return nullptr;
+    }
+}
+
+} // namespace fsa {
@@ -1,11 +1,13 @@
 #pragma once
 
 
-#include <bitset>
 #include <fstream>
 #include <array>
 #include <vector>
+#include <memory>
+#include <cassert>
 #include "align/alignment.hpp"
+#include "../utils/word_bitset.hpp"
 
 
 namespace fsa {
@@ -55,7 +57,7 @@ public:
         
         Loc prev {-1, -1, -1};
         size_t count {0};
-        std::bitset<MAX_COV> seqs;
+        WordBitset<MAX_COV> seqs;
         //double w;       // weight
     };
 
@@ -74,17 +76,34 @@ public:
         int id; // seq id
     };
 
-    
+    // 未比对的query，range与Aligner::Align相同: query的[range[0], range[1])大致对应target的[range[2], range[3])，
+    // 来自overlap的坐标，query的坐标在正向链上，rc表示取反向互补
+    struct Fragment {
+        int qid;
+        const DnaSeq *query;
+        bool rc;
+        std::array<int, 4> range;
+    };
+
+    // opts: graph|poa[:...]
+    static std::unique_ptr<Corrector> Create(const std::string &opts);
+    virtual ~Corrector() {}
+
     virtual void SetParameter(const std::string &name, const std::string &v) = 0;
     virtual void SetParameter(const std::string &name, int v) = 0;
     virtual void SetParameter(const std::string &name, double v) = 0;
 
     virtual void Build(const DnaSeq& target, const std::array<size_t,2> &range, const std::vector<Alignment> &aligned) = 0;
+    // 为true时使用Build(target, range, fragments)，由Corrector自己把query比对到target上，调用者不需要做两两比对
+    virtual bool AlignsQueries() const { return false; }
+    virtual void Build(const DnaSeq& target, const std::array<size_t,2> &range, const std::vector<Fragment> &fragments) { assert(!"Not support"); }
     virtual void Clear() = 0;
     virtual void Consensus() = 0;
     virtual const std::string& GetSequence() const = 0;
     virtual const std::string& GetQuality() const = 0;
     virtual void SaveReadInfos(std::ostream &os, int tid, const class ReadStore& rs) const = 0;
+    // seconds spent in computing the similarity of the queries since the last call
+    virtual double TakeSimilarityTime() { return 0; }
 
  
 };
@@ -0,0 +1,493 @@
+#include "poa_graph.hpp"
+
+#include <cassert>
+#include <climits>
+#include <cstdint>
+#include <algorithm>
+#include <ostream>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__SSE4_1__)
+#include <smmintrin.h>
+#endif
+
+#include "./utils/logger.hpp"
+#include "../read_store.hpp"
+#include "../utility.hpp"
+
+namespace fsa {
+
+static const DnaSerialTable2 Base2Num;
+
+#if defined(__SSE2__)
+static inline __m128i Max32(__m128i a, __m128i b) {
+#if defined(__SSE4_1__)
+    return _mm_max_epi32(a, b);
+#else
+    __m128i gt = _mm_cmpgt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(gt, a), _mm_andnot_si128(gt, b));
+#endif
+}
+#endif
+
+// h[k] = max(h[k], p[k] + f[k], p[k+1] + gap), k in [0, n)
+void PoaGraph::UpdateFromPrev(int *h, const int *p, const int *f, int n, int gap) {
+    int k = 0;
+#if defined(__SSE2__)
+    // h按16字节对齐写入，与ScanInsertions的读取对齐，避免读取时不能直接从未写回的数据中转发
+    for (; k < n && ((uintptr_t)(h + k) & 15) != 0; ++k) {
+        h[k] = std::max(h[k], std::max(p[k] + f[k], p[k+1] + gap));
+    }
+    const __m128i vgap = _mm_set1_epi32(gap);
+    for (; k + 4 <= n; k += 4) {
+        __m128i vp0 = _mm_loadu_si128((const __m128i*)(p + k));
+        __m128i vp1 = _mm_loadu_si128((const __m128i*)(p + k + 1));
+        __m128i vf = _mm_loadu_si128((const __m128i*)(f + k));
+        __m128i vh = _mm_load_si128((const __m128i*)(h + k));
+        vh = Max32(vh, Max32(_mm_add_epi32(vp0, vf), _mm_add_epi32(vp1, vgap)));
+        _mm_store_si128((__m128i*)(h + k), vh);
+    }
+#endif
+    for (; k < n; ++k) {
+        h[k] = std::max(h[k], std::max(p[k] + f[k], p[k+1] + gap));
+    }
+}
+
+// h[k] = max(h[k], h[k-1] + gap)，返回得分最高的第一个位置。
+// 4个位置一组做前缀扫描: 组内移位两次，再加上前一组最后一个位置的得分c。c由标量递推，
+// 组之间只有标量的依赖: c' = max(组内扫描后的最后一个位置, c + 4*gap)
+int PoaGraph::ScanInsertions(int *h, int n, int gap) {
+    int k = 1;
+#if defined(__SSE2__)
+    k = 0;      // h是16字节对齐的，h[0]之前没有位置
+    const int NEG = INT_MIN / 2;
+    const __m128i vgap1 = _mm_set1_epi32(gap);
+    const __m128i vgap2 = _mm_set1_epi32(2*gap);
+    const __m128i vcarry = _mm_setr_epi32(gap, 2*gap, 3*gap, 4*gap);
+    const __m128i fill1 = _mm_setr_epi32(NEG, 0, 0, 0);
+    const __m128i fill2 = _mm_setr_epi32(NEG, NEG, 0, 0);
+    __m128i vmax = _mm_set1_epi32(NEG);
+    int c = NEG;
+    for (; k + 4 <= n; k += 4) {
+        __m128i v = _mm_load_si128((const __m128i*)(h + k));
+        v = Max32(v, _mm_add_epi32(_mm_or_si128(_mm_slli_si128(v, 4), fill1), vgap1));
+        v = Max32(v, _mm_add_epi32(_mm_or_si128(_mm_slli_si128(v, 8), fill2), vgap2));
+        const int last = _mm_cvtsi128_si32(_mm_shuffle_epi32(v, _MM_SHUFFLE(3, 3, 3, 3)));
+        v = Max32(v, _mm_add_epi32(_mm_set1_epi32(c), vcarry));
+        _mm_store_si128((__m128i*)(h + k), v);
+        c = std::max(last, c + 4*gap);
+        vmax = Max32(vmax, v);
+    }
+    vmax = Max32(vmax, _mm_shuffle_epi32(vmax, _MM_SHUFFLE(1, 0, 3, 2)));
+    vmax = Max32(vmax, _mm_shuffle_epi32(vmax, _MM_SHUFFLE(2, 3, 0, 1)));
+    int best_score = _mm_cvtsi128_si32(vmax);
+    if (k == 0) {
+        best_score = h[0];
+        k = 1;
+    }
+#else
+    int best_score = h[0];
+#endif
+    for (; k < n; ++k) {
+        h[k] = std::max(h[k], h[k-1] + gap);
+        best_score = std::max(best_score, h[k]);
+    }
+    int best = 0;
+    while (h[best] != best_score) best++;
+    return best;
+}
+
+PoaGraph::PoaGraph(const std::vector<std::string> &opts) {
+    // poa:m=2:x=-4:g=-4:w=10:wr=0.01
+    for (size_t i=1; i<opts.size(); ++i) {
+        auto kv = SplitStringByChar(opts[i], '=');
+        if (kv.size() != 2) {
+            LOG(ERROR)("Not support parameter: corrector=poa:..:%s:..", opts[i].c_str());
+        } else if (kv[0] == "m") {
+            match_ = std::stoi(kv[1]);
+        } else if (kv[0] == "x") {
+            mismatch_ = std::stoi(kv[1]);
+        } else if (kv[0] == "g") {
+            gap_ = std::stoi(kv[1]);
+        } else if (kv[0] == "w") {
+            band_ = std::stoi(kv[1]);
+        } else if (kv[0] == "wr") {
+            band_rate_ = std::stod(kv[1]);
+        } else if (kv[0] == "mg") {
+            margin_ = std::stoi(kv[1]);
+        } else {
+            LOG(ERROR)("Not support parameter: corrector=poa:..:%s:..", opts[i].c_str());
+        }
+    }
+}
+
+void PoaGraph::SetParameter(const std::string &name, const std::string &v) {
+    if (name == "score") {
+        // 只用于AlignmentGraph
+    } else {
+        LOG(ERROR)("Not support parameter: %s", name.c_str());
+    }
+}
+
+void PoaGraph::SetParameter(const std::string &name, int v) {
+    if (name == "min_coverage") {
+        min_coverage_ = v;
+    } else {
+        LOG(ERROR)("Not support parameter: %s", name.c_str());
+    }
+}
+
+void PoaGraph::SetParameter(const std::string &name, double v) {
+    LOG(ERROR)("Not support parameter: %s", name.c_str());
+}
+
+void PoaGraph::Clear() {
+    nodes_.clear();
+    order_.clear();
+    rank_.clear();
+    backbone_.clear();
+    infos_.clear();
+    sequence_.clear();
+    quality_.clear();
+}
+
+bool PoaGraph::InitBackbone(const DnaSeq& target, const std::array<size_t,2> &range) {
+    Clear();
+    range_ = range;
+
+    for (size_t i = range[0]; i < range[1]; ++i) {
+        int n = AddNode(target[i]);
+        nodes_[n].coverage = 1;
+        if (!backbone_.empty()) AddEdge(backbone_.back(), n);
+        backbone_.push_back(n);
+    }
+    TopologicalSort();
+    return !backbone_.empty();
+}
+
+bool PoaGraph::AddQuery(int qid, const std::vector<uint8_t> &seq, size_t first, size_t last, int min_score) {
+    // 比对区域是骨架上[first, last]，不超出range_
+    size_t b = std::max(first, range_[0]);
+    size_t e = std::min(last, range_[1] - 1);
+    if (seq.empty() || b > e) return false;
+
+    int score = 0;
+    bool fused = Align(seq, rank_[backbone_[b - range_[0]]], rank_[backbone_[e - range_[0]]], path_, score) && score >= min_score;
+    if (fused) {
+        Fuse(seq, path_);
+        TopologicalSort();
+    }
+    infos_.push_back({qid, score, seq.size(), fused});
+    return fused;
+}
+
+void PoaGraph::Build(const DnaSeq& target, const std::array<size_t,2> &range, const std::vector<Alignment> &aligned) {
+    if (!InitBackbone(target, range)) return;
+
+    std::vector<uint8_t> seq;
+    for (const auto &al : aligned) {
+        // 只取比对到range内的query碱基，插入归属于它前面的target碱基
+        seq.clear();
+        size_t first = range[1];
+        size_t last = range[0];
+        size_t t = al.target_start;
+        for (size_t i = 0; i < al.aligned_target.size(); ++i) {
+            char bt = al.aligned_target[i];
+            char bq = al.aligned_query[i];
+            if (bt == '-' && t == al.target_start) continue;
+
+            size_t pos = bt != '-' ? t++ : t - 1;
+            if (pos >= range[0] && pos < range[1]) {
+                first = std::min(first, pos);
+                last = std::max(last, pos);
+                if (bq != '-') seq.push_back(Base2Num[bq]);
+            }
+        }
+        if (seq.empty() || first > last) continue;
+
+        AddQuery(al.qid, seq, first >= (size_t)margin_ ? first - margin_ : 0, last + margin_, INT_MIN);
+    }
+}
+
+void PoaGraph::Build(const DnaSeq& target, const std::array<size_t,2> &range, const std::vector<Fragment> &fragments) {
+    if (!InitBackbone(target, range)) return;
+
+    for (const auto &f : fragments) {
+        // 换到比对的链上
+        const int qsize = (int)f.query->Size();
+        int qs = !f.rc ? f.range[0] : qsize - f.range[1];
+        int qe = !f.rc ? f.range[1] : qsize - f.range[0];
+        int ts = f.range[2];
+        int te = f.range[3];
+        if (qs >= qe || ts >= te) continue;
+
+        // 超出range的部分按比例从query上截去。overlap的坐标有误差，两端再向内多截margin_个碱基，
+        // 避免留下range外的碱基。query在图上的起止是自由的，少截的碱基只是不参与该位置的投票
+        const double rate = (double)(qe - qs) / (te - ts);
+        if (ts < (int)range[0]) {
+            qs += (int)((range[0] - ts) * rate) + margin_;
+            ts = (int)range[0];
+        }
+        if (te > (int)range[1]) {
+            qe -= (int)((te - range[1]) * rate) + margin_;
+            te = (int)range[1];
+        }
+        if (qs >= qe || ts >= te) continue;
+
+        std::vector<uint8_t> seq = !f.rc ? f.query->ToUInt8(qs, qe, false) : f.query->ToUInt8(qsize - qe, qsize - qs, true);
+
+        // 错配和空位的得分为负，随机序列的得分远低于0，得分为负时认为不是真实的overlap
+        const size_t ext = margin_ + band_ + (size_t)(band_rate_ * seq.size());
+        AddQuery(f.qid, seq, (size_t)ts >= ext ? ts - ext : 0, te + ext, 0);
+    }
+}
+
+int PoaGraph::AddNode(uint8_t base) {
+    nodes_.push_back(Node(base));
+    return (int)nodes_.size() - 1;
+}
+
+void PoaGraph::AddEdge(int from, int to) {
+    auto &out = nodes_[from].out;
+    auto it = std::find_if(out.begin(), out.end(), [to](const Edge &e) { return e.node == to; });
+    if (it != out.end()) {
+        it->weight++;
+        auto &in = nodes_[to].in;
+        std::find_if(in.begin(), in.end(), [from](const Edge &e) { return e.node == from; })->weight++;
+    } else {
+        out.push_back({to, 1});
+        nodes_[to].in.push_back({from, 1});
+    }
+}
+
+void PoaGraph::TopologicalSort() {
+    indegree_.assign(nodes_.size(), 0);
+    order_.clear();
+    for (size_t i = 0; i < nodes_.size(); ++i) {
+        indegree_[i] = (int)nodes_[i].in.size();
+        if (indegree_[i] == 0) order_.push_back((int)i);
+    }
+
+    for (size_t i = 0; i < order_.size(); ++i) {
+        for (const auto &e : nodes_[order_[i]].out) {
+            if (--indegree_[e.node] == 0) order_.push_back(e.node);
+        }
+    }
+    assert(order_.size() == nodes_.size());
+
+    rank_.assign(nodes_.size(), 0);
+    for (size_t i = 0; i < order_.size(); ++i) {
+        rank_[order_[i]] = (int)i;
+    }
+}
+
+bool PoaGraph::Align(const std::vector<uint8_t> &seq, int begin, int end, std::vector<std::array<int,2>> &path, int &score) {
+    const int m = (int)seq.size();
+    const int w = band_ + (int)(band_rate_ * m);
+    const int NEG = INT_MIN / 2;
+
+    for (int b = 0; b < 4; ++b) {
+        profile_[b].assign(m + 1, NEG);
+        for (int j = 1; j <= m; ++j) {
+            profile_[b][j] = seq[j-1] == b ? match_ : mismatch_;
+        }
+    }
+
+    // h[v][0] = 0: 图上的起点是自由的; 虚拟起点h0[j] = gap_*j: query的开头不能跳过
+    rows_.resize(nodes_.size());
+    size_t used = 0;                // scores_只增长，已用的长度
+    int best_score = NEG;
+    int best_node = -1;
+
+    for (int r = begin; r <= end; ++r) {
+        const int v = order_[r];
+        const Node &node = nodes_[v];
+
+        int lo = INT_MAX;
+        int hi = -1;
+        for (const auto &e : node.in) {
+            if (rank_[e.node] >= begin) {
+                lo = std::min(lo, rows_[e.node].best + 1);
+                hi = std::max(hi, rows_[e.node].best + 1);
+            }
+        }
+        if (hi < 0) lo = hi = 0;
+        lo = std::max(0, lo - w);
+        hi = std::min(m, hi + w);
+
+        Row &row = rows_[v];
+        row.lo = lo;
+        row.hi = hi;
+        row.offset = used;
+        used += (hi - lo + 4) / 4 * 4;      // 每行从16字节对齐的位置开始
+        if (scores_.size() < used) scores_.resize(std::max(used, 2 * scores_.size()));
+
+        int *h = scores_.data() + row.offset;       // h[k]: 位置lo+k
+        std::fill(h, h + (hi - lo + 1), NEG);
+        const int *prof = profile_[node.base].data();
+
+        // 从虚拟起点开始只在query开头附近才可能得分更高
+        if (lo == 0) h[0] = 0;
+        for (int j = std::max(lo, 1); j <= std::min(hi, w); ++j) {
+            h[j-lo] = std::max(h[j-lo], gap_ * (j-1) + prof[j]);
+        }
+
+        for (const auto &e : node.in) {
+            if (rank_[e.node] < begin) continue;
+            const Row &pr = rows_[e.node];
+            const int *ph = scores_.data() + pr.offset;            // ph[k]: 位置pr.lo+k
+
+            // 匹配或错配: ph[j-1] + prof[j]，query中缺失该节点: ph[j] + gap_
+            int s = std::max(lo, pr.lo + 1);
+            int t = std::min(hi, pr.hi);
+            if (s <= t) UpdateFromPrev(h + (s - lo), ph + (s - 1 - pr.lo), prof + s, t - s + 1, gap_);
+            if (pr.lo >= lo && pr.lo <= hi) {
+                h[pr.lo-lo] = std::max(h[pr.lo-lo], ph[0] + gap_);
+            }
+            if (pr.hi + 1 >= std::max(lo, pr.lo + 1) && pr.hi + 1 <= hi) {
+                h[pr.hi+1-lo] = std::max(h[pr.hi+1-lo], ph[pr.hi-pr.lo] + prof[pr.hi+1]);
+            }
+        }
+
+        // query中插入
+        row.best = lo + ScanInsertions(h, hi - lo + 1, gap_);
+        if (hi == m && h[m-lo] > best_score) {
+            best_score = h[m-lo];
+            best_node = v;
+        }
+    }
+
+    if (best_node < 0) return false;    // query的末端不在带内
+    score = best_score;
+
+    auto get = [this, NEG](int v, int j) {
+        const Row &r = rows_[v];
+        return j >= r.lo && j <= r.hi ? scores_[r.offset + j - r.lo] : NEG;
+    };
+
+    path.clear();
+    int v = best_node;
+    int j = m;
+    while (j > 0) {
+        const int s = get(v, j);
+        const int sub = profile_[nodes_[v].base][j];
+
+        bool found = false;
+        for (const auto &e : nodes_[v].in) {
+            if (rank_[e.node] < begin) continue;
+            if (get(e.node, j-1) + sub == s) {
+                path.push_back({{v, j-1}});
+                v = e.node;
+                j--;
+                found = true;
+                break;
+            } else if (get(e.node, j) + gap_ == s) {
+                path.push_back({{v, -1}});
+                v = e.node;
+                found = true;
+                break;
+            }
+        }
+        if (found) continue;
+
+        if (get(v, j-1) + gap_ == s) {
+            path.push_back({{-1, j-1}});
+            j--;
+        } else if (gap_ * (j-1) + sub == s) {
+            path.push_back({{v, j-1}});
+            for (j = j-1; j > 0; --j) {
+                path.push_back({{-1, j-1}});
+            }
+        } else {
+            assert(!"Must find the previous cell");
+            return false;
+        }
+    }
+    std::reverse(path.begin(), path.end());
+    return true;
+}
+
+void PoaGraph::Fuse(const std::vector<uint8_t> &seq, const std::vector<std::array<int,2>> &path) {
+    int prev = -1;
+    for (const auto &p : path) {
+        if (p[1] < 0) continue;
+
+        uint8_t base = seq[p[1]];
+        int n = -1;
+        if (p[0] < 0) {
+            n = AddNode(base);
+        } else if (nodes_[p[0]].base == base) {
+            n = p[0];
+        } else {
+            for (auto a : nodes_[p[0]].aligned) {
+                if (nodes_[a].base == base) {
+                    n = a;
+                    break;
+                }
+            }
+            if (n < 0) {
+                n = AddNode(base);
+                auto group = nodes_[p[0]].aligned;
+                group.push_back(p[0]);
+                for (auto a : group) {
+                    nodes_[a].aligned.push_back(n);
+                    nodes_[n].aligned.push_back(a);
+                }
+            }
+        }
+
+        nodes_[n].coverage++;
+        if (prev >= 0) AddEdge(prev, n);
+        prev = n;
+    }
+}
+
+void PoaGraph::Consensus() {
+    sequence_.clear();
+    if (nodes_.empty()) return;
+
+    // 最重路径: 每个节点选权重最大的入边，相同时选得分高的前驱
+    std::vector<long long> scores(nodes_.size(), 0);
+    std::vector<int> prevs(nodes_.size(), -1);
+    int best = -1;
+    for (auto v : order_) {
+        int weight = 0;
+        for (const auto &e : nodes_[v].in) {
+            if (e.weight > weight || (e.weight == weight && scores[e.node] > scores[prevs[v]])) {
+                weight = e.weight;
+                prevs[v] = e.node;
+            }
+        }
+        scores[v] = prevs[v] >= 0 ? scores[prevs[v]] + weight : 0;
+        if (best < 0 || scores[v] > scores[best]) best = v;
+    }
+
+    std::vector<int> path;
+    for (int v = best; v >= 0; v = prevs[v]) {
+        path.push_back(v);
+    }
+    std::reverse(path.begin(), path.end());
+
+    // 去掉两端覆盖度不足的部分
+    size_t s = 0;
+    while (s < path.size() && nodes_[path[s]].coverage < min_coverage_) s++;
+    size_t e = path.size();
+    while (e > s && nodes_[path[e-1]].coverage < min_coverage_) e--;
+
+    sequence_.reserve(e - s);
+    for (size_t i = s; i < e; ++i) {
+        sequence_.push_back("ACGT"[nodes_[path[i]].base]);
+    }
+}
+
+void PoaGraph::SaveReadInfos(std::ostream& os, int tid, const ReadStore &rs) const {
+    const std::string& tname = rs.QueryNameById(tid);
+    for (const auto &info : infos_) {
+        const std::string& qname = rs.QueryNameById(info.qid);
+        double weight = info.length > 0 ? info.score * 1.0 / (match_ * info.length) : 0.0;
+        os << tname << " " << qname << " " << weight << " " << (info.fused ? 1 : 0) << "\n";
+    }
+}
+
+} // namespace fsa {
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <array>
+#include <string>
+#include <vector>
+
+#include "corrector.hpp"
+
+namespace fsa {
+
+class ReadStore;
+
+// 偏序比对(POA)的一致性序列。以target为骨架，依次把各query比对到图上并合并，最后取最重路径。
+// 比对是图上局部、query上全局的带状动态规划，带宽随query长度调整，带的位置由前驱节点的最佳位置决定。
+// 每个节点的一行按query位置计算，匹配和删除的转移及插入的前缀扫描用SSE2指令每次处理4个位置。
+// query可以是两两比对的结果，也可以是未比对的序列，后者由overlap的坐标确定在骨架上的大致区域，不需要先做两两比对。
+class PoaGraph : public Corrector {
+public:
+    PoaGraph(const std::vector<std::string> &opts=std::vector<std::string>());
+
+    void SetParameter(const std::string &name, const std::string &v);
+    void SetParameter(const std::string &name, int v);
+    void SetParameter(const std::string &name, double v);
+
+    void Build(const DnaSeq& target, const std::array<size_t,2> &range, const std::vector<Alignment> &aligned);
+    bool AlignsQueries() const { return true; }
+    void Build(const DnaSeq& target, const std::array<size_t,2> &range, const std::vector<Fragment> &fragments);
+    void Clear();
+    void Consensus();
+    const std::string& GetSequence() const { return sequence_; }
+    const std::string& GetQuality() const { return quality_; }
+    void SaveReadInfos(std::ostream &os, int tid, const ReadStore& rs) const;
+
+protected:
+    struct Edge {
+        int node;
+        int weight;
+    };
+
+    struct Node {
+        Node(uint8_t b) : base(b) {}
+        uint8_t base;
+        int coverage { 0 };
+        std::vector<Edge> in;
+        std::vector<Edge> out;
+        std::vector<int> aligned;       // 与该节点比对在同一位置的其它碱基的节点
+    };
+
+    // 一个节点在动态规划矩阵中的行，只保存带内[lo, hi]的得分
+    struct Row {
+        int lo;
+        int hi;
+        int best;               // 得分最高的query位置
+        size_t offset;          // 在scores_中的起始位置
+    };
+
+    struct QueryInfo {
+        int qid;
+        int score;
+        size_t length;
+        bool fused;
+    };
+
+    bool InitBackbone(const DnaSeq& target, const std::array<size_t,2> &range);
+    // 把seq比对到骨架[first, last]的区域并合并，得分低于min_score时不合并
+    bool AddQuery(int qid, const std::vector<uint8_t> &seq, size_t first, size_t last, int min_score);
+    int AddNode(uint8_t base);
+    void AddEdge(int from, int to);
+    void TopologicalSort();
+
+    // 把seq比对到rank在[begin, end]内的节点上，path为(节点, query位置)，-1表示空位
+    bool Align(const std::vector<uint8_t> &seq, int begin, int end, std::vector<std::array<int,2>> &path, int &score);
+    void Fuse(const std::vector<uint8_t> &seq, const std::vector<std::array<int,2>> &path);
+    static void UpdateFromPrev(int *h, const int *p, const int *f, int n, int gap);
+    static int ScanInsertions(int *h, int n, int gap);
+
+protected:
+    int match_ { 2 };
+    int mismatch_ { -4 };
+    int gap_ { -4 };
+    int band_ { 10 };               // 带宽为 band_ + band_rate_ * query长度
+    double band_rate_ { 0.01 };
+    int margin_ { 16 };             // 比对区域在骨架上向两端扩展的碱基数
+    int min_coverage_ { 4 };
+
+    std::array<size_t, 2> range_ {{0, 0}};
+    std::vector<Node> nodes_;
+    std::vector<int> order_;        // 拓扑顺序
+    std::vector<int> rank_;         // 节点在order_中的位置
+    std::vector<int> backbone_;     // target[range_[0]+i]的节点
+    std::vector<QueryInfo> infos_;
+
+    std::string sequence_;
+    std::string quality_;
+
+    // 比对用的缓存，在query之间重用
+    std::vector<Row> rows_;
+    std::vector<int> scores_;
+    std::array<std::vector<int>, 4> profile_;   // profile_[b][j]: seq[j-1]与碱基b的得分
+    std::vector<int> indegree_;
+    std::vector<std::array<int,2>> path_;
+};
+
+} // namespace fsa {
@@ -2,7 +2,11 @@
 
 #include <iostream>
 #include <atomic>
+#include <chrono>
+#include <cmath>
+#include <numeric>
 #include "./utils/logger.hpp"
+#include "./utils/ordered_writer.hpp"
 #include "../utility.hpp"
 
 namespace fsa {
@@ -20,16 +24,24 @@ ArgumentParser ReadCorrect::GetArgumentParser() {
     ap.AddNamedOption(thread_size_, "thread_size", "thread size");
     ap.AddNamedOption(graph_fname_, "graph_fname", "The file recording graph");
     ap.AddNamedOption(infos_fname_, "infos_fname", "The file recording score infos");
+    ap.AddNamedOption(stats_fname_, "stats_fname", "The file recording the statistics of each read (TSV): name, length, tried, accepted, used and seconds of the phases");
     ap.AddNamedOption(output_directory_, "output_directory", "The directory for temporary files");
     ap.AddNamedOption(read_name_, "read_name", "read name for correcting");
     ap.AddNamedOption(read_name_fname_, "read_name_fname", "Set read name for correcting");
-    ap.AddNamedOption(aligner_, "aligner", "method for local alignment, diff|edlib.");
+    ap.AddNamedOption(aligner_, "aligner", "method for local alignment, diff|edlib|simd. simd: banded extension of several queries at once, one per SSE2 lane, simd:m=2:x=-4:g=-3:w=64:z=200");
+    ap.AddNamedOption(corrector_, "corrector", "method for consensus, graph|poa. graph: AlignmentGraph built from the pairwise alignments, poa: banded partial order alignment of the reads placed by the overlaps, without pairwise alignment, poa:m=2:x=-4:g=-4:w=10:wr=0.01:mg=16");
     ap.AddNamedOption(score_, "score", "");
-    ap.AddNamedOption(cands_opts_str_, "candidate", "options for selecting candidate overlaps");
+    ap.AddNamedOption(cands_opts_str_, "candidate", "options for selecting candidate overlaps, b: the number of candidates aligned together, 0 for the batch size of the aligner");
     ap.AddNamedOption(min_identity_, "min_identity", "");
     ap.AddNamedOption(min_local_identity_, "min_local_identity", "");
     ap.AddNamedOption(min_coverage_, "min_coverage", "");
     ap.AddNamedOption(use_cache_, "use_cache", "use cache for alignment");
+    ap.AddNamedOption(use_cigar_, "use_cigar", "build alignments from the cigar (cg:Z:) in the overlap file, and realign the reads only when the result is not acceptable");
+    ap.AddNamedOption(output_window_, "output_window", "maximum number of corrected reads buffered for writing them in order");
+    ap.AddNamedOption(max_memory_, "max_memory", "memory budget (GB) of the overlaps. If it is set, the overlaps are spilled to temporary files by the target reads and the reads are corrected part by part");
+    ap.AddNamedOption(checkpoint_interval_, "checkpoint_interval", "number of reads written between checkpoints, 0 for no checkpoint");
+    ap.AddNamedOption(resume_, "resume", "resume the job from the last checkpoint");
+    ap.AddNamedOption(schedule_, "schedule", "order of dispatching reads to threads, order|cost. order: the order of the reads in the file, cost: the most expensive reads first, which also changes the output order");
 
     return ap;
 }
@@ -43,6 +55,10 @@ void ReadCorrect::CheckArguments() {
 
     cands_opts_.From(cands_opts_str_);          // 合并用户设置
     cands_opts_str_ = cands_opts_.ToString();   // 输出所有参数
+
+    if (schedule_ != "cost" && schedule_ != "order") {
+        LOG(ERROR)("Not support parameter: schedule=%s", schedule_.c_str());
+    }
 }
 
 void ReadCorrect::CandidateOptions::From(const std::string& str) {
@@ -60,6 +76,8 @@ void ReadCorrect::CandidateOptions::From(const std::string& str) {
             percent = std::stod(kv[1]);
         } else if (kv[0] == "ohwt") {
             overhang_weight = std::stod(kv[1]);
+        } else if (kv[0] == "b") {
+            batch = std::max(0, std::stoi(kv[1]));
         } else {
             LOG(ERROR)("Unrecoginze candidate overlaps options %s", kv[0].c_str());
         }
@@ -74,7 +92,8 @@ std::string ReadCorrect::CandidateOptions::ToString() const  {
         << ":n=" << max_number
         << ":f=" << failures
         << ":p=" << percent
-        << ":ohwt=" << overhang_weight;
+        << ":ohwt=" << overhang_weight
+        << ":b=" << batch;
     return oss.str();
 }
 
@@ -91,17 +110,26 @@ bool ReadCorrect::ReadCorrect::CandidateOptions::IsEnough(const std::vector<int>
 
 void ReadCorrect::Running() {
     LoadReadIds();
+    PrepareCheckpoint();
 
-    LoadOverlaps(overlap_fname_);
-    LoadReads();
+    if (max_memory_ > 0) {
+        CorrectPartitioned();
+    } else {
+        LoadOverlaps(overlap_fname_);
+        LoadReads();
 
-    // TODO 根据read_ids来分组，不考虑其它的
-    ol_store_.Group(groups_, std::unordered_set<int>(read_ids_.begin(), read_ids_.end()), thread_size_);
-    LOG(INFO)("Group %zd %zd", groups_.size(), read_ids_.size());
+        // TODO 根据read_ids来分组，不考虑其它的
+        ol_store_.Group(groups_, std::unordered_set<int>(read_ids_.begin(), read_ids_.end()), thread_size_);
+        LOG(INFO)("Group %zd %zd", groups_.size(), read_ids_.size());
 
-    if (use_cache_) GroupReadIds();
+        if (use_cache_) GroupReadIds();
+        else if (schedule_ == "cost") ScheduleReadIds();
+
+        Correct();
+    }
 
-    Correct();
+    // 全部完成，不再需要checkpoint
+    if (checkpoint_ != nullptr) checkpoint_->Remove();
 }
 
 void ReadCorrect::LoadReads() {
@@ -129,6 +157,24 @@ void ReadCorrect::LoadOverlaps(const std::string &fname) {
 
 
 
+void ReadCorrect::PrepareCheckpoint() {
+    if (checkpoint_interval_ <= 0 && !resume_) return;
+
+    checkpoint_.reset(new Checkpoint(cread_fname_ + ".ckpt", read_store_.Size()));
+    if (resume_ && checkpoint_->Load()) {
+        checkpoint_->Restore({cread_fname_, infos_fname_, stats_fname_});
+        size_t size = read_ids_.size();
+        read_ids_.erase(std::remove_if(read_ids_.begin(), read_ids_.end(), [this](Seq::Id id) {
+            return checkpoint_->Test(id);
+        }), read_ids_.end());
+        append_output_ = true;
+        LOG(INFO)("Resume from checkpoint: %zd/%zd reads done", size - read_ids_.size(), size);
+    } else {
+        // 旧的checkpoint与新的输出文件不一致
+        checkpoint_->Remove();
+    }
+}
+
 void ReadCorrect::LoadReadIds() {
     read_store_.Load(rread_fname_, "", false);
 
@@ -154,42 +200,62 @@ void ReadCorrect::Correct() {
 
     std::mutex mutex;
     
-    std::ofstream of_cread(cread_fname_);
-    std::ofstream of_infos(infos_fname_);
+    // ate: tellp() returns the size of the file for the checkpoint
+    const auto mode = append_output_ ? std::ios::app | std::ios::ate : std::ios::out;
+    std::ofstream of_cread(cread_fname_, mode);
+    std::ofstream of_infos(infos_fname_, mode);
+    std::ofstream of_stats(stats_fname_, mode);
     const bool save_infos = of_infos.is_open();
-    const size_t flush_block = 20*1024*1024;
+    const bool save_stats = of_stats.is_open();
+    if (save_stats && !append_output_) {
+        of_stats << "#name\tlength\ttried\taccepted\tused";
+        for (size_t i = 0; i < PHASE_SIZE; ++i) of_stats << "\t" << PhaseName(i);
+        of_stats << "\n";
+    }
 
     Progress progress(*this);
 
-    auto save_oss = [&](std::ostringstream &oss_cread, std::ostringstream &oss_scores) {
-        std::lock_guard<std::mutex> lock(mutex);
-        of_cread << oss_cread.str();              
-        oss_cread.str("");
-
-        if (save_infos) {
-            of_infos << oss_scores.str();
-            oss_scores.str("");
+    // Each read is written in the dispatching order, so the output doesn't depend on the thread size or timing.
+    // With use_cache_, a thread takes a whole group of reads at a time, so the window must hold a group per thread.
+    size_t output_window = std::max(output_window_, thread_size_);
+    if (use_cache_) {
+        size_t max_group = 1;
+        for (size_t i = 1; i < group_ticks.size(); ++i) {
+            max_group = std::max(max_group, group_ticks[i] - group_ticks[i-1]);
         }
-    };
+        output_window = std::max(output_window, thread_size_ * max_group);
+    }
+    OrderedWriter writer({&of_cread, save_infos ? &of_infos : nullptr, save_stats ? &of_stats : nullptr}, output_window);
+    if (checkpoint_ != nullptr) {
+        const auto &ids = use_cache_ ? grouped_ids_ : read_ids_;
+        writer.SetWritten([&](size_t sn) {
+            checkpoint_->Set(ids[sn]);
+            if (checkpoint_interval_ > 0 && (sn + 1) % checkpoint_interval_ == 0) {
+                checkpoint_->Save({&of_cread, save_infos ? &of_infos : nullptr, save_stats ? &of_stats : nullptr});
+            }
+        });
+    }
 
-    struct Dispatcher { virtual Seq::Id Get(bool &uc) = 0; };
+    struct Dispatcher { virtual Seq::Id Get(bool &uc, size_t &sn) = 0; };
     struct SimpleDispatcher : public Dispatcher {
         SimpleDispatcher(Progress &p) : progress(p) {}
-        Seq::Id Get(bool &uc) { uc = false; return progress.Get(); }
+        Seq::Id Get(bool &uc, size_t &sn) { uc = false; return progress.Get(sn); }
         Progress &progress;
     };
 
     struct GroupDispatcher : public Dispatcher {
         GroupDispatcher(Progress &p, ReadCorrect::Worker &w) : progress(p), worker(w), ids(2000){}
 
-        Seq::Id Get(bool &uc) {
+        Seq::Id Get(bool &uc, size_t &sn) {
             uc = true; 
             if (index < size) {
+                sn = start + index;
                 return ids[index++];
             } else {
                 index = 0;
-                size = progress.Get(ids);
+                size = progress.Get(ids, start);
                 worker.ResetCache(ids, size);
+                sn = start + index;
                 return index < size ? ids[index++] : -1;
             }
         }
@@ -200,22 +266,32 @@ void ReadCorrect::Correct() {
         std::vector<Seq::Id> ids;
         size_t index { 0 };
         size_t size { 0 };
+        size_t start { 0 };
 
     };
 
+    typedef std::chrono::steady_clock Clock;
+    auto seconds = [](Clock::time_point s, Clock::time_point e) { return std::chrono::duration<double>(e - s).count(); };
+    const auto start_time = Clock::now();
+    thread_infos_.assign(thread_size_, ThreadInfo());
+
     auto work_func = [&](size_t i) {
         Worker worker(*this);
+        ThreadInfo &tinfo = thread_infos_[i];
         std::unique_ptr<Dispatcher> dispatcher(use_cache_ ? 
             (Dispatcher*)new GroupDispatcher(progress, worker) : 
             (Dispatcher*)new SimpleDispatcher(progress));
 
         std::ostringstream oss_cread;
         std::ostringstream oss_scores;
+        std::ostringstream oss_stats;
         bool uc = false;
+        size_t sn = 0;
 
-        for (auto tid=dispatcher->Get(uc); tid != Seq::NID; tid = dispatcher->Get(uc)) {
+        for (auto tid=dispatcher->Get(uc, sn); tid != Seq::NID; tid = dispatcher->Get(uc, sn)) {
             auto it = groups_.find(tid);
             if (it != groups_.end()) {
+                auto busy_start = Clock::now();
                 if (worker.Correct(it->first, it->second, uc)) {
                     if ( worker.GetCorrected().size() > 0) {
                         SaveCRead(oss_cread, it->first, worker.GetCorrected());
@@ -224,24 +300,28 @@ void ReadCorrect::Correct() {
                         LOG(WARNING)("Corrected Read(%s) is emtpy", read_store_.QueryNameById(tid).c_str());
                     }
                 }
+                if (save_stats) worker.SaveReadStat(oss_stats, it->first, read_store_);
                 worker.Clear();
+                tinfo.busy += seconds(busy_start, Clock::now());
+                tinfo.reads++;
             }
 
-            if (oss_cread.tellp() > (int)flush_block) {
-                save_oss(oss_cread, oss_scores);
-            }
+            writer.Put(sn, {oss_cread.str(), oss_scores.str(), oss_stats.str()});
+            oss_cread.str("");
+            oss_scores.str("");
+            oss_stats.str("");
         }
 
-        if (oss_cread.tellp() > 0) {
-            save_oss(oss_cread, oss_scores);
-        }
         CollectWorkerInfo(worker, mutex);
+        tinfo.finish = seconds(start_time, Clock::now());
     };
 
  
     LOG(INFO)("thread size %zd, totalsize %d", thread_size_, read_ids_.size());
     if (of_cread.is_open()) {
         MultiThreadRun((size_t)thread_size_, work_func);
+        // 分块纠错时，记录本块已完成，后面的块仍可从这里恢复
+        if (checkpoint_ != nullptr && max_memory_ > 0) checkpoint_->Save({&of_cread, save_infos ? &of_infos : nullptr, save_stats ? &of_stats : nullptr});
     } else {
         LOG(INFO)("Failed to open file: %s", rread_fname_.c_str());
     }
@@ -250,6 +330,159 @@ void ReadCorrect::Correct() {
 }
 
 
+void ReadCorrect::CorrectPartitioned() {
+    // 按在read_ids_中的位置把待纠错的read分到若干个小桶，扫描一遍overlap文件，把overlap写入它的两端所在的桶。
+    // 然后在内存预算内合并相邻的小桶，逐个载入并纠错。read的索引已由LoadReadIds建立，每块只载入用到的序列，纠错后释放。
+    const std::vector<Seq::Id> all_ids(read_ids_);
+    const size_t budget = (size_t)(max_memory_ * 1024 * 1024 * 1024);
+
+    // 以overlap文件的大小估计全部载入后的内存，压缩文件按4倍估计。小桶约为预算的1/4，合并时可以接近预算。
+    // 小桶数不超过read数，也不超过同时打开的文件数的限制，超出时一个小桶可能大于预算，单独载入。
+    const size_t max_bucket_count = 1000;
+    std::ifstream ol_file(overlap_fname_, std::ios::binary | std::ios::ate);
+    double volume = ol_file.is_open() ? (double)ol_file.tellg() : 0.0;
+    ol_file.close();
+    if (overlap_fname_.size() >= 3 && overlap_fname_.compare(overlap_fname_.size()-3, 3, ".gz") == 0) volume *= 4;
+    const size_t wanted = (size_t)std::ceil(volume * 4 / std::max<size_t>(budget, 1));
+    const size_t bucket_count = std::max<size_t>(1, std::min(std::min(wanted, all_ids.size()), max_bucket_count));
+    if (wanted > max_bucket_count) {
+        LOG(WARNING)("The memory budget needs %zd buckets, use %zd buckets", wanted, max_bucket_count);
+    }
+
+    std::vector<int> buckets(read_store_.Size(), -1);
+    for (size_t i = 0; i < all_ids.size(); ++i) {
+        // 未找到的read名字对应Seq::NID，跳过
+        if (all_ids[i] >= 0 && all_ids[i] < (Seq::Id)buckets.size()) {
+            buckets[all_ids[i]] = i * bucket_count / all_ids.size();
+        }
+    }
+    auto bucket = [&buckets](Seq::Id id) { return id >= 0 && id < (Seq::Id)buckets.size() ? buckets[id] : -1; };
+    auto bucket_fname = [this](size_t i) { return OutputPath("rd_correct_bucket_" + std::to_string(i) + ".bin"); };
+
+    struct Spill {
+        std::mutex mutex;
+        std::ofstream file;
+        size_t count { 0 };
+        size_t memory { 0 };    // estimated memory after loading
+    };
+    std::vector<Spill> spills(bucket_count);
+    for (size_t i = 0; i < spills.size(); ++i) {
+        spills[i].file.open(bucket_fname(i), std::ios::binary);
+        if (!spills[i].file.is_open()) LOG(ERROR)("Failed to open file: %s", bucket_fname(i).c_str());
+    }
+
+    auto spill = [&spills](int b, const Overlap &o) {
+        auto &s = spills[b];
+        std::lock_guard<std::mutex> lock(s.mutex);
+        OverlapStore::ToBinary(s.file, o);
+        s.count++;
+        s.memory += sizeof(Overlap) + o.detail_.size()*sizeof(Overlap::Detail) + 2*64;    // 64: an item of groups_
+    };
+
+    ol_store_.LoadFast(overlap_fname_, "", (size_t)thread_size_, [&](Overlap &o) {
+        int ba = bucket(o.a_.id);
+        int bb = bucket(o.b_.id);
+        if ((ba >= 0 || bb >= 0) && filter0_.Valid(o)) {
+            if (ba >= 0) spill(ba, o);
+            if (bb >= 0 && bb != ba) spill(bb, o);
+        }
+        return false;
+    });
+
+    size_t count = 0;
+    for (auto &s : spills) {
+        s.file.close();
+        count += s.count;
+    }
+    LOG(INFO)("Spill %zd overlaps from file %s into %zd buckets", count, overlap_fname_.c_str(), spills.size());
+
+    std::vector<bool> used(read_store_.Size(), false);
+    for (size_t lo = 0, hi = 0; lo < spills.size(); lo = hi) {
+        size_t memory = 0;
+        for (hi = lo; hi < spills.size() && (hi == lo || memory + spills[hi].memory <= budget); ++hi) {
+            memory += spills[hi].memory;
+        }
+
+        ol_store_.Clear();
+        groups_.clear();
+        for (size_t k = lo; k < hi; ++k) {
+            // 两端都在[lo, hi)中的overlap在两个桶中，只从编号小的桶载入
+            ol_store_.LoadBinary(bucket_fname(k), [&](const Overlap &o) {
+                int other = bucket(o.a_.id) == (int)k ? bucket(o.b_.id) : bucket(o.a_.id);
+                return !(other >= (int)lo && other < (int)k);
+            });
+            std::remove(bucket_fname(k).c_str());
+        }
+
+        read_ids_.clear();
+        for (auto i : all_ids) {
+            if (bucket(i) >= (int)lo && bucket(i) < (int)hi) read_ids_.push_back(i);
+        }
+        LOG(INFO)("Correct buckets [%zd, %zd): %zd reads, %zd overlaps, about %.2fGB", lo, hi, read_ids_.size(), ol_store_.Size(), memory / (1024.0*1024*1024));
+
+        // 只载入本块用到的read的序列
+        std::vector<Seq::Id> reads;
+        for (size_t i = 0; i < ol_store_.Size(); ++i) {
+            const Overlap& o = ol_store_.Get(i);
+            for (auto id : {o.a_.id, o.b_.id}) {
+                if (!used[id]) {
+                    used[id] = true;
+                    reads.push_back(id);
+                }
+            }
+        }
+        std::sort(reads.begin(), reads.end());
+        read_store_.LoadItems(reads);
+
+        ol_store_.Group(groups_, std::unordered_set<int>(read_ids_.begin(), read_ids_.end()), thread_size_);
+        grouped_ids_.clear();
+        group_ticks.clear();
+        if (use_cache_) GroupReadIds();
+        else if (schedule_ == "cost") ScheduleReadIds();
+
+        Correct();
+        append_output_ = true;
+
+        read_store_.ReleaseItems(reads);
+        for (auto id : reads) used[id] = false;
+    }
+
+    ol_store_.Clear();
+    groups_.clear();
+    read_ids_ = all_ids;
+}
+
+void ReadCorrect::ReportPhases() const {
+    std::ostringstream oss;
+    oss.precision(2);
+    oss.setf(std::ios::fixed);
+    double total = std::accumulate(stat_info_.seconds.begin(), stat_info_.seconds.end(), 0.0);
+    for (size_t i = 0; i < PHASE_SIZE; ++i) {
+        oss << ", " << PhaseName(i) << " " << stat_info_.seconds[i] << "s(" << (total > 0 ? stat_info_.seconds[i] * 100 / total : 0.0) << "%)";
+    }
+    LOG(INFO)("phases: total %.2fs%s", total, oss.str().c_str());
+}
+
+void ReadCorrect::ReportThreadInfos() const {
+    if (thread_infos_.empty()) return;
+
+    double wall = 0;
+    double busy = 0;
+    for (const auto &t : thread_infos_) {
+        wall = std::max(wall, t.finish);
+        busy += t.busy;
+    }
+
+    for (size_t i=0; i<thread_infos_.size(); ++i) {
+        const auto &t = thread_infos_[i];
+        LOG(INFO)("thread %zd: reads %zd, busy %.2fs, finish %.2fs, utilisation %.1f%%", i, t.reads, t.busy, t.finish, wall > 0 ? t.busy*100.0 / wall : 0.0);
+    }
+    LOG(INFO)("threads: wall %.2fs, utilisation %.1f%%, tail %.2fs", wall, wall > 0 ? busy*100.0 / (wall*thread_infos_.size()) : 0.0, 
+        wall - std::min_element(thread_infos_.begin(), thread_infos_.end(), [](const ThreadInfo &a, const ThreadInfo &b) {
+            return a.finish < b.finish; 
+        })->finish);
+}
+
 void ReadCorrect::SaveCRead(std::ostream &os, int tid, const std::string &cread) {
     
     auto result = SplitString(cread, [](char c) { return islower(c); });
@@ -315,6 +548,33 @@ void ReadCorrect::GroupReadIds() {
 
 }
 
+// Sort read_ids_ so that the most expensive reads are dispatched first. The cost of a read is
+// estimated as target length × the number of candidates it would align, which keeps a long read
+// with many overlaps from becoming the straggler at the end of the job.
+void ReadCorrect::ScheduleReadIds() {
+    std::vector<std::pair<Seq::Id, size_t>> costs(read_ids_.size());
+
+    for (size_t i = 0; i < read_ids_.size(); ++i) {
+        auto id = read_ids_[i];
+        auto iter = groups_.find(id);
+        if (iter != groups_.end() && iter->second.size() > 0) {
+            size_t len = iter->second.begin()->second->GetRead(id).len;
+            size_t ncands = std::min<size_t>(iter->second.size(), cands_opts_.max_number);
+            costs[i] = std::make_pair(id, len * ncands);
+        } else {
+            costs[i] = std::make_pair(id, (size_t)0);
+        }
+    }
+
+    std::stable_sort(costs.begin(), costs.end(), [](const std::pair<Seq::Id, size_t> &a, const std::pair<Seq::Id, size_t> &b) {
+        return a.second > b.second;
+    });
+
+    for (size_t i = 0; i < costs.size(); ++i) {
+        read_ids_[i] = costs[i].first;
+    }
+}
+
 bool ReadCorrect::Worker::ExactFilter(const Alignment &r, const std::array<size_t,2> &trange) {
     size_t start = std::max(trange[0], r.target_start);
     size_t end = std::min(trange[1], r.target_end);
@@ -362,31 +622,145 @@ bool ReadCorrect::Worker::GetAlignment(Seq::Id id, const Overlap* o, bool uc, Al
     const auto& qread = o->GetOtherRead(id);
 
     DEBUG_printf("start align %s %s\n", owner_.read_store_.QueryNameById(qread.id).c_str(), owner_.read_store_.QueryNameById(tread.id).c_str());
+    bool r = false;
+    if (GetAlignmentWithoutAligning(id, o, uc, al, r)) return r;
+
+    std::array<int, 4> range = {qread.start, qread.end, tread.start, tread.end};
+    r = aligner_.Align(owner_.read_store_.GetSeq(qread.id), !o->SameDirect(), range, al);  // TODO target 由调用者设置，可能存在不一致，需要优化。
     if (owner_.use_cache_ && uc) {
-        if (!cache_.GetAlignment(qread.id, tread.id, o->SameDirect(), al)) {
-            std::array<int, 4> range = {qread.start, qread.end, tread.start, tread.end};
-            auto r = aligner_.Align(owner_.read_store_.GetSeq(qread.id), !o->SameDirect(), range, al);  // TODO target 由调用者设置，可能存在不一致，需要优化。
-            cache_.SetAlignment(qread.id, tread.id, o->SameDirect(), al);
-            return r;
+        cache_.SetAlignment(qread.id, tread.id, o->SameDirect(), al);
+    }
+    return r;
+}
+
+// 从cigar或缓存得到比对，r为比对结果。返回false表示需要比对
+bool ReadCorrect::Worker::GetAlignmentWithoutAligning(Seq::Id id, const Overlap* o, bool uc, Alignment& al, bool &r) {
+    const auto& tread = o->GetRead(id);
+    const auto& qread = o->GetOtherRead(id);
+
+    if (owner_.use_cigar_ && o->detail_.size() > 0) {
+        if (GetAlignmentFromCigar(id, o, al) && !ExactFilter(al)) {
+            stat_info.aligns[2]++;
+            r = true;
+            return true;
+        }
+        stat_info.aligns[3]++;
+        al.Reset();
+    }
+
+    if (owner_.use_cache_ && uc && cache_.GetAlignment(qread.id, tread.id, o->SameDirect(), al)) {
+        r = al.Valid();
+        return true;
+    }
+    return false;
+}
 
+// 一批候选中需要比对的部分一起交给aligner_，结果与逐个调用GetAlignment相同
+void ReadCorrect::Worker::GetAlignments(Seq::Id id, const std::vector<const Overlap*> &ols, bool uc, std::vector<Alignment> &als, std::vector<bool> &rs) {
+    if (ols.size() == 1) {
+        als.assign(1, Alignment(ols[0]->GetRead(id).id, ols[0]->GetOtherRead(id).id));
+        rs.assign(1, GetAlignment(id, ols[0], uc, als[0]));
+        return;
+    }
+
+    als.clear();
+    rs.assign(ols.size(), false);
+    batch_.clear();
+    batch_index_.clear();
+    for (size_t i = 0; i < ols.size(); ++i) {
+        const auto& tread = ols[i]->GetRead(id);
+        const auto& qread = ols[i]->GetOtherRead(id);
+        als.push_back(Alignment(tread.id, qread.id));
+
+        bool r = false;
+        if (GetAlignmentWithoutAligning(id, ols[i], uc, als[i], r)) {
+            rs[i] = r;
         } else {
-            return al.Valid();
+            batch_.push_back({&owner_.read_store_.GetSeq(qread.id), !ols[i]->SameDirect(), {{qread.start, qread.end, tread.start, tread.end}}});
+            batch_index_.push_back(i);
+        }
+    }
+    if (batch_.empty()) return;
+
+    batch_als_.clear();
+    for (auto i : batch_index_) {
+        batch_als_.push_back(Alignment(als[i].tid, als[i].qid));
+    }
+    aligner_.Align(batch_, batch_als_, batch_rs_);
+
+    for (size_t j = 0; j < batch_index_.size(); ++j) {
+        auto i = batch_index_[j];
+        als[i] = std::move(batch_als_[j]);
+        rs[i] = batch_rs_[j];
+        if (owner_.use_cache_ && uc) {
+            cache_.SetAlignment(als[i].qid, als[i].tid, ols[i]->SameDirect(), als[i]);
         }
-    } else {
-        std::array<int, 4> range = {qread.start, qread.end, tread.start, tread.end};
-        return aligner_.Align(owner_.read_store_.GetSeq(qread.id), !o->SameDirect(), range, al);  // TODO target 由调用者设置，可能存在不一致，需要优化。
     }
 }
       
- std::array<size_t,2> MostEffectiveCoverage(size_t tsize, const std::vector<Alignment> &aligns, size_t stub, int min_coverage) {
-    if (aligns.size() == 0) return {0, 0};
+bool ReadCorrect::Worker::GetAlignmentFromCigar(Seq::Id id, const Overlap* o, Alignment &al) {
+    // 在PAF的坐标系中还原比对：target(b_)为正向，query(a_)按strand取正向或反向互补
+    const DnaSeq& qseq = owner_.read_store_.GetSeq(o->a_.id);
+    const DnaSeq& tseq = owner_.read_store_.GetSeq(o->b_.id);
+    const bool rc = !o->SameDirect();
+    const char* bases = "ACGT";
+
+    Alignment pal(&tseq, &qseq);
+    pal.target_start = o->b_.start;
+    pal.target_end = o->b_.end;
+    pal.query_start = !rc ? o->a_.start : o->a_.len - o->a_.end;
+    pal.query_end = !rc ? o->a_.end : o->a_.len - o->a_.start;
+
+    auto qbase = [&](size_t i) { return !rc ? bases[qseq[i]] : bases[3 - qseq[qseq.Size() - 1 - i]]; };
+
+    size_t it = pal.target_start;
+    size_t iq = pal.query_start;
+    for (const auto &d : o->detail_) {
+        if (d.type == 'M' || d.type == '=' || d.type == 'X') {
+            if (it + d.len > pal.target_end || iq + d.len > pal.query_end) return false;
+            for (int i = 0; i < d.len; ++i) {
+                pal.aligned_target.push_back(bases[tseq[it++]]);
+                pal.aligned_query.push_back(qbase(iq++));
+                if (pal.aligned_target.back() != pal.aligned_query.back()) pal.distance += 2;
+            }
+        } else if (d.type == 'I') {
+            if (iq + d.len > pal.query_end) return false;
+            for (int i = 0; i < d.len; ++i) {
+                pal.aligned_target.push_back('-');
+                pal.aligned_query.push_back(qbase(iq++));
+            }
+            pal.distance += d.len;
+        } else if (d.type == 'D') {
+            if (it + d.len > pal.target_end) return false;
+            for (int i = 0; i < d.len; ++i) {
+                pal.aligned_target.push_back(bases[tseq[it++]]);
+                pal.aligned_query.push_back('-');
+            }
+            pal.distance += d.len;
+        } else {
+            return false;
+        }
+    }
+    if (it != pal.target_end || iq != pal.query_end) return false;
+
+    if (o->a_.id == id) {
+        pal.Swap(o->SameDirect());
+    }
+    pal.tid = al.tid;
+    pal.qid = al.qid;
+    al = std::move(pal);
+
+    return aligner_.Validate(al);
+}
+
+ std::array<size_t,2> MostEffectiveCoverage(size_t tsize, const std::vector<std::array<size_t,2>> &intervals, size_t stub, int min_coverage) {
+    if (intervals.size() == 0) return {0, 0};
 
     std::vector<int> coverage(tsize+1, 0);
-    for (const auto& al : aligns) {
-        //assert(al.target_end - al.target_start > 2*stub);
-        if (al.target_end - al.target_start > 2*stub) {
-            coverage[al.target_start+stub] += 1;
-            coverage[al.target_end - stub] -= 1;
+    for (const auto& r : intervals) {
+        if (r[1] - r[0] > 2*stub) {
+            coverage[r[0]+stub] += 1;
+            coverage[r[1] - stub] -= 1;
         }
      }
 
@@ -423,18 +797,29 @@ bool ReadCorrect::Worker::GetAlignment(Seq::Id id, const Overlap* o, bool uc, Al
 
 }
 
+std::array<size_t,2> MostEffectiveCoverage(size_t tsize, const std::vector<Alignment> &aligns, size_t stub, int min_coverage) {
+    std::vector<std::array<size_t,2>> intervals(aligns.size());
+    std::transform(aligns.begin(), aligns.end(), intervals.begin(), [](const Alignment &al) { return std::array<size_t,2>{{al.target_start, al.target_end}}; });
+    return MostEffectiveCoverage(tsize, intervals, stub, min_coverage);
+}
+
 bool ReadCorrect::Worker::Correct(int id, const std::unordered_map<int, const Overlap*>& g, bool uc) {
     const DnaSeq& target = owner_.read_store_.GetSeq(id);
     assert(target.Size() >= (size_t)owner_.filter0_.min_length); 
 
     std::vector<std::pair<const Overlap*, double>> cands(g.size());
     std::transform(g.begin(), g.end(), cands.begin(), [](const std::pair<int, const Overlap*>& a) { return std::make_pair(a.second, 0.0); });
+    read_stat = ReadStat();
+    auto last = Clock::now();
     CalculateWeight(id, target, cands);
+    Lap(PHASE_WEIGHT, last);
 
     std::make_heap(cands.begin(), cands.end(), [](const std::pair<const Overlap*, double>& a, const std::pair<const Overlap*, double>& b) {
        return a.second < b.second;    // CAUTION, calulated by CalculateWeight
     });
     
+    if (graph_->AlignsQueries()) return CorrectWithFragments(id, target, cands);
+
     size_t heap_size = cands.size();
     aligner_.SetTarget(target);
     std::vector<int> coverage(target.Size(), 0);
@@ -442,20 +827,39 @@ bool ReadCorrect::Worker::Correct(int id, const std::unordered_map<int, const Ov
     std::vector<Alignment> first_als;
     std::vector<Alignment> flt_als;    // 
     int num_consecu_fail =  0;
+    // 按堆的顺序每次取出batch个候选一起比对，再逐个处理，提前结束的条件与逐个比对相同
+    const size_t batch_size = owner_.cands_opts_.batch > 0 ? (size_t)owner_.cands_opts_.batch : aligner_.BatchSize();
+    std::vector<const Overlap*> batch;
+    std::vector<Alignment> batch_als;
+    std::vector<bool> batch_rs;
+    size_t ib = 0;
     while (heap_size > 0) {
-        auto ol = cands[0].first;
-        const auto& tread = ol->GetRead(id);
-        const auto& qread = ol->GetOtherRead(id);
-        
-        Alignment al(tread.id, qread.id);
+        if (ib >= batch.size()) {
+            batch.clear();
+            for (size_t i = 0; i < batch_size && i < heap_size; ++i) {
+                batch.push_back(cands[0].first);
+                std::pop_heap(cands.begin(), cands.begin()+heap_size-i, [](std::pair<const Overlap*, double>& a, std::pair<const Overlap*, double>& b) {
+                    return a.second < b.second;    // CAUTION, calulated by CalculateWeight
+                });
+            }
+            last = Clock::now();
+            GetAlignments(id, batch, uc, batch_als, batch_rs);
+            Lap(PHASE_ALIGN, last);
+            read_stat.tried += batch.size();
+            ib = 0;
+        }
 
-        auto r = GetAlignment(id, ol, uc, al);
+        auto ol = batch[ib];
+        Alignment &al = batch_als[ib];
+        bool r = batch_rs[ib];
+        ib++;
         DEBUG_printf("alignment: r = %d, q = (%zd %zd %zd),  d=%d, t = (%zd %zd %zd), d=%zd,%f\n", r,
             al.query_start, al.query_end, al.QuerySize(), ol->SameDirect(),
             al.target_start, al.target_end, al.TargetSize(), al.distance, al.Identity());
         
         if (r && !ExactFilter(al)) { 
             stat_info.aligns[0]++;
+            read_stat.accepted++;
             first_als.push_back(al);
             std::for_each(coverage.begin()+al.target_start, coverage.begin()+al.target_end, [](int& c) {c++;} );
 
@@ -468,9 +872,6 @@ bool ReadCorrect::Worker::Correct(int id, const std::unordered_map<int, const Ov
 
         if (owner_.cands_opts_.IsEndCondition(coverage, first_als.size(), num_consecu_fail)) break;
         
-        std::pop_heap(cands.begin(), cands.begin()+heap_size, [](std::pair<const Overlap*, double>& a, std::pair<const Overlap*, double>& b) {
-            return a.second < b.second;    // CAUTION, calulated by CalculateWeight
-        });
         heap_size--;
     }
 
@@ -495,18 +896,82 @@ bool ReadCorrect::Worker::Correct(int id, const std::unordered_map<int, const Ov
         }
 
 
+        last = Clock::now();
         for (auto &al : aligned_) {
             al.Rearrange();
         }
+        Lap(PHASE_REARRANGE, last);
+
+        graph_->Build(target, range, aligned_);
+        Lap(PHASE_BUILD, last);
+        graph_->Consensus();
+        Lap(PHASE_CONSENSUS, last);
+
+        // ComputeSimilarity在Consensus中调用，单独统计
+        double similarity = graph_->TakeSimilarityTime();
+        read_stat.seconds[PHASE_CONSENSUS] -= similarity;
+        read_stat.seconds[PHASE_SIMILARITY] += similarity;
+        stat_info.seconds[PHASE_CONSENSUS] -= similarity;
+        stat_info.seconds[PHASE_SIMILARITY] += similarity;
+        read_stat.used = aligned_.size();
+        return true;
+    }
+
+    return false;
+}
+
+bool ReadCorrect::Worker::CorrectWithFragments(int id, const DnaSeq& target, std::vector<std::pair<const Overlap*, double>>& cands) {
+    auto last = Clock::now();
+    size_t heap_size = cands.size();
+    std::vector<int> coverage(target.Size(), 0);
+
+    std::vector<Corrector::Fragment> fragments;
+    std::vector<std::array<size_t,2>> intervals;
+    while (heap_size > 0) {
+        auto ol = cands[0].first;
+        const auto& tread = ol->GetRead(id);
+        const auto& qread = ol->GetOtherRead(id);
+
+        read_stat.tried++;
+        read_stat.accepted++;
+        fragments.push_back({qread.id, &owner_.read_store_.GetSeq(qread.id), !ol->SameDirect(), {{qread.start, qread.end, tread.start, tread.end}}});
+        intervals.push_back({{(size_t)tread.start, (size_t)tread.end}});
+        std::for_each(coverage.begin()+tread.start, coverage.begin()+tread.end, [](int& c) {c++;} );
+
+        if (owner_.cands_opts_.IsEndCondition(coverage, fragments.size(), 0)) break;
+
+        std::pop_heap(cands.begin(), cands.begin()+heap_size, [](std::pair<const Overlap*, double>& a, std::pair<const Overlap*, double>& b) {
+            return a.second < b.second;    // CAUTION, calulated by CalculateWeight
+        });
+        heap_size--;
+    }
+    Lap(PHASE_ALIGN, last);
 
-        graph_.Build(target, range, aligned_);
-        graph_.Consensus();
+    size_t stub = 500;
+    auto range = MostEffectiveCoverage(target.Size(), intervals, stub, owner_.min_coverage_);
+    if (range[0] < range[1] && range[1] - range[0] + 2*stub >= (size_t)owner_.filter0_.min_length) {
+        range[0] -= stub;
+        range[1] += stub;
+
+        graph_->Build(target, range, fragments);
+        Lap(PHASE_BUILD, last);
+        graph_->Consensus();
+        Lap(PHASE_CONSENSUS, last);
+        read_stat.used = fragments.size();
         return true;
     }
 
     return false;
 }
 
+void ReadCorrect::Worker::SaveReadStat(std::ostream& os, int tid, const ReadStore &rd) const {
+    os << rd.QueryNameById(tid) << "\t" << rd.GetSeqLength(tid) << "\t" << read_stat.tried << "\t" << read_stat.accepted << "\t" << read_stat.used;
+    for (auto s : read_stat.seconds) {
+        os << "\t" << s;
+    }
+    os << "\n";
+}
+
 void ReadCorrect::Worker::CalculateWeight(Seq::Id id,  const DnaSeq& target, std::vector<std::pair<const Overlap*, double>>& cands) {
     std::vector<double> cand_cov_wts (target.Size()+1);
 
@@ -4,12 +4,15 @@
 #include <string>
 #include <vector>
 #include <mutex>
+#include <chrono>
+#include <memory>
 
 #include "overlap_store.hpp"
 #include "read_store.hpp"
 #include "alignment_graph.hpp"
 #include "utils/program.hpp"
 #include "align/alignment_cache.hpp"
+#include "utils/checkpoint.hpp"
 
 namespace fsa {
 class ReadCorrect : public Program {
@@ -36,6 +39,7 @@ public:
         int failures { 10 };               // f 连续失败次数
         int max_number { 200 };             //  // MAX_COV - 1
         int coverage { 80 };                    // 需要多少层数据
+        int batch { 0 };                        // b 每次一起比对的候选数目，0为比对工具的批量大小
     };
 
 protected:
@@ -43,66 +47,119 @@ protected:
     void LoadReads();
     void LoadOverlaps(const std::string &fname);
     void LoadReadIds();
+    void PrepareCheckpoint();
     void Correct();
+    void CorrectPartitioned();
     void SaveCRead(std::ostream &os, int tid, const std::string &cread);
     
     std::string OutputPath(const std::string &fname) { return output_directory_+"/"+fname; }
 
     void GroupOverlaps();
     void GroupReadIds();
+    void ScheduleReadIds();
 
     // 
+    // 纠错各阶段的耗时
+    enum Phase { PHASE_WEIGHT, PHASE_ALIGN, PHASE_REARRANGE, PHASE_BUILD, PHASE_SIMILARITY, PHASE_CONSENSUS, PHASE_SIZE };
+    static const char* PhaseName(size_t i) {
+        static const char* names[PHASE_SIZE] = {"weight", "align", "rearrange", "build", "similarity", "consensus"};
+        return names[i];
+    }
+
+    // 单条read的统计，可输出到stats_fname_
+    struct ReadStat {
+        size_t tried { 0 };         // 比对过的候选overlap数
+        size_t accepted { 0 };
+        size_t used { 0 };          // 用于构建AlignmentGraph的比对数
+        std::array<double, PHASE_SIZE> seconds {{ 0 }};
+    };
+
     struct StatInfo {
         void Merge(const StatInfo si) {
             aligns[0] += si.aligns[0];
             aligns[1] += si.aligns[1];
+            aligns[2] += si.aligns[2];
+            aligns[3] += si.aligns[3];
+            for (size_t i = 0; i < PHASE_SIZE; ++i) seconds[i] += si.seconds[i];
         }
-        std::array<int, 4> aligns {{0,0,0,0}}; // 统计执行详细比对的测试 all, succ, fails
+        std::array<int, 4> aligns {{0,0,0,0}}; // 统计比对: accepted, filtered, built from cigar, realigned after cigar
+        std::array<double, PHASE_SIZE> seconds {{ 0 }};
+    };
+
+    // per-thread utilisation, used to check the tail of the job
+    struct ThreadInfo {
+        size_t reads { 0 };
+        double busy { 0 };      // seconds spent in correcting reads
+        double finish { 0 };    // seconds from the start of Correct() to the end of the thread
     };
 
     class Worker {
     public:
-        Worker(ReadCorrect& owner) : owner_(owner) {
-            graph_.SetParameter("score", owner.score_);
-            graph_.SetParameter("min_coverage", owner.min_coverage_);
+        Worker(ReadCorrect& owner) : owner_(owner), graph_(Corrector::Create(owner.corrector_)) {
+            graph_->SetParameter("score", owner.score_);
+            graph_->SetParameter("min_coverage", owner.min_coverage_);
             aligner_.SetParameter("min_identity", owner.min_identity_);  
             aligner_.SetParameter("min_local_identity", owner.min_local_identity_);
             aligner_.SetParameter("aligner", owner_.aligner_);
         };
         ~Worker() {  }
         bool Correct(int id, const std::unordered_map<int, const Overlap*>& g, bool uc=true);
+        // Corrector自己比对read时使用，候选按overlap的坐标选取，不做两两比对
+        bool CorrectWithFragments(int id, const DnaSeq& target, std::vector<std::pair<const Overlap*, double>>& cands);
         void CalculateWeight(Seq::Id id,  const DnaSeq& target, std::vector<std::pair<const Overlap*, double>>& cands);
         bool IsCoverageEnough(const std::vector<int> &cov);
         bool ExactFilter(const Alignment& r);
         bool ExactFilter(const Alignment& r, const std::array<size_t,2>& trange);
         bool GetAlignment(Seq::Id id, const Overlap* o, bool uc, Alignment &al);
-        void Clear() {graph_.Clear(); aligned_.clear(); corrected.clear(); }
+        bool GetAlignmentWithoutAligning(Seq::Id id, const Overlap* o, bool uc, Alignment &al, bool &r);
+        void GetAlignments(Seq::Id id, const std::vector<const Overlap*> &ols, bool uc, std::vector<Alignment> &als, std::vector<bool> &rs);
+        bool GetAlignmentFromCigar(Seq::Id id, const Overlap* o, Alignment &al);
+        void Clear() {graph_->Clear(); aligned_.clear(); corrected.clear(); }
         void ClearCache() { return cache_.Clear(); }
         void ResetCache(const std::vector<Seq::Id> &ids, size_t size) { return cache_.Reset(ids, size); }
-        const std::string GetCorrected() const { return graph_.GetSequence(); }
-        void SaveReadInfos(std::ostream& os, int tid, const ReadStore &rd) { graph_.SaveReadInfos(os, tid, rd); }
+        const std::string GetCorrected() const { return graph_->GetSequence(); }
+        void SaveReadInfos(std::ostream& os, int tid, const ReadStore &rd) { graph_->SaveReadInfos(os, tid, rd); }
+        void SaveReadStat(std::ostream& os, int tid, const ReadStore &rd) const;
         StatInfo stat_info;
+        ReadStat read_stat;
+    protected:
+        typedef std::chrono::steady_clock Clock;
+        // 把上次计时以来的时间计入phase
+        void Lap(Phase phase, Clock::time_point &last) {
+            auto now = Clock::now();
+            double s = std::chrono::duration<double>(now - last).count();
+            read_stat.seconds[phase] += s;
+            stat_info.seconds[phase] += s;
+            last = now;
+        }
     protected:
         ReadCorrect& owner_;
-        AlignmentGraph graph_;
+        std::unique_ptr<Corrector> graph_;
         Aligner aligner_;
         std::vector<Alignment> aligned_;
         std::string corrected;
         AlignmentCache cache_;
+        std::vector<Aligner::Query> batch_;
+        std::vector<size_t> batch_index_;
+        std::vector<Alignment> batch_als_;
+        std::vector<bool> batch_rs_;
     };   
     friend class Worker;
 
     struct Progress {
         Progress(ReadCorrect& rc) : owner(rc) {}
-        Seq::Id Get() {
+        // sn: the serial number of the read, which is its position in the dispatching order
+        Seq::Id Get(size_t &sn) {
             auto curr = index.fetch_add(1);
             if (curr % log_block_size == 0) {
              LOG(INFO)("done %zd, all %zd", curr, owner.read_ids_.size());
             }
+            sn = curr;
             return curr < owner.read_ids_.size() ? owner.read_ids_[curr] : Seq::NID;
         }
         
-        size_t Get(std::vector<Seq::Id> &ids) {
+        // start: the serial number of ids[0]
+        size_t Get(std::vector<Seq::Id> &ids, size_t &start) {
             auto curr = index.fetch_add(1);
             if (curr < owner.group_ticks.size()-1) {
                 if (owner.group_ticks[curr] - last_log >= log_block_size) {
@@ -113,6 +170,7 @@ protected:
                 for (size_t i=owner.group_ticks[curr]; i<owner.group_ticks[curr+1]; ++i) {
                     ids[i-owner.group_ticks[curr]] = owner.grouped_ids_[i];
                 }
+                start = owner.group_ticks[curr];
                 return owner.group_ticks[curr+1] - owner.group_ticks[curr];
             } else {
                 return (size_t)0;
@@ -136,7 +194,14 @@ protected:
     }
     void Report() const {
         LOG(INFO)("alignment %d %d", stat_info_.aligns[0], stat_info_.aligns[1]);
+        if (use_cigar_) {
+            LOG(INFO)("alignment from cigar %d, realigned %d", stat_info_.aligns[2], stat_info_.aligns[3]);
+        }
+        ReportPhases();
+        ReportThreadInfos();
     }
+    void ReportPhases() const;
+    void ReportThreadInfos() const;
 protected:
     std::string filter0_opts_ {"l=2000:al=2000:alr=0.50"};
     std::string filter1_opts_ {"l=2000:al=3000:alr=0.50:aal=6000:oh=2000:ohr=0.2"};
@@ -150,13 +215,22 @@ protected:
     double min_local_identity_ { 50 };
 
     bool use_cache_ { false };
+    bool use_cigar_ { false };
+    int output_window_ { 2000 };
+    double max_memory_ { 0 };       // GB, 0 for loading all overlaps at once
+    bool append_output_ { false };  // the output files are appended by the later parts
+    bool resume_ { false };
+    int checkpoint_interval_ { 0 };
+    std::unique_ptr<Checkpoint> checkpoint_;
 
     std::string read_name_ {""};
     std::string read_name_fname_ { "" };
     int thread_size_{ 4 };
 
     std::string aligner_ { "diff" };
+    std::string corrector_ { "graph" };
     std::string aligner_parameter { "" };
+    std::string schedule_ { "order" };
     std::string score_ { "weight" };
     std::string output_directory_ {"."};
 
@@ -165,6 +239,7 @@ protected:
     std::string cread_fname_;
     std::string graph_fname_ {""};
     std::string infos_fname_ {""}; 
+    std::string stats_fname_ {""};
     
     std::vector<Seq::Id> read_ids_;
     std::vector<Seq::Id> grouped_ids_;
@@ -177,6 +252,7 @@ protected:
     std::unordered_map<int, std::unordered_map<int, const Overlap*>> groups_;
 
     StatInfo stat_info_;
+    std::vector<ThreadInfo> thread_infos_;
 };
 
 } // namespace fsa {
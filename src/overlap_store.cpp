@@ -581,5 +581,31 @@ std::string OverlapStore::ToPafLine(const Overlap &o, const StringPool::NameId&
     return oss.str();
 }
 
+void OverlapStore::ToBinary(std::ostream &os, const Overlap &o) {
+    uint32_t dsize = o.detail_.size();
+    os.write((const char*)&o.a_, sizeof(o.a_));
+    os.write((const char*)&o.b_, sizeof(o.b_));
+    os.write((const char*)&o.identity_, sizeof(o.identity_));
+    os.write((const char*)&dsize, sizeof(dsize));
+    if (dsize > 0) {
+        os.write((const char*)&o.detail_[0], sizeof(o.detail_[0])*dsize);
+    }
+}
+
+bool OverlapStore::FromBinary(std::istream &is, Overlap &o) {
+    uint32_t dsize = 0;
+    is.read((char*)&o.a_, sizeof(o.a_));
+    is.read((char*)&o.b_, sizeof(o.b_));
+    is.read((char*)&o.identity_, sizeof(o.identity_));
+    is.read((char*)&dsize, sizeof(dsize));
+    if (!is) return false;
+
+    o.detail_.resize(dsize);
+    if (dsize > 0) {
+        is.read((char*)&o.detail_[0], sizeof(o.detail_[0])*dsize);
+    }
+    return (bool)is;
+}
+
 } // namespace fsa {
 
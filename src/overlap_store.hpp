@@ -55,6 +55,15 @@ struct OverlapSet {
         overlaps.push_back(std::vector<Overlap>());
         overlaps.back().reserve(bsize);
     }
+
+    // 只能缩小
+    void Resize(size_t sz) {
+        assert(sz <= size);
+        size_t nblock = std::max<size_t>(1, (sz + bsize - 1) / bsize);
+        overlaps.resize(nblock);
+        overlaps.back().resize(sz - (nblock - 1) * bsize);
+        size = sz;
+    }
     size_t size = 0;
     size_t bsize = 10000000;
     std::vector<std::vector<Overlap>> overlaps;
@@ -76,7 +85,24 @@ public:
     template<typename C = bool(*)(const Overlap &o)>
     void Save(const std::string &fname, const std::string &type="", size_t thread_size=1, C check=[](const Overlap &o){return true;}) const; 
 
+    template<typename C = bool(*)(const Overlap &o)>
+    void LoadBinary(const std::string &fname, C check=[](const Overlap &o) { return true; });
+
     size_t Size() const { return overlaps_.Size(); }
+    void Clear() { overlaps_ = OverlapSet(); }
+
+    // 删除不满足keep的overlap，其余的顺序不变
+    template<typename C>
+    void Filter(C keep) {
+        size_t sz = 0;
+        for (size_t i = 0; i < overlaps_.Size(); ++i) {
+            if (keep(overlaps_.Get(i))) {
+                if (sz != i) overlaps_.Get(sz) = overlaps_.Get(i);
+                sz++;
+            }
+        }
+        overlaps_.Resize(sz);
+    }
     Overlap& Get(size_t i)  { return  overlaps_.Get(i); }
     const Overlap& Get(size_t i) const { return  overlaps_.Get(i); }
     // size_t Size() const { return overlaps_.size(); }
@@ -138,6 +164,10 @@ public:
     static std::string ToM4Line(const Overlap& o, const StringPool::NameId& ni);
     static std::string ToPafLine(const Overlap &o, const StringPool::NameId& ni) ;
 
+    // 二进制格式，只用于本进程的临时文件
+    static void ToBinary(std::ostream &os, const Overlap &o);
+    static bool FromBinary(std::istream &is, Overlap &o);
+
     std::string ToM4aLine1(const Overlap& o) const { return ToM4aLine(o,  StringPool::UnsafeNameId(string_pool_)); }
     std::string ToM4Line1(const Overlap& o) const { return ToM4Line(o,  StringPool::UnsafeNameId(string_pool_)); }
     std::string ToPafLine1(const Overlap &o) const { return ToPafLine(o,  StringPool::UnsafeNameId(string_pool_)); }
@@ -457,6 +487,21 @@ void OverlapStore::Save(const std::string &fname, const std::string &type, size_
     }
 }
 
+template<typename C>
+void OverlapStore::LoadBinary(const std::string &fname, C check) {
+    std::ifstream in(fname, std::ios::binary);
+    if (in.is_open()) {
+        Overlap o;
+        while (FromBinary(in, o)) {
+            if (check(o)) {
+                overlaps_.Add(o);
+            }
+        }
+    } else {
+        LOG(ERROR)("Failed to load file: %s", fname.c_str());
+    }
+}
+
 template<typename C>
 void OverlapStore::LoadFileTxtMt(const std::string &fname, C check, size_t thread_size) {
     std::vector<std::string> files = GetLineFromFile(fname);
@@ -1,7 +1,12 @@
 #include "contig_phaser.hpp"
 
+#include <mutex>
+#include <numeric>
+#include <sstream>
+
 #include "../read_store.hpp"
 #include "../overlap_store.hpp"
+#include "../utils/ordered_writer.hpp"
 
 #include "phs_options.hpp"
 #include "phs_dataset.hpp"
@@ -9,8 +14,8 @@
 
 namespace fsa {
 
-ContigPhaser::ContigPhaser(Seq::Id ctg, const PhsDataset& dataset, PhsOptions &opts) 
- : ctg_(ctg), dataset_(dataset), rd_store_(dataset_.rd_store_), ol_store_(dataset_.ol_store_), opts_(opts) {
+ContigPhaser::ContigPhaser(Seq::Id ctg, const PhsDataset& dataset, PhsOptions &opts, std::ostream* of_vars) 
+ : ctg_(ctg), dataset_(dataset), rd_store_(dataset_.rd_store_), ol_store_(dataset_.ol_store_), opts_(opts), of_vars_(of_vars) {
 
     // 
     Phase();
@@ -18,12 +23,9 @@ ContigPhaser::ContigPhaser(Seq::Id ctg, const PhsDataset& dataset, PhsOptions &o
 
 void ContigPhaser::Phase() {
 
-    variants_.assign(GetReadStore().GetSeqLength(ctg_), Variant());
-
     read_infos_ = CollectReads(ctg_);
-    FindVariantsInContig(ctg_, read_infos_, variants_);
-    ConfirmVariants(variants_);
-    FindVariantsInReads(read_infos_, variants_);
+    FindVariantsInContig(ctg_, read_infos_);
+    FindVariantsInReads(read_infos_);
     ClassifyReads(read_infos_);
 }
 
@@ -70,184 +72,297 @@ std::unordered_map<ReadOffset, ReadInfo> ContigPhaser::CollectReads(Seq::Id ctg)
 }
 
 
-void ContigPhaser::FindVariantsInContig(Seq::Id c, const std::unordered_map<ReadOffset, ReadInfo>& read_infos, std::vector<Variant> &vars) {
-    const int C = opts_.snp_match_length_;
-    const int variant_type = opts_.variant_type_;
-    
-    //const auto &ctg = rd_store_.GetSeq(c);  
+std::vector<std::array<int,2>> ContigPhaser::SplitWindows(size_t ctg_len) const {
+    std::vector<std::array<int,2>> windows;
+    for (size_t s = 0; s < ctg_len; s += opts_.window_size_) {
+        windows.push_back({(int)s, (int)std::min<size_t>(s + opts_.window_size_, ctg_len)});
+    }
+    return windows;
+}
+
+size_t ContigPhaser::WindowOf(int pos) const {
+    return (size_t)pos / opts_.window_size_;
+}
+
+template<typename F>
+void ContigPhaser::RunInParallel(size_t size, F func) {
+    std::atomic<size_t> index { 0 };
+    auto work_func = [this, &index, size, &func](size_t thread_id) {
+        if (thread_id > 0) opts_.curr_thread_size.fetch_add(1);
+        for (size_t i = index.fetch_add(1); i < size; i = index.fetch_add(1)) {
+            func(i);
+        }
+        if (thread_id > 0) opts_.curr_thread_size.fetch_add(-1);
+    };
+
+    if (size > 1) {
+        // 窗口都已领取后不再启动新线程
+        AutoThreadRun(work_func, [this, &index, size]() {
+            return index < size && opts_.curr_thread_size < (size_t)opts_.thread_size_;
+        });
+    } else {
+        work_func(0);
+    }
+}
+
+void ContigPhaser::FindVariantsInContig(Seq::Id c, const std::unordered_map<ReadOffset, ReadInfo>& read_infos) {
+    // 每个窗口单独累计和它相交的read，确认后只保留候选位点，内存与窗口大小相关，与contig长度无关。
+    // 插入可能落在比对区间外的一个位置上，因此区间两端各扩展一个碱基
+    const int ctg_len = (int)GetReadStore().GetSeqLength(c);
+    auto windows = SplitWindows(ctg_len);
+    std::vector<std::vector<const Overlap*>> window_ols(windows.size());
     for (auto &iter : read_infos) {
         const Overlap& o = *(iter.second.o);
         assert(o.b_.id == c);
-        
-        const auto &rd = rd_store_.GetSeq(o.a_.id); 
-        const auto &ctg = rd_store_.GetSeq(c); 
-        size_t ctg_off = 0;
-        size_t rd_off = 0;
-        for (const auto &d : o.detail_) {
-            switch (d.type) {
-            case 'M':
-                if (variant_type & VARIANT_TYPE_M) {
-                    if (d.len >= C) {
-                        for (int i=C/2; i<d.len-C/2; ++i) {
-                            size_t ctg_i = o.b_.strand == 0 ? o.b_.start+ctg_off+i : o.b_.end-ctg_off-i-1;
-                            size_t rd_i = o.a_.strand == 0 ? o.a_.start+rd_off+i : o.a_.end-rd_off-i-1;
+        size_t last = WindowOf(std::min<int>(o.b_.end, ctg_len - 1));
+        for (size_t w = WindowOf(std::max(0, o.b_.start - 1)); w <= last; ++w) {
+            window_ols[w].push_back(&o);
+        }
+    }
+
+    // 按窗口顺序输出到of_vars_，最多暂存thread_size_个先完成的窗口
+    OrderedWriter writer({of_vars_}, (size_t)std::max(opts_.thread_size_, 1));
+
+    std::vector<std::vector<int>> window_positions(windows.size());
+    std::vector<std::vector<Variant>> window_sites(windows.size());
+    RunInParallel(windows.size(), [&](size_t w) {
+        std::vector<Variant> pileup(windows[w][1] - windows[w][0]);
+        for (auto o : window_ols[w]) {
+            FindVariantsInWindow(*o, windows[w], pileup);
+        }
+
+        for (size_t i = 0; i < pileup.size(); ++i) {
+            pileup[i].Comfirm(opts_.cov_opts_);
+            if (pileup[i].Valid()) {
+                window_positions[w].push_back(windows[w][0] + (int)i);
+                window_sites[w].push_back(pileup[i]);
+            }
+        }
 
-                            //uint8_t ctg_b = ctg[ctg_i];
-                            uint8_t rd_b = o.a_.strand == o.b_.strand ? rd[rd_i] : (3 - rd[rd_i]);
-                            
-                            bool s = true;
-                            for (int ii = i - C/2; ii < i+C/2+1; ++ii) {
-                                if (ii != i) {
-                                    size_t ctg_i = o.b_.strand == 0 ? o.b_.start+ctg_off+ii : o.b_.end-ctg_off-ii-1;
-                                    size_t rd_i = o.a_.strand == 0 ? o.a_.start+rd_off+ii : o.a_.end-rd_off-ii-1;
+        if (of_vars_ != nullptr) {
+            std::ostringstream oss;
+            DumpVariants(oss, windows[w][0], pileup);
+            writer.Put(w, {oss.str()});
+        }
+    });
 
-                                    uint8_t ctg_b = ctg[ctg_i];
-                                    uint8_t rd_b = o.a_.strand == o.b_.strand ? rd[rd_i] : (3 - rd[rd_i]);
-                                    if (ctg_b != rd_b) {
-                                        s = false;
-                                        break;
-                                    }
+    for (size_t w = 0; w < windows.size(); ++w) {
+        site_positions_.insert(site_positions_.end(), window_positions[w].begin(), window_positions[w].end());
+        sites_.insert(sites_.end(), window_sites[w].begin(), window_sites[w].end());
+    }
+}
+
+void ContigPhaser::FindVariantsInWindow(const Overlap &o, const std::array<int,2> &win, std::vector<Variant> &pileup) {
+    const int C = opts_.snp_match_length_;
+    const int variant_type = opts_.variant_type_;
+    auto in_window = [&win](size_t i) { return (int)i >= win[0] && (int)i < win[1]; };
+
+    thread_local std::vector<uint8_t> bases;
+    thread_local std::vector<uint8_t> matched;
+
+    const auto &rd = rd_store_.GetSeq(o.a_.id); 
+    const auto &ctg = rd_store_.GetSeq(o.b_.id); 
+    size_t ctg_off = 0;
+    size_t rd_off = 0;
+    for (const auto &d : o.detail_) {
+        switch (d.type) {
+        case 'M':
+            if (variant_type & VARIANT_TYPE_M) {
+                if (d.len >= C) {
+                    // 落在窗口中的i的范围[ib, ie)
+                    long long ib = C/2;
+                    long long ie = d.len-C/2;
+                    if (o.b_.strand == 0) {
+                        long long base = o.b_.start + (long long)ctg_off;
+                        ib = std::max<long long>(ib, win[0] - base);
+                        ie = std::min<long long>(ie, win[1] - base);
+                    } else {
+                        long long base = o.b_.end - (long long)ctg_off - 1;
+                        ib = std::max<long long>(ib, base - win[1] + 1);
+                        ie = std::min<long long>(ie, base - win[0] + 1);
+                    }
 
-                                }
+                    if (ib < ie) {
+                        // 每个碱基只解码一次。位置i两侧各C/2个碱基都匹配时才计数，用滑动窗口统计匹配数
+                        const long long kb = ib - C/2;
+                        const long long ke = ie + C/2;
+                        bases.resize(ke - kb);
+                        matched.resize(ke - kb);
+                        for (long long k = kb; k < ke; ++k) {
+                            size_t ctg_k = o.b_.strand == 0 ? o.b_.start+ctg_off+k : o.b_.end-ctg_off-k-1;
+                            size_t rd_k = o.a_.strand == 0 ? o.a_.start+rd_off+k : o.a_.end-rd_off-k-1;
+                            bases[k-kb] = o.a_.strand == o.b_.strand ? rd[rd_k] : (3 - rd[rd_k]);
+                            matched[k-kb] = ctg[ctg_k] == bases[k-kb];
+                        }
 
+                        int count = std::accumulate(matched.begin(), matched.begin() + 2*(C/2) + 1, 0);
+                        for (long long i = ib; i < ie; ++i) {
+                            if (i > ib) {
+                                count += matched[i+C/2-kb] - matched[i-C/2-1-kb];
+                            }
+                            if (count - matched[i-kb] == 2*(C/2)) {
+                                size_t ctg_i = o.b_.strand == 0 ? o.b_.start+ctg_off+i : o.b_.end-ctg_off-i-1;
+                                pileup[ctg_i - win[0]].IncM(bases[i-kb]);
                             }
-                            if (s) vars[ctg_i].IncM(rd_b);
                         }
                     }
                 }
-                ctg_off += d.len;
-                rd_off += d.len;
-                break;
-
-            case 'D':
-                if (variant_type & VARIANT_TYPE_D) {
-                    for (int i=0; i<d.len; ++i) {
-                        size_t ctg_i = o.b_.strand == 0 ? o.b_.start+ctg_off+i : o.b_.end-ctg_off-i-1;
-                        vars[ctg_i].IncD();
-                    }
+            }
+            ctg_off += d.len;
+            rd_off += d.len;
+            break;
+
+        case 'D':
+            if (variant_type & VARIANT_TYPE_D) {
+                for (int i=0; i<d.len; ++i) {
+                    size_t ctg_i = o.b_.strand == 0 ? o.b_.start+ctg_off+i : o.b_.end-ctg_off-i-1;
+                    if (in_window(ctg_i)) pileup[ctg_i - win[0]].IncD();
                 }
-                ctg_off += d.len;
-                break;
+            }
+            ctg_off += d.len;
+            break;
 
-            case 'I':
-                if (variant_type & VARIANT_TYPE_I) {
-                    size_t ctg_i = o.b_.strand == 0 ? o.b_.start+ctg_off+0 : o.b_.end-ctg_off-0-1;
+        case 'I':
+            if (variant_type & VARIANT_TYPE_I) {
+                size_t ctg_i = o.b_.strand == 0 ? o.b_.start+ctg_off+0 : o.b_.end-ctg_off-0-1;
+                if (in_window(ctg_i)) {
                     size_t rd_i = o.a_.strand == 0 ? o.a_.start+rd_off+0 : o.a_.end-rd_off-0-1;
                     uint8_t rd_b = o.a_.strand == o.b_.strand ? rd[rd_i] : 3 - rd[rd_i];
-                    vars[ctg_i].IncI(rd_b);
+                    pileup[ctg_i - win[0]].IncI(rd_b);
                 }
-                rd_off += d.len;
-                break;
-
-            case '=':
-            default:
-                LOG(ERROR)("Not support cigar type '%c'.", d.type);
             }
-        }
+            rd_off += d.len;
+            break;
 
-        // 计算Coverage
-        for (auto i = o.b_.start; i < o.b_.end; ++i) {
-            vars[i].IncCov();
+        case '=':
+        default:
+            LOG(ERROR)("Not support cigar type '%c'.", d.type);
         }
-        
     }
-}
 
-void ContigPhaser::ConfirmVariants(std::vector<Variant> &vars) {
-    for (size_t i=0; i<vars.size(); ++i) {
-        vars[i].Comfirm(opts_.cov_opts_);
+    // 计算Coverage
+    for (auto i = std::max(o.b_.start, win[0]); i < std::min(o.b_.end, win[1]); ++i) {
+        pileup[i - win[0]].IncCov();
     }
 }
 
+const Variant& ContigPhaser::GetSite(int pos) const {
+    auto it = std::lower_bound(site_positions_.begin(), site_positions_.end(), pos);
+    assert(it != site_positions_.end() && *it == pos);
+    return sites_[it - site_positions_.begin()];
+}
+
+void ContigPhaser::FindVariantsInReads(std::unordered_map<ReadOffset, ReadInfo>& read_infos) {
+    // read之间相互独立，按起始位置所在的窗口分批处理
+    std::vector<std::vector<ReadInfo*>> window_reads(SplitWindows(GetReadStore().GetSeqLength(ctg_)).size());
+    for (auto &iter : read_infos) {
+        window_reads[WindowOf(iter.second.o->b_.start)].push_back(&iter.second);
+    }
 
-void ContigPhaser::FindVariantsInReads(std::unordered_map<ReadOffset, ReadInfo>& read_infos, const std::vector<Variant> &vars) {
+    RunInParallel(window_reads.size(), [this, &window_reads](size_t w) {
+        for (auto ri : window_reads[w]) {
+            FindVariantsInRead(*ri);
+        }
+    });
+}
+
+void ContigPhaser::FindVariantsInRead(ReadInfo &ri) {
     const int C = opts_.snp_match_length_;
     const int variant_type = opts_.variant_type_;
-    for (auto &iter : read_infos) {
-        const Overlap& o = *(iter.second.o);
+    const Overlap& o = *(ri.o);
+
+    // read覆盖的候选位点，插入可能落在比对区间外的一个位置上
+    const int span_start = o.b_.start - 1;
+    const int span_end = o.b_.end + 1;
+    auto first = std::lower_bound(site_positions_.begin(), site_positions_.end(), span_start);
+    auto last = std::lower_bound(first, site_positions_.end(), span_end);
+    thread_local std::vector<const Variant*> span;
+    span.assign(span_end - span_start, nullptr);
+    for (auto it = first; it != last; ++it) {
+        span[*it - span_start] = &sites_[it - site_positions_.begin()];
+    }
+    auto site = [span_start](size_t i) -> const Variant* {
+        int k = (int)i - span_start;
+        return k >= 0 && k < (int)span.size() ? span[k] : nullptr;
+    };
 
-        std::unordered_map<int, std::array<int,5>> cand_vars;
+    std::unordered_map<int, std::array<int,5>> cand_vars;
 
-        const auto &rd = rd_store_.GetSeq(o.a_.id); 
-        size_t ctg_off = 0;
-        size_t rd_off = 0;
-        for (const auto &d : o.detail_) {
+    const auto &rd = rd_store_.GetSeq(o.a_.id); 
+    size_t ctg_off = 0;
+    size_t rd_off = 0;
+    for (const auto &d : o.detail_) {
 
-            switch (d.type) {
-            case 'M':
-                if (variant_type & VARIANT_TYPE_M) {
-                    if (d.len >= C) {
-                        for (int i=C/2; i<d.len-C/2; ++i) {
-                            size_t ctg_i = o.b_.strand == 0 ? o.b_.start+ctg_off+i : o.b_.end-ctg_off-i-1;
+        switch (d.type) {
+        case 'M':
+            if (variant_type & VARIANT_TYPE_M) {
+                if (d.len >= C) {
+                    for (int i=C/2; i<d.len-C/2; ++i) {
+                        size_t ctg_i = o.b_.strand == 0 ? o.b_.start+ctg_off+i : o.b_.end-ctg_off-i-1;
+                        auto v = site(ctg_i);
+                        if (v != nullptr) {
                             size_t rd_i = o.a_.strand == 0 ? o.a_.start+rd_off+i : o.a_.end-rd_off-i-1;
-
                             uint8_t rd_b = o.a_.strand == o.b_.strand ? rd[rd_i] : 3 - rd[rd_i];
 
-                            if (vars[ctg_i].Valid()) {
-                                if (vars[ctg_i].AtM(rd_b)) {
-                                    cand_vars[ctg_i] = {(int)ctg_i, (int)rd_i, rd_b, vars[ctg_i].Offset(rd_b), -1 };
-                                    //iter.second.vars.push_back({(int)ctg_i, (int)rd_i, rd_b, vars[ctg_i].Offset(rd_b), -1 });
-                                } 
-                            }
+                            if (v->AtM(rd_b)) {
+                                cand_vars[ctg_i] = {(int)ctg_i, (int)rd_i, rd_b, v->Offset(rd_b), -1 };
+                                //ri.vars.push_back({(int)ctg_i, (int)rd_i, rd_b, vars[ctg_i].Offset(rd_b), -1 });
+                            } 
                         }
                     }
                 }
-                ctg_off += d.len;
-                rd_off += d.len;
-                break;
-
-            case 'D':
-                if (variant_type & VARIANT_TYPE_D) {
-                    for (int i=0; i<d.len; ++i) {
-                        size_t ctg_i = o.b_.strand == 0 ? o.b_.start+ctg_off+i : o.b_.end-ctg_off-i-1;
-                        size_t rd_i = o.a_.strand == 0 ? o.a_.start+rd_off+i : o.a_.end-rd_off-i-1;
-                        if (vars[ctg_i].AtD()) {
-                            //iter.second.vars.push_back({(int)ctg_i, (int)rd_i, (uint8_t)8});
-                            cand_vars[ctg_i] = {(int)ctg_i, (int)rd_i, (uint8_t)8, vars[ctg_i].Offset(8), -1};
-                        }
-                    }
-                }
-                ctg_off += d.len;
-                break;
-
-            case 'I':
-                if (variant_type & VARIANT_TYPE_I) {
-                    size_t ctg_i = o.b_.strand == 0 ? o.b_.start+ctg_off+0 : o.b_.end-ctg_off-0-1;
-                    size_t rd_i = o.a_.strand == 0 ? o.a_.start+rd_off+0 : o.a_.end-rd_off-0-1;
-                    uint8_t rd_b = o.a_.strand == o.b_.strand ? rd[rd_i] : 3 - rd[rd_i];
-                    if (vars[ctg_i].AtI(rd_b)) {
-                        //iter.second.vars.push_back({(int)ctg_i, (int)rd_i, rd_b+4});
-                        cand_vars[ctg_i] = {(int)ctg_i, (int)rd_i, rd_b+4, vars[ctg_i].Offset(rd_b+4), -1};
+            }
+            ctg_off += d.len;
+            rd_off += d.len;
+            break;
+
+        case 'D':
+            if (variant_type & VARIANT_TYPE_D) {
+                for (int i=0; i<d.len; ++i) {
+                    size_t ctg_i = o.b_.strand == 0 ? o.b_.start+ctg_off+i : o.b_.end-ctg_off-i-1;
+                    size_t rd_i = o.a_.strand == 0 ? o.a_.start+rd_off+i : o.a_.end-rd_off-i-1;
+                    auto v = site(ctg_i);
+                    if (v != nullptr && v->AtD()) {
+                        //ri.vars.push_back({(int)ctg_i, (int)rd_i, (uint8_t)8});
+                        cand_vars[ctg_i] = {(int)ctg_i, (int)rd_i, (uint8_t)8, v->Offset(8), -1};
                     }
                 }
-                rd_off += d.len;
-                break;
-
-            case '=':
-            default:
-                LOG(ERROR)("Not support cigar type '%c'.", d.type);
             }
-            
-        }
-
-        for (size_t i = o.b_.start; i < (size_t)o.b_.end; ++i) {
-            if (vars[i].Valid()) {
-                auto it = cand_vars.find(i);
-                if (it != cand_vars.end()) {
-                    iter.second.vars.push_back(it->second);
-                } else {
-                    iter.second.vars.push_back({int(i), -1, -1, -1, -1});
+            ctg_off += d.len;
+            break;
+
+        case 'I':
+            if (variant_type & VARIANT_TYPE_I) {
+                size_t ctg_i = o.b_.strand == 0 ? o.b_.start+ctg_off+0 : o.b_.end-ctg_off-0-1;
+                size_t rd_i = o.a_.strand == 0 ? o.a_.start+rd_off+0 : o.a_.end-rd_off-0-1;
+                uint8_t rd_b = o.a_.strand == o.b_.strand ? rd[rd_i] : 3 - rd[rd_i];
+                auto v = site(ctg_i);
+                if (v != nullptr && v->AtI(rd_b)) {
+                    //ri.vars.push_back({(int)ctg_i, (int)rd_i, rd_b+4});
+                    cand_vars[ctg_i] = {(int)ctg_i, (int)rd_i, rd_b+4, v->Offset(rd_b+4), -1};
                 }
             }
+            rd_off += d.len;
+            break;
+
+        case '=':
+        default:
+            LOG(ERROR)("Not support cigar type '%c'.", d.type);
         }
- 
+        
     }
 
-
+    for (auto it = std::lower_bound(first, last, o.b_.start); it != last && *it < o.b_.end; ++it) {
+        auto cand = cand_vars.find(*it);
+        if (cand != cand_vars.end()) {
+            ri.vars.push_back(cand->second);
+        } else {
+            ri.vars.push_back({*it, -1, -1, -1, -1});
+        }
+    }
 }
 
 
-
 std::unordered_map<ReadOffset, std::unordered_set<ReadOffset>> ContigPhaser::GroupReads(std::unordered_map<ReadOffset, ReadInfo>& read_infos, int shared_variants) {
     std::vector<const ReadInfo*> sorted_read_infos;
     sorted_read_infos.reserve(read_infos.size());
@@ -259,23 +374,30 @@ std::unordered_map<ReadOffset, std::unordered_set<ReadOffset>> ContigPhaser::Gro
         return a->o->b_.start < b->o->b_.start || (a->o->b_.start == b->o->b_.start && a->o->b_.end < b->o->b_.end);
     });
 
-    std::unordered_set<ReadOffset> discards;
-    std::unordered_map<ReadOffset, std::unordered_set<ReadOffset>> groups;
-    for (size_t i=0; i<sorted_read_infos.size(); ++i) {
-        
-        auto &iri = *sorted_read_infos[i];
-        ReadOffset iid = ReadOffset::Make(*sorted_read_infos[i]->o);
-        if (discards.find(iid) != discards.end()) continue;   
+    // read按起始位置排序后扫描：read j的起点超过read i的终点后，后面的read都不再与i相交。
+    // 共享位点的计数与discards无关，按窗口并行计算每个read的候选。丢弃read依赖处理顺序，随后串行完成
+    const size_t size = sorted_read_infos.size();
+    std::vector<std::vector<size_t>> candidates(size);
+    std::vector<size_t> window_begins(SplitWindows(GetReadStore().GetSeqLength(ctg_)).size() + 1, size);
+    for (size_t i = size; i > 0; --i) {
+        window_begins[WindowOf(sorted_read_infos[i-1]->o->b_.start)] = i - 1;
+    }
+    for (size_t w = window_begins.size() - 1; w > 0; --w) {
+        window_begins[w-1] = std::min(window_begins[w-1], window_begins[w]);
+    }
 
-        for (size_t j=i+1; j < sorted_read_infos.size(); ++j) {
+    auto var_less = [](const std::array<int,5> &v, int pos) { return v[0] < pos; };
+    RunInParallel(window_begins.size() - 1, [&](size_t w) {
+        for (size_t i = window_begins[w]; i < window_begins[w+1]; ++i) {
+            auto &iri = *sorted_read_infos[i];
 
-            auto &jri = *sorted_read_infos[j];
-            ReadOffset jid = ReadOffset::Make(*sorted_read_infos[j]->o);
-            if (discards.find(jid) != discards.end()) continue;   
+            for (size_t j=i+1; j < size && sorted_read_infos[j]->o->b_.start <= iri.o->b_.end; ++j) {
 
-            if (jri.o->b_.start <= iri.o->b_.end) {
+                auto &jri = *sorted_read_infos[j];
+                
+                // 位点按位置排序，i中位于j起点之前的位点不会共享
                 std::array<int, 2> count {0, 0};
-                size_t ii = 0; 
+                size_t ii = std::lower_bound(iri.vars.begin(), iri.vars.end(), jri.o->b_.start, var_less) - iri.vars.begin(); 
                 size_t ji = 0;
                 while (ii < iri.vars.size() && ji < jri.vars.size()) {
                     int ictg = iri.vars[ii][0];
@@ -300,22 +422,43 @@ std::unordered_map<ReadOffset, std::unordered_set<ReadOffset>> ContigPhaser::Gro
 
                 if (count[0] >= shared_variants) {
                     if (dataset_.HasAva() && !dataset_.QueryAva(iri.id, jri.id)) continue;
-                    groups[jid].insert(iid);
-                    groups[iid].insert(jid);
+                    candidates[i].push_back(j);
+                }
+            }
+        }
+    });
 
+    std::vector<ReadOffset> ids(size);
+    for (size_t i = 0; i < size; ++i) {
+        ids[i] = ReadOffset::Make(*sorted_read_infos[i]->o);
+    }
 
-                    if ((int)groups[jid].size() >= opts_.cov_opts_.valid_range[1]*2) {
-                        discards.insert(jid);
-                        groups.erase(jid);
-                    }
-                    if ((int)groups[iid].size() >= opts_.cov_opts_.valid_range[1]*2) {
-                        discards.insert(iid);
-                        groups.erase(iid);
-                    }
-                }
+    std::vector<bool> discards(size, false);
+    std::unordered_map<ReadOffset, std::unordered_set<ReadOffset>> groups;
+    for (size_t i=0; i<size; ++i) {
+        
+        const ReadOffset &iid = ids[i];
+        if (discards[i]) continue;   
+
+        for (auto j : candidates[i]) {
+            const ReadOffset &jid = ids[j];
+            if (discards[j]) continue;   
 
+            auto &jgroup = groups[jid];
+            jgroup.insert(iid);
+            groups[iid].insert(jid);
+
+
+            if ((int)jgroup.size() >= opts_.cov_opts_.valid_range[1]*2) {
+                discards[j] = true;
+                groups.erase(jid);
+            }
+            if ((int)groups[iid].size() >= opts_.cov_opts_.valid_range[1]*2) {
+                discards[i] = true;
+                groups.erase(iid);
             }
         }
+        std::vector<size_t>().swap(candidates[i]);
     }
     return groups;
 }
@@ -425,7 +568,7 @@ void ContigPhaser::DumpReadInfos(std::ostream& of) const {
         for (auto &v : ri.vars) {
             int choice = v[3];
             if (choice == 0 || choice == 1) {
-                of << " " <<  v[0] << "|" << int(variants_[v[0]].var[choice]) << "|" << v[1] << "|" << v[2];
+                of << " " <<  v[0] << "|" << int(GetSite(v[0]).var[choice]) << "|" << v[1] << "|" << v[2];
             } else {
                 of << " " <<  v[0] << "|" << -1 << "|" << v[1] << "|" << v[2];
             }
@@ -434,17 +577,17 @@ void ContigPhaser::DumpReadInfos(std::ostream& of) const {
     }
 } 
 
-void ContigPhaser::DumpVariants(std::ostream& of) const {
+void ContigPhaser::DumpVariants(std::ostream& of, int start, const std::vector<Variant> &pileup) const {
     const auto & cname = dataset_.rd_store_.QueryNameById(ctg_);
-    for (size_t i=0; i<variants_.size(); ++i) {
-        if (true || variants_[i].Valid()) {
+    for (size_t i=0; i<pileup.size(); ++i) {
+        if (true || pileup[i].Valid()) {
             of << cname << " ";
-            of << i;
+            of << start + i;
 
             for (size_t j=0; j<10; ++j) {
-                of << " " << variants_[i].counts[j];
+                of << " " << pileup[i].counts[j];
             }
-            of << " " << variants_[i].Valid() << "\n";
+            of << " " << pileup[i].Valid() << "\n";
         }
     }
 }
@@ -17,33 +17,47 @@ class PhsDataset;
 
 class ContigPhaser {
 public:
-    ContigPhaser(Seq::Id ctg, const PhsDataset& dataset, PhsOptions &opts);
+    // of_vars不为空时，在检测变异的过程中按位置顺序输出每个碱基的计数
+    ContigPhaser(Seq::Id ctg, const PhsDataset& dataset, PhsOptions &opts, std::ostream* of_vars=nullptr);
 
     void Phase();
 
     std::unordered_map<ReadOffset, ReadInfo> CollectReads(Seq::Id ctg);
-    void FindVariantsInContig(Seq::Id c, const std::unordered_map<ReadOffset, ReadInfo>& read_infos, std::vector<Variant> &vars);
-    void ConfirmVariants(std::vector<Variant> &vars);
-    void FindVariantsInReads(std::unordered_map<ReadOffset, ReadInfo>& read_infos, const std::vector<Variant> &vars);
+    void FindVariantsInContig(Seq::Id c, const std::unordered_map<ReadOffset, ReadInfo>& read_infos);
+    void FindVariantsInReads(std::unordered_map<ReadOffset, ReadInfo>& read_infos);
     // return ignored overlaps {iid, jid}
     std::unordered_map<ReadOffset, std::unordered_set<ReadOffset>> GroupReads(std::unordered_map<ReadOffset, ReadInfo>& read_infos, int shared);
     void ClassifyReads(std::unordered_map<ReadOffset, ReadInfo>& read_infos);   
 
-    void DumpVariants(std::ostream& of) const;
     void DumpReadInfos(std::ostream& of) const;
     void DumpInconsistent(std::ostream& of) const;
     void DumpConsistent(std::ostream& of) const;
 protected:
     const ReadStore& GetReadStore() const { return dataset_.rd_store_; }
 
+    // contig被切成长度为opts_.window_size_的窗口[start, end)，窗口内的工作由当前线程和空闲线程并行处理
+    std::vector<std::array<int,2>> SplitWindows(size_t ctg_len) const;
+    size_t WindowOf(int pos) const;
+    template<typename F>
+    void RunInParallel(size_t size, F func);
+
+    // 只累计o在窗口win中的位置，pileup[0]对应位置win[0]
+    void FindVariantsInWindow(const Overlap &o, const std::array<int,2> &win, std::vector<Variant> &pileup);
+    void DumpVariants(std::ostream& of, int start, const std::vector<Variant> &pileup) const;
+    void FindVariantsInRead(ReadInfo &ri);
+    const Variant& GetSite(int pos) const;
+
 protected:
     Seq::Id ctg_;
     const PhsDataset &dataset_;
     const ReadStore &rd_store_;
     const OverlapStore &ol_store_;
     PhsOptions &opts_;
+    std::ostream* of_vars_;
 
-    std::vector<Variant> variants_;
+    // 候选位点，按位置排序。只保存被确认的位点，不保存整个contig的计数
+    std::vector<int> site_positions_;
+    std::vector<Variant> sites_;
     std::unordered_map<ReadOffset, ReadInfo> read_infos_;
     std::unordered_map<ReadOffset, std::vector<PhaseItem>> consistent_;
     std::unordered_map<ReadOffset, std::vector<PhaseItem>> inconsistent_;
@@ -1,5 +1,6 @@
 #include "local_phaser.hpp"
 #include <algorithm>
+#include <iterator>
 
 #include "read_haplotype.hpp"
 #include "../read_store.hpp"
@@ -81,8 +82,15 @@ auto LocalPhaser::Group::SelectCentroids() const -> std::vector<Centroid>   {
     std::vector<std::array<int,3>> vscores ((*queries.begin())->vars.size(), {0, 0, 0});
 
     for (auto q : queries) {
-        for (size_t i = 0; i < vscores.size(); ++i) {
-            vscores[i][1 + q->vars[i]]++;
+        q->bits.ForEach([&vscores](size_t i, int v) {
+            vscores[i][1 + v]++;
+        });
+    }
+
+    std::vector<int> weights(vscores.size(), 0);
+    for (size_t i = 0; i < vscores.size(); ++i) {
+        if (vscores[i][0] != 0 && vscores[i][2] != 0) {
+            weights[i] = vscores[i][0] + vscores[i][2] - std::abs(vscores[i][0] - vscores[i][2]);
         }
     }
 
@@ -95,13 +103,9 @@ auto LocalPhaser::Group::SelectCentroids() const -> std::vector<Centroid>   {
     double best_score0 = 0;
     for (auto q : qs) {
         double score = 0.0;
-        for (size_t i = 0; i < q->vars.size(); ++i) {
-            if (q->vars[i] != 0) {
-                if (vscores[i][0] != 0 && vscores[i][2] != 0) {
-                    score += vscores[i][0] + vscores[i][2] - std::abs(vscores[i][0] - vscores[i][2]);
-                }
-            }
-        }
+        q->bits.ForEach([&score, &weights](size_t i, int) {
+            score += weights[i];
+        });
         if (centroids[0] == nullptr || score > best_score0) {
             centroids[0] = q;
             best_score0 = score;
@@ -264,13 +268,11 @@ std::vector<std::array<size_t,3>> LocalPhaser::Group::Centroid::CombineRange(con
 std::vector<std::array<size_t,2>> LocalPhaser::Group::Centroid::GetRangeLink(const std::vector<std::array<size_t,3>>& ranges, const std::vector<int> &cs, const Group& group, double rate, int count) {
  
     std::vector<std::array<size_t,2>> linkmaps(ranges.size()*ranges.size(), {0, 0});
+    BitVars cbits(cs);
     for (auto q : group.queries) {
         std::vector<std::array<size_t,3>> bs(ranges.size());
         for (size_t ir = 0; ir < ranges.size(); ++ir) {
-            std::array<size_t, 3> stat = {0, 0, 0};
-            for (size_t p = ranges[ir][0]; p < ranges[ir][1]; ++p) {
-                stat[cs[p] * q->vars[p] + 1] += 1;
-            }
+            auto stat = cbits.Stat(q->bits, ranges[ir][0], ranges[ir][1]);
             bs[ir] = stat;
 
             DEBUG_local_printf("ToC: %s | %zd = %d %d\n", local_read_store->QueryNameById(q->query->id).c_str(), ir, stat[0], stat[2]);
@@ -299,28 +301,23 @@ auto LocalPhaser::Group::Centroid::Compare(const Query &q) const -> CompareResul
     assert(locs.size() == q.vars.size());
 
     CompareResult rs;
-    double d = 0.0;
-    //for (size_t i = 0; i < locs.size(); ++i) {
-    for (size_t i = range[0]; i < range[1]; ++i) {
-        if (locs[i].cov > 0) {
-            rs.asize ++;
-        }
-        if (q.vars[i] != 0) {
-            rs.bsize ++;
-        }
-
-        if (locs[i].cov > 0 && q.vars[i] != 0) {
-            rs.common_size ++;
+    auto stat = bits.Stat(q.bits, range[0], range[1]);
+    rs.asize = bits.Count(range[0], range[1]);
+    rs.bsize = q.bits.Count(range[0], range[1]);
+    rs.common_size = stat[0] + stat[2];
+    rs.same = stat[2];
+    rs.diff = stat[0];
+    return rs;
+}
 
-            auto v = locs[i].accu <= 0 ? -1 : 1;
-            if (v * q.vars[i] > 0) {
-                rs.same ++;
-            } else {
-                rs.diff ++;
-            }
+std::vector<int> LocalPhaser::Group::Centroid::Signs(const std::vector<Loc>& ls) {
+    std::vector<int> signs(ls.size(), 0);
+    for (size_t i = 0; i < ls.size(); ++i) {
+        if (ls[i].cov > 0) {
+            signs[i] = ls[i].accu <= 0 ? -1 : 1;
         }
     }
-    return rs;
+    return signs;
 }
 
 std::vector<int> LocalPhaser::Group::Centroid::Values(double rate, int count) const {
@@ -390,7 +387,7 @@ auto LocalPhaser::SplitGroups(const Group& g0, const std::vector<Group::Centroid
 
     for (auto q : g0.queries) {
         auto g = DistributeQuery(centroids, q);
-        groups[g].Merge(Group(q));
+        groups[g].Merge(q);
     }
 
     return groups;
@@ -438,7 +435,7 @@ std::vector<LocalPhaser::Group> LocalPhaser::BiKMeans(const Group& g0) {
 } 
     
 std::array<double,2> LocalPhaser::Group::CalcGroupSSE(const PhsOptions::PhaserOptions& opts) const {
-    auto centroid = GetCentroid().Values(0.5, 1);
+    BitVars centroid(GetCentroid().Values(0.5, 1));
     std::array<size_t,3> all_stat = {0, 0, 0};
     for (auto q : queries) {
         auto stat = q->Stat(centroid);
@@ -650,7 +647,7 @@ auto LocalPhaser::Combine2(const std::vector<Group> &groups) -> std::vector<Grou
 
     size_t n0 = items.size();
     for (size_t i = 0; i < items.size(); ++i) {
-        if (groups[items[i].i].queries.find(target_in_queires_) != groups[items[i].i].queries.end()) {
+        if (groups[items[i].i].Contains(target_in_queires_)) {
             n0 = i;
             break;
         }
@@ -745,7 +742,7 @@ auto LocalPhaser::Combine2(const std::vector<Group> &groups) -> std::vector<Grou
     // std::swap(combine[0], combine[best]);
     
     for (size_t i = 0; i < combine.size(); ++i) {
-        if (combine[i].queries.find(target_in_queires_) != combine[i].queries.end()) {
+        if (combine[i].Contains(target_in_queires_)) {
             if (i != 0) {
                 std::swap(combine[0], combine[i]);
             }
@@ -787,28 +784,23 @@ void LocalPhaser::FindInconsistent(const Group& g0, const Group& gx) {
 }
 
 LocalPhaser::Group::Group(const Query* q) : queries({q}), vars(q->vars.size()) {
-    for (size_t i = 0; i < q->vars.size(); ++i) {
-        auto v = q->vars[i];
-        if (v != 0) {
-            vars[i].accu = v;
-            vars[i].cov = 1;
-        }
-    }
+    q->bits.ForEach([this](size_t i, int v) {
+        vars[i].accu = v;
+        vars[i].cov = 1;
+    });
     assert(vars.size() > 0);
 }
 
-LocalPhaser::Group::Group(const std::unordered_set<const Query*>& qs)
- : queries(qs.begin(), qs.end()), vars((*qs.begin())->vars.size()) {
-
-    for (auto q : qs) {
-        for (size_t i = 0; i < q->vars.size(); ++i) {
-            auto v = q->vars[i];
-            if (v != 0) {
-                vars[i].accu += v;
-                vars[i].cov += 1;
-            }
-        }
+LocalPhaser::Group::Group(const std::vector<const Query*>& qs)
+ : queries(qs), vars((*qs.begin())->vars.size()) {
 
+    std::sort(queries.begin(), queries.end());
+    queries.erase(std::unique(queries.begin(), queries.end()), queries.end());
+    for (auto q : queries) {
+        q->bits.ForEach([this](size_t i, int v) {
+            vars[i].accu += v;
+            vars[i].cov += 1;
+        });
     }
     assert(vars.size() > 0);
 }
@@ -816,16 +808,13 @@ LocalPhaser::Group::Group(const std::unordered_set<const Query*>& qs)
 LocalPhaser::Group::Group(const std::vector<Query>& qs)
  : vars(qs.begin()->vars.size()) {
 
+    queries.reserve(qs.size());
     for (const auto &q : qs) {
-        queries.insert(&q);
-        for (size_t i = 0; i < q.vars.size(); ++i) {
-            auto v = q.vars[i];
-            if (v != 0) {
-                vars[i].accu += v;
-                vars[i].cov += 1;
-            }
-        }
-
+        queries.push_back(&q);
+        q.bits.ForEach([this](size_t i, int v) {
+            vars[i].accu += v;
+            vars[i].cov += 1;
+        });
     }
     assert(vars.size() > 0);
 }
@@ -865,25 +854,42 @@ void LocalPhaser::Group::Merge(const Group &b) {
         vars[i].Merge(b.vars[i]);
     }
 
-    queries.insert(b.queries.begin(), b.queries.end());
+    if (queries.empty() || b.queries.empty() || queries.back() < b.queries.front()) {
+        queries.insert(queries.end(), b.queries.begin(), b.queries.end());
+    } else {
+        std::vector<const Query*> merged;
+        merged.reserve(queries.size() + b.queries.size());
+        std::set_union(queries.begin(), queries.end(), b.queries.begin(), b.queries.end(), std::back_inserter(merged));
+        queries.swap(merged);
+    }
 }
 
 void LocalPhaser::Group::Merge(const Query* q) {
-    Merge(Group(q));
+    if (vars.size() == 0) vars.assign(q->vars.size(), Loc());
+    assert(vars.size() == q->vars.size());
+    q->bits.ForEach([this](size_t i, int v) {
+        vars[i].accu += v;
+        vars[i].cov += 1;
+    });
+
+    auto iter = std::lower_bound(queries.begin(), queries.end(), q);
+    if (iter == queries.end() || *iter != q) {
+        queries.insert(iter, q);
+    }
 }
 
 void LocalPhaser::Group::Remove(const Query* q) {
 
-    for (size_t i = 0; i < vars.size(); ++i) {
-        //vars[i].Remove({q->vars[i], 1});
-        if (q->vars[i] != 0) {
-            vars[i].cov -= 1;
-            vars[i].accu -= q->vars[i];
-        }
+    q->bits.ForEach([this](size_t i, int v) {
+        vars[i].cov -= 1;
+        vars[i].accu -= v;
         assert(vars[i].cov >= 0);
-    }
+    });
 
-    queries.erase(q);
+    auto iter = std::lower_bound(queries.begin(), queries.end(), q);
+    if (iter != queries.end() && *iter == q) {
+        queries.erase(iter);
+    }
 }
 
 
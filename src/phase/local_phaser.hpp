@@ -1,7 +1,9 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
 #include <cassert>
+#include <cstdint>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -44,45 +46,85 @@ public:
         int same { 0 };
     };
 
-    struct Query {
-        const ReadInfo* query;
-        const std::vector<int> vars;  // -1, 0, 1
-        size_t Size() const { 
-            return std::accumulate(vars.begin(), vars.end(), 0, [](size_t a, int v) {
-                return a += (v != 0 ? 1 : 0);
-            });
+    // 位点值按位存储, covered的第i位表示值非0, positive的第i位表示值为1
+    struct BitVars {
+        BitVars() {}
+        BitVars(const std::vector<int>& vs) : covered((vs.size() + 63) / 64, 0), positive(covered.size(), 0) {
+            for (size_t i = 0; i < vs.size(); ++i) {
+                if (vs[i] != 0) covered[i / 64] |= (uint64_t)1 << (i % 64);
+                if (vs[i] == 1) positive[i / 64] |= (uint64_t)1 << (i % 64);
+            }
+        }
+
+        size_t Count(size_t begin, size_t end) const { return Count(covered, begin, end); }
+        size_t PCount(size_t begin, size_t end) const { return Count(positive, begin, end); }
+
+        // 比较[begin, end)内的位点, 返回 (值相反, 有一方为0, 值相同) 的数目
+        std::array<size_t, 3> Stat(const BitVars& b, size_t begin, size_t end) const {
+            assert(b.covered.size() == covered.size());
+            size_t common = 0;
+            size_t diff = 0;
+            for (size_t w = begin / 64; w * 64 < end; ++w) {
+                uint64_t both = covered[w] & b.covered[w] & Mask(w, begin, end);
+                common += __builtin_popcountll(both);
+                diff += __builtin_popcountll(both & (positive[w] ^ b.positive[w]));
+            }
+            return {diff, end - begin - common, common - diff};
         }
 
-        size_t PSize() const {
-            return std::accumulate(vars.begin(), vars.end(), 0, [](size_t a, int v) {
-                return a += (v == 1 ? 1 : 0);
-            });
+        // 按位点顺序访问非0值, func(i, v), v为-1或1
+        template<typename F>
+        void ForEach(F func) const {
+            for (size_t w = 0; w < covered.size(); ++w) {
+                for (uint64_t m = covered[w]; m != 0; m &= m - 1) {
+                    size_t b = __builtin_ctzll(m);
+                    func(w * 64 + b, (positive[w] >> b) & 1 ? 1 : -1);
+                }
+            }
         }
 
-        size_t NSize() const {
-            return std::accumulate(vars.begin(), vars.end(), 0, [](size_t a, int v) {
-                return a += (v == -1 ? 1 : 0);
-            });
+        static uint64_t Mask(size_t w, size_t begin, size_t end) {
+            size_t lo = std::max(begin, w * 64) - w * 64;
+            size_t hi = std::min(end, w * 64 + 64) - w * 64;
+            uint64_t m = hi >= 64 ? ~(uint64_t)0 : ((uint64_t)1 << hi) - 1;
+            return m & (~(uint64_t)0 << lo);
         }
 
-        size_t Distance(const Query* b) const {
-            std::array<size_t, 3> stat = {0, 0, 0};
-            for (size_t i= 0; i < vars.size(); ++i) {
-                stat[1 + vars[i]*b->vars[i]] ++;
+        static size_t Count(const std::vector<uint64_t>& words, size_t begin, size_t end) {
+            size_t n = 0;
+            for (size_t w = begin / 64; w * 64 < end; ++w) {
+                n += __builtin_popcountll(words[w] & Mask(w, begin, end));
             }
-            return stat[0];
+            return n;
+        }
+
+        std::vector<uint64_t> covered;
+        std::vector<uint64_t> positive;
+    };
+
+    struct Query {
+        Query(const ReadInfo* q, const std::vector<int>& vs) : query(q), vars(vs), bits(vs) {}
+
+        const ReadInfo* query;
+        const std::vector<int> vars;  // -1, 0, 1
+        const BitVars bits;
+
+        size_t Size() const { return bits.Count(0, vars.size()); }
+        size_t PSize() const { return bits.PCount(0, vars.size()); }
+        size_t NSize() const { return Size() - PSize(); }
+
+        size_t Distance(const Query* b) const {
+            return Stat(b)[0];
         }
 
         std::array<size_t, 3> Stat(const Query* b) const {
-            return Stat(b->vars);
+            return bits.Stat(b->bits, 0, vars.size());
         }
 
         std::array<size_t, 3> Stat() const {
-            std::array<size_t, 3> stat = {0, 0, 0};
-            for (size_t i= 0; i < vars.size(); ++i) {
-                stat[1 + vars[i]] ++;
-            }
-            return stat;
+            size_t n = NSize();
+            size_t p = PSize();
+            return {n, vars.size() - n - p, p};
         }
 
         double Similariry(const Query* b) const {
@@ -90,13 +132,8 @@ public:
             return stat[0] * 1.0 / (stat[0] + stat[2]);
         }
 
-        std::array<size_t, 3> Stat(const std::vector<int> &c) const {
-            assert(c.size() == vars.size());
-            std::array<size_t, 3> stat = {0, 0, 0};
-            for (size_t i = 0; i < vars.size(); ++i) {
-                stat[1 + vars[i]*c[i]] ++;
-            }
-            return stat;
+        std::array<size_t, 3> Stat(const BitVars &c) const {
+            return bits.Stat(c, 0, vars.size());
         }
 
         static double Coverage(const std::array<size_t,3>& stat, size_t size) {
@@ -157,7 +194,7 @@ public:
         };
 
         struct Centroid {
-            Centroid(const std::vector<Loc>& ls) : locs(ls), range({0, ls.size()}) {}
+            Centroid(const std::vector<Loc>& ls) : locs(ls), range({0, ls.size()}), bits(Signs(ls)) {}
 
             double Distance(const Query& q) const;
 
@@ -168,18 +205,21 @@ public:
             CompareResult Compare(const Query &q) const;
             std::vector<int> Values(double rate, int count) const;
             std::vector<int> Values(double rate, int count, const Centroid& alt) const;
+            static std::vector<int> Signs(const std::vector<Loc>& ls);
             std::vector<Loc> locs;
             std::array<size_t, 2> range;
+            BitVars bits;       // 有覆盖的位点按accu的正负取值, 见Compare
         };
 
         Group() {};
         Group(const Query* q);
-        Group(const std::unordered_set<const Query*>& qs);
+        Group(const std::vector<const Query*>& qs);
         Group(const std::vector<Query>& qs);
 
 
 
         size_t Size() const { return queries.size(); }
+        bool Contains(const Query* q) const { return std::binary_search(queries.begin(), queries.end(), q); }
         std::array<int, 3> StatDiffs() const ;
         std::array<int, 3> StatDiffs(double support_rate) const ;
         std::array<int, 3> StatDiffs(double support_rate, int support) const ;
@@ -219,7 +259,7 @@ public:
         bool Connected() const ;
         std::vector<Group> Split() const;
 
-        std::unordered_set<const Query*> queries;
+        std::vector<const Query*> queries;      // 按地址(即在queries_中的下标)排序
         std::vector<Loc> vars;  // ((-n, 0, n), cov
     };
 
@@ -17,11 +17,15 @@ void PhsOptions::SetArguments(ArgumentParser &ap) {
     ap.AddNamedOption(phase_opts_str_, "phase_options", "Phasing options");
     ap.AddNamedOption(snp_match_length_, "snp_match_length", "");
     ap.AddNamedOption(rd2rd, "rd2rd", "overlaps between reads");
+    ap.AddNamedOption(window_size_, "window_size", "window size of splitting a contig, the windows of a contig are processed in parallel");
     ap.AddNamedOption(loglevel, "loglevel", "the larger the value(0-4), the more detailed the log. ");
     
 }
 
 void PhsOptions::CheckArguments() {
+    if (window_size_ <= 0) {
+        LOG(ERROR)("window_size should be greater than 0");
+    }
 
     filter_opts_.From(filter_opts_str_);
     cov_opts_.From(cov_opts_str_);
@@ -79,6 +79,7 @@ public:
     int variant_type_ { 1 };
     int snp_match_length_ { 3 };
     int max_count { 6 };
+    int window_size_ { 1000000 };       //!< contigs are split into windows of this size, which are processed by idle threads
     std::atomic<size_t> curr_thread_size { 0 };
     int loglevel { 0 };
 
@@ -3,6 +3,8 @@
 #include <unordered_set>
 #include <iostream>
 #include <atomic>
+#include <cstdio>
+#include <fstream>
 #include "../utils/logger.hpp"
 #include "overlap_store.hpp"
 #include "utility.hpp"
@@ -47,11 +49,17 @@ void ReadHaplotype::FindVariants() {
     std::ofstream of_phased(opts_.Inconsistent());
     std::ofstream of_consistent(opts_.Consistent());
     
-    auto dump_func = [&](std::ostringstream &oss_vars, std::ostringstream &oss_rdinfos, std::ostringstream &oss_phased, std::ostringstream &oss_consistent) {
+    // 变异计数的规模与contig长度相同，先写入每个线程的临时文件，不保存在内存中
+    auto dump_func = [&](const std::string &tmp_vars, std::ofstream &of_tmp_vars, std::ostringstream &oss_rdinfos, std::ostringstream &oss_phased, std::ostringstream &oss_consistent) {
         std::lock_guard<std::mutex> lock(mutex);
 
-        of_vars << oss_vars.str();
-        oss_vars.str("");
+        of_tmp_vars.close();
+        std::ifstream in_tmp_vars(tmp_vars);
+        if (in_tmp_vars.peek() != std::ifstream::traits_type::eof()) {
+            of_vars << in_tmp_vars.rdbuf();
+        }
+        in_tmp_vars.close();
+        of_tmp_vars.open(tmp_vars);
 
         of_rdinfos << oss_rdinfos.str();
         oss_rdinfos.str("");
@@ -69,7 +77,8 @@ void ReadHaplotype::FindVariants() {
 
     auto work_func = [&](size_t i) {
         opts_.curr_thread_size.fetch_add(1);
-        std::ostringstream oss_vars;
+        std::string tmp_vars = opts_.Varaints() + "." + std::to_string(i);
+        std::ofstream of_tmp_vars(tmp_vars);
         std::ostringstream oss_rdinfos;
         std::ostringstream oss_phased;
         std::ostringstream oss_consistent;
@@ -80,16 +89,17 @@ void ReadHaplotype::FindVariants() {
         
             LOG(INFO)("Begin Contig %s, %zd/%zd", dataset_.QueryNameById(c).c_str(), curr, contigs_list.size());
 
-            ContigPhaser phaser(c, dataset_, opts_);
+            ContigPhaser phaser(c, dataset_, opts_, &of_tmp_vars);
             
             phaser.DumpReadInfos(oss_rdinfos);
             phaser.DumpInconsistent(oss_phased);
-            phaser.DumpVariants(oss_vars);
             phaser.DumpConsistent(oss_consistent);
             LOG(INFO)("End Contig %s", dataset_.QueryNameById(c).c_str());
             curr = index.fetch_add(1);
-            dump_func(oss_vars, oss_rdinfos, oss_phased, oss_consistent);
+            dump_func(tmp_vars, of_tmp_vars, oss_rdinfos, oss_phased, oss_consistent);
         }
+        of_tmp_vars.close();
+        std::remove(tmp_vars.c_str());
         opts_.curr_thread_size.fetch_add(-1);
     };
 
@@ -166,6 +166,18 @@ void ReadStore::LoadItem(Item &item) const {
     }
 }
 
+void ReadStore::LoadItems(const std::vector<Seq::Id> &ids) const {
+    for (auto id : ids) {
+        if (id >= 0 && (size_t)id < items_.size()) LoadItem(items_[id]);
+    }
+}
+
+void ReadStore::ReleaseItems(const std::vector<Seq::Id> &ids) const {
+    for (auto id : ids) {
+        if (id >= 0 && (size_t)id < items_.size() && items_[id].reader != nullptr) items_[id].seq = DnaSeq();
+    }
+}
+
 void ReadStore::SaveIdToName(const std::string &fname) const {
     string_pool_.Save(fname);
 }
@@ -51,6 +51,9 @@ public:
     void LoadFofn(const std::string &fname, bool all, const std::unordered_set<Seq::Id>& seqids);
     void LoadTxt(const std::string &fname, bool all, const std::unordered_set<Seq::Id>& seqids) { LoadFofn(fname, all, seqids); }
     void LoadItem(Item &item) const;
+    // 载入或释放ids的序列，只用于有reader的read，释放后GetSeq会重新载入。分块处理时用于只保留当前块的序列
+    void LoadItems(const std::vector<Seq::Id> &ids) const;
+    void ReleaseItems(const std::vector<Seq::Id> &ids) const;
     
     const std::unordered_set<Seq::Id>& IdsInFile(const std::string &fname) const;
 
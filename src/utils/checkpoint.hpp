@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "logger.hpp"
+
+namespace fsa {
+
+// Records which items (reads or contigs, indexed by id) have been written, together with the
+// sizes of the output files at that moment. The caller saves it while the output streams are
+// consistent with the bitmap, e.g. under the lock of the writer. When a job is resumed, the
+// output files are truncated to the recorded sizes and the marked items are skipped, so at most
+// the items written after the last checkpoint are computed again.
+class Checkpoint {
+public:
+    Checkpoint(const std::string &fname, size_t size) : fname_(fname), size_(size), bits_((size + 63) / 64, 0) {}
+
+    void Set(size_t i) { bits_[i / 64] |= (uint64_t)1 << (i % 64); }
+    bool Test(size_t i) const { return i < size_ && (bits_[i / 64] >> (i % 64)) & 1; }
+
+    // Flushes the streams and writes the checkpoint. It is written to a temporary file and renamed,
+    // so a crash during saving leaves the previous checkpoint intact.
+    void Save(const std::vector<std::ostream*> &streams) {
+        offsets_.clear();
+        for (auto s : streams) {
+            if (s != nullptr) {
+                s->flush();
+                offsets_.push_back((int64_t)s->tellp());
+            } else {
+                offsets_.push_back(-1);
+            }
+        }
+
+        std::string tmp = fname_ + ".tmp";
+        std::ofstream of(tmp, std::ios::binary);
+        uint64_t size = size_;
+        uint64_t count = offsets_.size();
+        of.write(Magic(), 8);
+        of.write((const char*)&size, sizeof(size));
+        of.write((const char*)&count, sizeof(count));
+        of.write((const char*)offsets_.data(), sizeof(offsets_[0]) * offsets_.size());
+        of.write((const char*)bits_.data(), sizeof(bits_[0]) * bits_.size());
+        of.close();
+
+        if (!of || std::rename(tmp.c_str(), fname_.c_str()) != 0) {
+            LOG(WARNING)("Failed to save checkpoint: %s", fname_.c_str());
+        }
+    }
+
+    // Returns false if there is no checkpoint.
+    bool Load() {
+        std::ifstream in(fname_, std::ios::binary);
+        if (!in.is_open()) return false;
+
+        char magic[8];
+        uint64_t size = 0;
+        uint64_t count = 0;
+        in.read(magic, 8);
+        in.read((char*)&size, sizeof(size));
+        in.read((char*)&count, sizeof(count));
+        if (!in || std::string(magic, 8) != std::string(Magic(), 8) || size != size_) {
+            LOG(ERROR)("Checkpoint %s doesn't match the input", fname_.c_str());
+        }
+        offsets_.assign(count, 0);
+        in.read((char*)offsets_.data(), sizeof(offsets_[0]) * offsets_.size());
+        in.read((char*)bits_.data(), sizeof(bits_[0]) * bits_.size());
+        if (!in) LOG(ERROR)("Failed to load checkpoint: %s", fname_.c_str());
+        return true;
+    }
+
+    // Truncates the files to the sizes recorded in the checkpoint, in the order passed to Save.
+    void Restore(const std::vector<std::string> &fnames) const {
+        for (size_t i = 0; i < fnames.size() && i < offsets_.size(); ++i) {
+            if (offsets_[i] >= 0 && truncate(fnames[i].c_str(), (off_t)offsets_[i]) != 0) {
+                LOG(ERROR)("Failed to truncate file %s to %lld", fnames[i].c_str(), (long long)offsets_[i]);
+            }
+        }
+    }
+
+    void Remove() const { std::remove(fname_.c_str()); }
+
+protected:
+    static const char* Magic() { return "FSACKPT1"; }
+
+protected:
+    std::string fname_;
+    size_t size_;
+    std::vector<uint64_t> bits_;
+    std::vector<int64_t> offsets_;
+};
+
+} // namespace fsa {
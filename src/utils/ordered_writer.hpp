@@ -0,0 +1,65 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace fsa {
+
+// Writes blocks produced by multiple threads in the order of their serial numbers, so the
+// output does not depend on the thread size or timing. Each item carries one block per
+// stream and is written when all items with smaller serial numbers have been written.
+// At most `window` items are buffered: a thread whose item is too far ahead waits until
+// the gap is filled. The item next to be written is always accepted, so the threads
+// holding smaller serial numbers are never blocked by the waiting one.
+class OrderedWriter {
+public:
+    OrderedWriter(const std::vector<std::ostream*> &streams, size_t window, size_t first=0)
+        : streams_(streams), window_(window > 0 ? window : 1), next_(first) {}
+
+    void Put(size_t sn, std::vector<std::string> &&blocks) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait(lock, [this, sn]() { return sn < next_ + window_; });
+
+        pending_[sn] = std::move(blocks);
+
+        bool advanced = false;
+        while (!pending_.empty() && pending_.begin()->first == next_) {
+            const auto &blocks = pending_.begin()->second;
+            for (size_t i = 0; i < streams_.size() && i < blocks.size(); ++i) {
+                if (streams_[i] != nullptr && !blocks[i].empty()) {
+                    *streams_[i] << blocks[i];
+                }
+            }
+            pending_.erase(pending_.begin());
+            if (written_) written_(next_);
+            next_++;
+            advanced = true;
+        }
+
+        if (advanced) cond_.notify_all();
+    }
+
+    // Called under the lock after the item has been written to the streams.
+    void SetWritten(std::function<void(size_t sn)> written) { written_ = written; }
+
+    size_t Next() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return next_;
+    }
+
+protected:
+    std::vector<std::ostream*> streams_;
+    size_t window_;
+    size_t next_;
+    std::map<size_t, std::vector<std::string>> pending_;
+    mutable std::mutex mutex_;
+    std::condition_variable cond_;
+    std::function<void(size_t)> written_;
+};
+
+} // namespace fsa {
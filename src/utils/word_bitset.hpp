@@ -0,0 +1,91 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace fsa {
+
+// Fixed-size bit set with the subset of the std::bitset interface used by the correctors. Unlike
+// std::bitset its 64-bit words are accessible, so the set bits can be visited one word at a time
+// without copying or shifting the whole set.
+template<size_t N>
+class WordBitset {
+public:
+    static const size_t WORD_BITS = 64;
+    static const size_t WORD_SIZE = (N + WORD_BITS - 1) / WORD_BITS;
+
+    WordBitset() { reset(); }
+
+    size_t size() const { return N; }
+    bool operator [] (size_t i) const { return test(i); }
+    bool test(size_t i) const { return (words_[i / WORD_BITS] >> (i % WORD_BITS)) & 1; }
+
+    WordBitset& set(size_t i, bool v=true) {
+        if (v) words_[i / WORD_BITS] |= uint64_t(1) << (i % WORD_BITS);
+        else   words_[i / WORD_BITS] &= ~(uint64_t(1) << (i % WORD_BITS));
+        return *this;
+    }
+    WordBitset& reset(size_t i) { return set(i, false); }
+    WordBitset& reset() { std::fill(words_, words_ + WORD_SIZE, 0); return *this; }
+
+    bool any() const {
+        return std::any_of(words_, words_ + WORD_SIZE, [](uint64_t w) { return w != 0; });
+    }
+
+    size_t count() const {
+        size_t c = 0;
+        for (size_t i = 0; i < WORD_SIZE; ++i) c += PopCount(words_[i]);
+        return c;
+    }
+
+    WordBitset& operator &= (const WordBitset &b) {
+        for (size_t i = 0; i < WORD_SIZE; ++i) words_[i] &= b.words_[i];
+        return *this;
+    }
+    WordBitset operator & (const WordBitset &b) const { return WordBitset(*this) &= b; }
+
+    // Calls func(i) for each set bit in ascending order.
+    template<typename F>
+    void ForEach(F func) const {
+        for (size_t w = 0; w < WORD_SIZE; ++w) {
+            for (uint64_t word = words_[w]; word != 0; word &= word - 1) {
+                func(w * WORD_BITS + CountTrailingZeros(word));
+            }
+        }
+    }
+
+    // The highest bit first, the same as std::bitset::to_string.
+    std::string to_string() const {
+        std::string s(N, '0');
+        ForEach([&s](size_t i) { s[N - 1 - i] = '1'; });
+        return s;
+    }
+
+    static size_t PopCount(uint64_t w) {
+#if defined(__GNUC__)
+        return __builtin_popcountll(w);
+#else
+        size_t c = 0;
+        for (; w != 0; w &= w - 1) c++;
+        return c;
+#endif
+    }
+
+    // w must not be 0
+    static size_t CountTrailingZeros(uint64_t w) {
+#if defined(__GNUC__)
+        return __builtin_ctzll(w);
+#else
+        size_t c = 0;
+        for (; (w & 1) == 0; w >>= 1) c++;
+        return c;
+#endif
+    }
+
+protected:
+    uint64_t words_[WORD_SIZE];
+};
+
+} // namespace fsa {